@@ -0,0 +1,358 @@
+/**
+ * @file lookup.cpp
+ *
+ * Measures the cost of the lookup API (contains, get, get_as,
+ * get_qualified, get_qualified_as and get_array_of) on a generated
+ * document. The document has two tables, "values" (integers) and
+ * "arrays" (arrays of integers), holding the same keys and nested
+ * --depth levels below the root. Lookups draw their keys from a Zipf
+ * distribution over the table's keys (--zipf 0 is uniform), mixed with
+ * keys of the same length that are not in the table according to
+ * --hit-ratio.
+ *
+ * Each accessor is timed with one reader thread and, when --threads is
+ * more than one, with that many threads reading the same document. The
+ * report gives nanoseconds and heap allocations per lookup. The same
+ * source is built once per storage policy (cpptoml-bench-lookup for the
+ * default unordered_map, cpptoml-bench-lookup-map for CPPTOML_USE_MAP
+ * and cpptoml-bench-lookup-ordered for CPPTOML_USE_INSERTION_ORDER) so
+ * that they can be compared.
+ */
+
+#include "cpptoml.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// GCC pairs the inlined replacements below with the allocations they
+// replace and then flags the malloc/free inside them as mismatched
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+namespace
+{
+std::atomic<std::uint64_t> allocations{0};
+}
+
+void* operator new(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (auto p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc{};
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace
+{
+using clock_type = std::chrono::steady_clock;
+
+struct options
+{
+    std::size_t keys = 1000;
+    std::size_t key_length = 16;
+    std::size_t depth = 3;
+    double hit_ratio = 0.9;
+    double zipf = 1.0;
+    unsigned threads = 4;
+    std::size_t ops = 1000000;
+};
+
+/**
+ * A random key of the given length made of characters valid in a bare
+ * key.
+ */
+std::string random_key(std::mt19937_64& rng, std::size_t length)
+{
+    static const char chars[] = "abcdefghijklmnopqrstuvwxyz0123456789_-";
+    std::uniform_int_distribution<std::size_t> pick{0, sizeof(chars) - 2};
+    std::string key;
+    for (std::size_t i = 0; i < length; ++i)
+        key += chars[pick(rng)];
+    return key;
+}
+
+/**
+ * The generated document and the keys to look up in it.
+ */
+struct workload
+{
+    std::shared_ptr<cpptoml::table> root;
+    std::shared_ptr<cpptoml::table> values;
+    std::shared_ptr<cpptoml::table> arrays;
+
+    // the keys to look up, in order, with their paths from the root
+    std::vector<std::string> keys;
+    std::vector<std::string> paths;
+    std::vector<std::string> array_paths;
+
+    // the subset of keys (and paths) that are in the tables, for the
+    // accessors that throw on a miss
+    std::vector<std::string> hit_keys;
+    std::vector<std::string> hit_paths;
+};
+
+workload make_workload(const options& opts)
+{
+    std::mt19937_64 rng{42};
+    workload w;
+
+    std::vector<std::string> present;
+    while (present.size() < opts.keys)
+    {
+        auto key = random_key(rng, opts.key_length);
+        if (std::find(present.begin(), present.end(), key) == present.end())
+            present.push_back(key);
+    }
+
+    w.root = cpptoml::make_table();
+    auto parent = w.root;
+    std::string prefix;
+    for (std::size_t i = 0; i < opts.depth; ++i)
+    {
+        auto name = "level" + std::to_string(i);
+        auto child = cpptoml::make_table();
+        parent->insert(name, child);
+        parent = child;
+        prefix += name + ".";
+    }
+    w.values = cpptoml::make_table();
+    w.arrays = cpptoml::make_table();
+    parent->insert("values", w.values);
+    parent->insert("arrays", w.arrays);
+    for (std::size_t i = 0; i < present.size(); ++i)
+    {
+        w.values->insert(present[i], static_cast<int64_t>(i));
+        auto arr = cpptoml::make_array();
+        for (int64_t j = 0; j < 4; ++j)
+            arr->push_back(static_cast<int64_t>(i) + j);
+        w.arrays->insert(present[i], arr);
+    }
+
+    // Zipf weights over the keys, with ranks assigned in random order so
+    // that the hot keys are spread through the table
+    std::vector<double> cumulative(present.size());
+    double total = 0;
+    for (std::size_t i = 0; i < present.size(); ++i)
+    {
+        total += 1.0 / std::pow(static_cast<double>(i + 1), opts.zipf);
+        cumulative[i] = total;
+    }
+    std::shuffle(present.begin(), present.end(), rng);
+
+    std::uniform_real_distribution<double> uniform{0, 1};
+    auto sequence = std::min<std::size_t>(opts.ops, 1 << 20);
+    for (std::size_t i = 0; i < sequence; ++i)
+    {
+        std::string key;
+        if (uniform(rng) < opts.hit_ratio)
+        {
+            auto it = std::lower_bound(cumulative.begin(), cumulative.end(),
+                                       uniform(rng) * total);
+            auto rank = std::min<std::size_t>(it - cumulative.begin(),
+                                              present.size() - 1);
+            key = present[rank];
+            w.hit_keys.push_back(key);
+            w.hit_paths.push_back(prefix + "values." + key);
+        }
+        else
+        {
+            // a miss that still has to be hashed or compared in full
+            key = random_key(rng, opts.key_length);
+        }
+        w.keys.push_back(key);
+        w.paths.push_back(prefix + "values." + key);
+        w.array_paths.push_back(prefix + "arrays." + key);
+    }
+    return w;
+}
+
+/**
+ * Runs lookup(i) for i in [0, ops) on each of threads threads at once,
+ * returning the mean nanoseconds per lookup seen by a thread and the heap
+ * allocations per lookup.
+ */
+template <class Lookup>
+std::pair<double, double> run(std::size_t ops, unsigned threads,
+                              const Lookup& lookup)
+{
+    std::atomic<unsigned> ready{0};
+    std::atomic<bool> go{false};
+    std::vector<double> elapsed(threads);
+    std::vector<std::thread> readers;
+
+    for (unsigned t = 0; t < threads; ++t)
+    {
+        readers.emplace_back([&, t]() {
+            ready.fetch_add(1);
+            while (!go.load())
+                std::this_thread::yield();
+
+            std::size_t sink = 0;
+            auto start = clock_type::now();
+            for (std::size_t i = 0; i < ops; ++i)
+                sink += lookup(i);
+            elapsed[t] = std::chrono::duration<double, std::nano>(
+                             clock_type::now() - start)
+                             .count();
+
+            // keep the lookups from being optimized away
+            if (sink == static_cast<std::size_t>(-1))
+                std::cerr << "";
+        });
+    }
+
+    while (ready.load() < threads)
+        std::this_thread::yield();
+    auto before = allocations.load();
+    go.store(true);
+    for (auto& reader : readers)
+        reader.join();
+    auto allocs = allocations.load() - before;
+
+    double mean = 0;
+    for (auto e : elapsed)
+        mean += e;
+    mean /= threads;
+    return {mean / ops,
+            static_cast<double>(allocs) / (static_cast<double>(ops) * threads)};
+}
+
+template <class Lookup>
+void report(const std::string& accessor, const options& opts,
+            std::size_t keys, const Lookup& lookup)
+{
+    if (keys == 0)
+    {
+        std::cout << std::left << std::setw(26) << accessor
+                  << "(no keys to look up)\n";
+        return;
+    }
+
+    auto indexed = [&](std::size_t i) { return lookup(i % keys); };
+    std::vector<unsigned> counts{1};
+    if (opts.threads > 1)
+        counts.push_back(opts.threads);
+    for (auto threads : counts)
+    {
+        auto result = run(opts.ops, threads, indexed);
+        std::cout << std::left << std::setw(26) << accessor << std::right
+                  << std::setw(8) << threads << std::fixed
+                  << std::setprecision(1) << std::setw(10) << result.first
+                  << std::setprecision(2) << std::setw(12) << result.second
+                  << "\n";
+    }
+}
+
+bool parse_args(int argc, char** argv, options& opts)
+{
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        std::string arg{argv[i]};
+        std::string val{argv[i + 1]};
+        if (arg == "--keys")
+            opts.keys = std::strtoull(val.c_str(), nullptr, 10);
+        else if (arg == "--key-length")
+            opts.key_length = std::strtoull(val.c_str(), nullptr, 10);
+        else if (arg == "--depth")
+            opts.depth = std::strtoull(val.c_str(), nullptr, 10);
+        else if (arg == "--hit-ratio")
+            opts.hit_ratio = std::atof(val.c_str());
+        else if (arg == "--zipf")
+            opts.zipf = std::atof(val.c_str());
+        else if (arg == "--threads")
+            opts.threads = static_cast<unsigned>(std::atoi(val.c_str()));
+        else if (arg == "--ops")
+            opts.ops = std::strtoull(val.c_str(), nullptr, 10);
+        else
+            return false;
+    }
+    return argc % 2 == 1 && opts.keys > 0 && opts.key_length > 0
+           && opts.threads > 0 && opts.ops > 0;
+}
+}
+
+int main(int argc, char** argv)
+{
+    options opts;
+    if (!parse_args(argc, argv, opts))
+    {
+        std::cerr << "Usage: " << argv[0]
+                  << " [--keys n] [--key-length n] [--depth n]"
+                     " [--hit-ratio r] [--zipf s] [--threads n] [--ops n]"
+                  << std::endl;
+        return 1;
+    }
+
+    auto w = make_workload(opts);
+
+#if defined(CPPTOML_USE_MAP)
+    std::cout << "storage=map";
+#elif defined(CPPTOML_USE_INSERTION_ORDER)
+    std::cout << "storage=insertion_ordered";
+#else
+    std::cout << "storage=unordered_map";
+#endif
+    std::cout << " keys=" << opts.keys << " key-length=" << opts.key_length
+              << " depth=" << opts.depth << " hit-ratio=" << opts.hit_ratio
+              << " zipf=" << opts.zipf << " ops=" << opts.ops << "\n";
+    std::cout << std::left << std::setw(26) << "accessor" << std::right
+              << std::setw(8) << "threads" << std::setw(10) << "ns/op"
+              << std::setw(12) << "allocs/op"
+              << "\n";
+
+    const auto& values = *w.values;
+    const auto& arrays = *w.arrays;
+    const auto& root = *w.root;
+
+    report("contains", opts, w.keys.size(), [&](std::size_t i) {
+        return values.contains(w.keys[i]) ? 1 : 0;
+    });
+    report("get (hits only)", opts, w.hit_keys.size(), [&](std::size_t i) {
+        return values.get(w.hit_keys[i]) ? 1 : 0;
+    });
+    report("get_as<int64_t>", opts, w.keys.size(), [&](std::size_t i) {
+        return static_cast<std::size_t>(
+            values.get_as<int64_t>(w.keys[i]).value_or(0));
+    });
+    report("get_array_of<int64_t>", opts, w.keys.size(), [&](std::size_t i) {
+        auto arr = arrays.get_array_of<int64_t>(w.keys[i]);
+        return arr ? arr->size() : 0;
+    });
+    report("get_qualified (hits only)", opts, w.hit_paths.size(),
+           [&](std::size_t i) {
+               return root.get_qualified(w.hit_paths[i]) ? 1 : 0;
+           });
+    report("get_qualified_as", opts, w.paths.size(), [&](std::size_t i) {
+        return static_cast<std::size_t>(
+            root.get_qualified_as<int64_t>(w.paths[i]).value_or(0));
+    });
+    report("get_qualified_array_of", opts, w.array_paths.size(),
+           [&](std::size_t i) {
+               auto arr
+                   = root.get_qualified_array_of<int64_t>(w.array_paths[i]);
+               return arr ? arr->size() : 0;
+           });
+    return 0;
+}
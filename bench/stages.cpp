@@ -0,0 +1,367 @@
+/**
+ * @file stages.cpp
+ *
+ * Breaks the cost of parsing a corpus down by parser stage (reading
+ * lines, skipping whitespace and comments, keys, strings, numbers, dates
+ * and table headers): time, and cycles, instructions, branch
+ * mispredictions and cache misses from Linux perf_event_open counters.
+ * The counters are read at every stage transition through a
+ * stage_observer
+ * (which requires the parser to be built with CPPTOML_PROFILE_STAGES)
+ * and charged to the innermost stage, so each stage's figures exclude
+ * the stages nested in it. Time spent in the parser outside of any of
+ * those stages (value dispatch, arrays and inline tables, building the
+ * tree) is reported as "other".
+ *
+ * Time is read from the steady clock, and the hardware counters (which
+ * only count user-space events) with one read() of the event group. What
+ * the counters see of reading them is calibrated before the run and
+ * subtracted from every interval, but stages entered very often
+ * (whitespace in particular) are still perturbed the most. Hardware
+ * counters that the machine does not expose (for instance in most
+ * virtual machines) are reported as n/a.
+ */
+
+#include "cpptoml.h"
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace
+{
+const std::size_t num_stages = 8;
+const std::size_t other_stage = 7;
+const char* const stage_names[num_stages]
+    = {"line",   "whitespace", "key",    "string",
+       "number", "date",       "header", "other"};
+
+struct event_spec
+{
+    const char* name;
+    uint32_t type;
+    uint64_t config;
+};
+
+const std::size_t num_events = 5;
+// the first "event" is the steady clock rather than a perf event
+const event_spec event_specs[num_events]
+    = {{"ns", 0, 0},
+       {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+       {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+       {"branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+       {"cache-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES}};
+
+using counts = std::array<uint64_t, num_events>;
+
+/**
+ * The clock and the hardware events that could be opened, the latter as
+ * one perf event group so that they are all read with a single system
+ * call.
+ */
+class counter_group
+{
+  public:
+    counter_group()
+    {
+        slot_.fill(-1);
+        int opened = 0;
+        for (std::size_t i = 1; i < num_events; ++i)
+        {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = event_specs[i].type;
+            attr.config = event_specs[i].config;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP;
+            attr.disabled = leader_ < 0;
+
+            auto fd = static_cast<int>(
+                syscall(__NR_perf_event_open, &attr, 0, -1, leader_, 0));
+            if (fd < 0)
+                continue;
+            if (leader_ < 0)
+                leader_ = fd;
+            else
+                members_.push_back(fd);
+            slot_[i] = opened++;
+        }
+        if (leader_ >= 0)
+            ioctl(leader_, PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    ~counter_group()
+    {
+        for (auto fd : members_)
+            close(fd);
+        if (leader_ >= 0)
+            close(leader_);
+    }
+
+    counter_group(const counter_group&) = delete;
+    counter_group& operator=(const counter_group&) = delete;
+
+    bool has_hardware() const
+    {
+        return leader_ >= 0;
+    }
+
+    bool available(std::size_t event) const
+    {
+        return event == 0 || slot_[event] >= 0;
+    }
+
+    void read(counts& out) const
+    {
+        out[0] = static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch())
+                .count());
+        if (leader_ < 0)
+            return;
+
+        // PERF_FORMAT_GROUP: the number of events, then their values
+        uint64_t buf[num_events];
+        if (::read(leader_, buf, sizeof(buf)) < 0)
+            std::memset(buf, 0, sizeof(buf));
+        for (std::size_t i = 1; i < num_events; ++i)
+            out[i] = slot_[i] >= 0 ? buf[1 + slot_[i]] : 0;
+    }
+
+  private:
+    int leader_ = -1;
+    std::vector<int> members_;
+    std::array<int, num_events> slot_;
+};
+
+/**
+ * Charges the counters between consecutive stage transitions to the
+ * innermost active stage.
+ */
+class stage_profiler : public cpptoml::stage_observer
+{
+  public:
+    explicit stage_profiler(const counter_group& counters)
+        : counters_(counters)
+    {
+        for (auto& t : totals_)
+            t.fill(0);
+        intervals_.fill(0);
+        calls_.fill(0);
+        overhead_.fill(0);
+        calibrate();
+    }
+
+    void enter(cpptoml::parse_stage stage) override
+    {
+        transition();
+        auto s = static_cast<std::size_t>(stage);
+        active_.push_back(s);
+        ++calls_[s];
+    }
+
+    void leave(cpptoml::parse_stage) override
+    {
+        transition();
+        active_.pop_back();
+    }
+
+    /**
+     * Starts charging to "other" until stop().
+     */
+    void start()
+    {
+        active_.assign(1, other_stage);
+        ++calls_[other_stage];
+        counters_.read(last_);
+    }
+
+    void stop()
+    {
+        transition();
+        active_.clear();
+    }
+
+    /**
+     * The total of an event in a stage, less the cost of reading the
+     * counters.
+     */
+    double total(std::size_t stage, std::size_t event) const
+    {
+        auto cost = static_cast<double>(intervals_[stage]) * overhead_[event];
+        auto t = static_cast<double>(totals_[stage][event]) - cost;
+        return t > 0 ? t : 0;
+    }
+
+    uint64_t calls(std::size_t stage) const
+    {
+        return calls_[stage];
+    }
+
+  private:
+    void transition()
+    {
+        counts now;
+        counters_.read(now);
+        auto& t = totals_[active_.back()];
+        for (std::size_t i = 0; i < num_events; ++i)
+            t[i] += now[i] - last_[i];
+        ++intervals_[active_.back()];
+        last_ = now;
+    }
+
+    /**
+     * Measures what the counters see of a read of the counters.
+     */
+    void calibrate()
+    {
+        const int reads = 20000;
+        counts first;
+        counts last;
+        counters_.read(first);
+        for (int i = 0; i < reads; ++i)
+            counters_.read(last);
+        for (std::size_t i = 0; i < num_events; ++i)
+            overhead_[i] = static_cast<double>(last[i] - first[i]) / reads;
+    }
+
+    const counter_group& counters_;
+    std::vector<std::size_t> active_;
+    counts last_;
+    std::array<counts, num_stages> totals_;
+    std::array<uint64_t, num_stages> intervals_;
+    std::array<uint64_t, num_stages> calls_;
+    std::array<double, num_events> overhead_;
+};
+
+void print_report(const counter_group& counters,
+                  const stage_profiler& profiler, double bytes)
+{
+    double all_ns = 0;
+    for (std::size_t s = 0; s < num_stages; ++s)
+        all_ns += profiler.total(s, 0);
+
+    std::cout << std::left << std::setw(12) << "stage" << std::right
+              << std::setw(12) << "calls" << std::setw(8) << "time%"
+              << std::setw(10) << "ns/B" << std::setw(10) << "cycles/B"
+              << std::setw(10) << "instr/B" << std::setw(14) << "br-miss/KiB"
+              << std::setw(16) << "cache-miss/KiB"
+              << "\n";
+
+    auto column = [&](std::size_t s, std::size_t event, double scale,
+                      int width) {
+        std::cout << std::setw(width);
+        if (counters.available(event))
+            std::cout << profiler.total(s, event) / bytes * scale;
+        else
+            std::cout << "n/a";
+    };
+
+    std::cout << std::fixed << std::setprecision(2);
+    for (std::size_t s = 0; s < num_stages; ++s)
+    {
+        std::cout << std::left << std::setw(12) << stage_names[s]
+                  << std::right << std::setw(12) << profiler.calls(s)
+                  << std::setw(8)
+                  << (all_ns > 0 ? 100 * profiler.total(s, 0) / all_ns : 0);
+        column(s, 0, 1, 10);
+        column(s, 1, 1, 10);
+        column(s, 2, 1, 10);
+        column(s, 3, 1024, 14);
+        column(s, 4, 1024, 16);
+        std::cout << "\n";
+    }
+}
+}
+
+int main(int argc, char** argv)
+{
+    int repeat = 5;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg{argv[i]};
+        if (arg == "--repeat" && i + 1 < argc)
+            repeat = std::atoi(argv[++i]);
+        else
+            files.push_back(arg);
+    }
+
+    if (files.empty() || repeat < 1)
+    {
+        std::cerr << "Usage: " << argv[0] << " [--repeat n] file [file...]"
+                  << std::endl;
+        return 1;
+    }
+
+    std::vector<std::string> corpus;
+    for (const auto& filename : files)
+    {
+        std::ifstream file{filename, std::ios::binary};
+        if (!file)
+        {
+            std::cerr << "Could not open " << filename << std::endl;
+            return 1;
+        }
+        corpus.emplace_back(std::istreambuf_iterator<char>{file},
+                            std::istreambuf_iterator<char>{});
+    }
+
+    counter_group counters;
+    if (!counters.has_hardware())
+        std::cerr << "Hardware counters are not available; reporting time "
+                     "only"
+                  << std::endl;
+
+    stage_profiler profiler{counters};
+    cpptoml::set_stage_observer(&profiler);
+
+    double bytes = 0;
+    int failed = 0;
+    for (int r = 0; r < repeat; ++r)
+    {
+        for (std::size_t i = 0; i < corpus.size(); ++i)
+        {
+            std::istringstream input{corpus[i]};
+            cpptoml::parser p{input};
+            std::shared_ptr<cpptoml::table> root;
+            profiler.start();
+            try
+            {
+                root = p.parse();
+            }
+            catch (const cpptoml::parse_exception& e)
+            {
+                if (r == 0)
+                {
+                    std::cerr << files[i] << ": " << e.what() << std::endl;
+                    ++failed;
+                }
+            }
+            profiler.stop();
+            bytes += static_cast<double>(corpus[i].size());
+        }
+    }
+    cpptoml::set_stage_observer(nullptr);
+
+    std::cout << corpus.size() << " files, "
+              << static_cast<uint64_t>(bytes) / repeat << " bytes, parsed "
+              << repeat << " times\n";
+    print_report(counters, profiler, bytes);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,44 @@
+# cpptoml_generate_config(<target> <schema>
+#                         [NAME <name>] [NAMESPACE <namespace>]
+#                         [OUTPUT <header>])
+#
+# Generates a header of structs and decoders for the TOML schema <schema>
+# with cpptoml-codegen, regenerating it whenever the schema changes, and
+# makes it available to <target> as #include "<name>.h". The root struct
+# is called <name> (by default the schema's file name without its
+# extension), and the header is written to
+# ${CMAKE_CURRENT_BINARY_DIR}/cpptoml-generated/<name>.h unless OUTPUT
+# gives another path.
+
+include(CMakeParseArguments)
+
+function(cpptoml_generate_config target schema)
+  cmake_parse_arguments(CPPTOML_GEN "" "NAME;NAMESPACE;OUTPUT" "" ${ARGN})
+
+  if (NOT CPPTOML_GEN_NAME)
+    get_filename_component(CPPTOML_GEN_NAME "${schema}" NAME_WE)
+  endif()
+  if (NOT CPPTOML_GEN_OUTPUT)
+    set(CPPTOML_GEN_OUTPUT
+        "${CMAKE_CURRENT_BINARY_DIR}/cpptoml-generated/${CPPTOML_GEN_NAME}.h")
+  endif()
+  get_filename_component(schema_path "${schema}" ABSOLUTE)
+  get_filename_component(output_dir "${CPPTOML_GEN_OUTPUT}" DIRECTORY)
+
+  set(namespace_args)
+  if (CPPTOML_GEN_NAMESPACE)
+    set(namespace_args --namespace ${CPPTOML_GEN_NAMESPACE})
+  endif()
+
+  add_custom_command(
+    OUTPUT "${CPPTOML_GEN_OUTPUT}"
+    COMMAND ${CMAKE_COMMAND} -E make_directory "${output_dir}"
+    COMMAND cpptoml-codegen "${schema_path}" "${CPPTOML_GEN_OUTPUT}"
+            --name ${CPPTOML_GEN_NAME} ${namespace_args}
+    DEPENDS "${schema_path}" cpptoml-codegen
+    COMMENT "Generating ${CPPTOML_GEN_NAME}.h from ${schema}"
+    VERBATIM)
+
+  target_sources(${target} PRIVATE "${CPPTOML_GEN_OUTPUT}")
+  target_include_directories(${target} PRIVATE "${output_dir}")
+endfunction()
@@ -0,0 +1,497 @@
+/**
+ * @file codegen.cpp
+ *
+ * Generates a header of C++ structs, and decoders that fill them from a
+ * parsed cpptoml::table, from a schema written in TOML. The schema has
+ * the shape of the documents it describes, with the name of a type in
+ * place of each value:
+ *
+ *     title = "string"
+ *     ports = "[int64]"        # an array; "[[int64]]" nests them
+ *     timeout = "double?"      # optional: a cpptoml::option<double>
+ *
+ *     [server]                 # a struct
+ *     host = "string"
+ *
+ *     [[routes]]               # a std::vector of structs
+ *     path = "string"
+ *
+ * The types are string, int64, double, bool, local_date, local_time,
+ * local_datetime and offset_datetime. A key is required unless its type
+ * ends in '?', a table is required if any of its keys are, and a table
+ * array may always be left out (leaving its vector empty). Decoding
+ * rejects keys that are not in the schema. The schemas are those of
+ * cpptoml::schema, so a value may also be a table of constraints such as
+ * { type = "int64", min = 1 }; only its type and "optional" are used.
+ *
+ * Each table is decoded in a single pass over its entries, matching each
+ * key against the schema's with a switch on its length and a memcmp
+ * rather than looking the schema's keys up one by one, and values are
+ * stored straight into the struct's members.
+ *
+ * Usage: cpptoml-codegen schema.toml output.h [--name name]
+ *                        [--namespace ns]
+ *
+ * The root struct is called name (by default the schema's file name
+ * without its extension), and the header also declares
+ * parse_<name>(std::istream&) and parse_<name>_file(filename) to parse
+ * and decode a document in one step.
+ */
+
+#include "cpptoml.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace
+{
+/**
+ * An error in the schema.
+ */
+class schema_error : public std::runtime_error
+{
+  public:
+    schema_error(const std::string& what) : std::runtime_error{what}
+    {
+        // nothing
+    }
+};
+
+/**
+ * A member of a generated struct.
+ */
+struct field
+{
+    std::string key;
+    std::string member;
+    std::string type;
+    bool required;
+};
+
+/**
+ * A generated struct.
+ */
+struct record
+{
+    std::string name;
+    std::vector<field> fields;
+};
+
+bool is_keyword(const std::string& word)
+{
+    static const std::set<std::string> keywords
+        = {"alignas",   "alignof",       "and",              "and_eq",
+           "asm",       "auto",          "bitand",           "bitor",
+           "bool",      "break",         "case",             "catch",
+           "char",      "char16_t",      "char32_t",         "char8_t",
+           "class",     "co_await",      "co_return",        "co_yield",
+           "compl",     "concept",       "const",            "const_cast",
+           "consteval", "constexpr",     "constinit",        "continue",
+           "decltype",  "default",       "delete",           "do",
+           "double",    "dynamic_cast",  "else",             "enum",
+           "explicit",  "export",        "extern",           "false",
+           "float",     "for",           "friend",           "goto",
+           "if",        "inline",        "int",              "long",
+           "mutable",   "namespace",     "new",              "noexcept",
+           "not",       "not_eq",        "nullptr",          "operator",
+           "or",        "or_eq",         "private",          "protected",
+           "public",    "register",      "reinterpret_cast", "requires",
+           "return",    "short",         "signed",           "sizeof",
+           "static",    "static_assert", "static_cast",      "struct",
+           "switch",    "template",      "this",             "thread_local",
+           "throw",     "true",          "try",              "typedef",
+           "typeid",    "typename",      "union",            "unsigned",
+           "using",     "virtual",       "void",             "volatile",
+           "wchar_t",   "while",         "xor",              "xor_eq"};
+    return keywords.count(word) > 0;
+}
+
+/**
+ * Turns a key into a C++ identifier: characters that cannot appear in
+ * one become underscores, and a leading digit or a keyword gets one more.
+ */
+std::string identifier(const std::string& key)
+{
+    std::string id;
+    for (auto c : key)
+    {
+        auto u = static_cast<unsigned char>(c);
+        id += std::isalnum(u) || c == '_' ? c : '_';
+    }
+    if (id.empty() || std::isdigit(static_cast<unsigned char>(id[0])))
+        id = "_" + id;
+    if (is_keyword(id))
+        id += "_";
+    return id;
+}
+
+/**
+ * Escapes a key for a C++ string literal.
+ */
+std::string literal(const std::string& key)
+{
+    std::ostringstream out;
+    out << '"';
+    for (auto c : key)
+    {
+        auto u = static_cast<unsigned char>(c);
+        if (c == '"' || c == '\\')
+            out << '\\' << c;
+        else if (u < 0x20 || u >= 0x7f)
+        {
+            // always three digits, so that a digit after it is not
+            // taken as part of the escape
+            out << '\\' << std::oct << std::setw(3) << std::setfill('0')
+                << static_cast<int>(u) << std::dec;
+        }
+        else
+            out << c;
+    }
+    out << '"';
+    return out.str();
+}
+
+/**
+ * The C++ type for a type name in the schema, such as "[int64]?".
+ */
+std::string cpp_type(const std::string& key, const std::string& spec,
+                     bool& required)
+{
+    auto name = spec;
+    required = name.empty() || name.back() != '?';
+    if (!required)
+        name.pop_back();
+
+    std::size_t depth = 0;
+    while (depth < name.size() && name[depth] == '['
+           && name[name.size() - 1 - depth] == ']')
+        ++depth;
+    name = name.substr(depth, name.size() - 2 * depth);
+
+    static const std::pair<const char*, const char*> types[]
+        = {{"string", "std::string"},
+           {"int64", "int64_t"},
+           {"double", "double"},
+           {"bool", "bool"},
+           {"local_date", "cpptoml::local_date"},
+           {"local_time", "cpptoml::local_time"},
+           {"local_datetime", "cpptoml::local_datetime"},
+           {"offset_datetime", "cpptoml::offset_datetime"}};
+
+    std::string type;
+    for (const auto& t : types)
+        if (name == t.first)
+            type = t.second;
+    if (type.empty())
+        throw schema_error{"Unknown type \"" + spec + "\" for key " + key};
+
+    for (std::size_t i = 0; i < depth; ++i)
+        type = "std::vector<" + type + ">";
+    return required ? type : "cpptoml::option<" + type + ">";
+}
+
+/**
+ * Builds the struct called name for a table of the schema, after the
+ * structs for its tables, and returns whether it has required members.
+ */
+bool build_record(const cpptoml::table& schema, const std::string& name,
+                  const std::string& path, std::vector<record>& records,
+                  std::set<std::string>& names)
+{
+    if (!names.insert(name).second)
+        throw schema_error{"Tables " + path + " and another both map to "
+                           + name};
+
+    std::vector<std::string> keys;
+    for (const auto& entry : schema)
+        keys.push_back(entry.first);
+    std::sort(keys.begin(), keys.end());
+
+    record rec;
+    rec.name = name;
+    bool any_required = false;
+    std::set<std::string> members;
+    for (const auto& key : keys)
+    {
+        auto elem = schema.get(key);
+        auto key_path = path.empty() ? key : path + "." + key;
+
+        field f;
+        f.key = key;
+        f.member = identifier(key);
+        if (!members.insert(f.member).second)
+            throw schema_error{"Key " + key_path
+                               + " has the same member name as another"};
+
+        cpptoml::option<std::string> spec;
+        if (auto name = elem->as<std::string>())
+            spec = cpptoml::option<std::string>{name->get()};
+        else if (elem->is_table())
+            spec = elem->as_table()->get_as<std::string>("type");
+
+        if (spec)
+        {
+            // a table of constraints (see cpptoml::schema) only
+            // contributes its type and whether it is optional
+            f.type = cpp_type(key_path, *spec, f.required);
+            if (elem->is_table()
+                && elem->as_table()->get_as<bool>("optional").value_or(false)
+                && f.required)
+            {
+                f.type = "cpptoml::option<" + f.type + ">";
+                f.required = false;
+            }
+        }
+        else if (elem->is_table())
+        {
+            f.type = name + "_" + f.member;
+            f.required = build_record(static_cast<const cpptoml::table&>(
+                                          *elem),
+                                      f.type, key_path, records, names);
+        }
+        else if (elem->is_table_array())
+        {
+            auto tables = static_cast<const cpptoml::table_array&>(*elem).get();
+            if (tables.size() != 1)
+                throw schema_error{"Table array " + key_path
+                                   + " must be described by one table"};
+            auto type = name + "_" + f.member;
+            build_record(*tables.front(), type, key_path, records, names);
+            f.type = "std::vector<" + type + ">";
+            f.required = false;
+        }
+        else
+        {
+            throw schema_error{"Expected a type name for key " + key_path};
+        }
+
+        any_required = any_required || f.required;
+        rec.fields.push_back(f);
+    }
+    records.push_back(rec);
+    return any_required;
+}
+
+void write_struct(std::ostream& out, const record& rec)
+{
+    out << "struct " << rec.name << "\n{\n";
+    for (const auto& f : rec.fields)
+    {
+        out << "    " << f.type << " " << f.member;
+        if (f.type == "int64_t" || f.type == "double" || f.type == "bool")
+            out << "{}";
+        out << ";\n";
+    }
+    out << "};\n\n";
+}
+
+void write_decoder(std::ostream& out, const record& rec)
+{
+    out << "inline void decode(const cpptoml::table& t, " << rec.name
+        << "& out,\n"
+        << "                   const cpptoml::detail::decode_path& path)\n"
+        << "{\n";
+
+    std::vector<std::size_t> required;
+    for (std::size_t i = 0; i < rec.fields.size(); ++i)
+        if (rec.fields[i].required)
+            required.push_back(i);
+    if (!required.empty())
+        out << "    bool seen[" << required.size() << "] = {};\n";
+
+    out << "    for (const auto& entry : t)\n"
+        << "    {\n"
+        << "        const auto& key = entry.first;\n"
+        << "        const cpptoml::detail::decode_path at{&path, "
+           "key.c_str(), 0};\n";
+
+    // the keys of each length, to switch on the length first
+    std::vector<std::vector<std::size_t>> by_length;
+    for (std::size_t i = 0; i < rec.fields.size(); ++i)
+    {
+        auto len = rec.fields[i].key.size();
+        if (by_length.size() <= len)
+            by_length.resize(len + 1);
+        by_length[len].push_back(i);
+    }
+
+    if (!rec.fields.empty())
+    {
+        out << "        switch (key.size())\n"
+            << "        {\n";
+        for (std::size_t len = 0; len < by_length.size(); ++len)
+        {
+            if (by_length[len].empty())
+                continue;
+            out << "            case " << len << ":\n";
+            for (auto i : by_length[len])
+            {
+                const auto& f = rec.fields[i];
+                out << "                if (std::memcmp(key.data(), "
+                    << literal(f.key) << ", " << len << ") == 0)\n"
+                    << "                {\n"
+                    << "                    cpptoml::detail::decode_value(\n"
+                    << "                        *entry.second, out." << f.member
+                    << ", at);\n";
+                auto slot = std::find(required.begin(), required.end(), i);
+                if (slot != required.end())
+                    out << "                    seen["
+                        << slot - required.begin() << "] = true;\n";
+                out << "                    continue;\n"
+                    << "                }\n";
+            }
+            out << "                break;\n";
+        }
+        out << "        }\n";
+    }
+    out << "        cpptoml::detail::decode_error(at, \"unknown key\");\n"
+        << "    }\n";
+
+    for (std::size_t j = 0; j < required.size(); ++j)
+    {
+        const auto& f = rec.fields[required[j]];
+        out << "    if (!seen[" << j << "])\n"
+            << "        cpptoml::detail::decode_error({&path, "
+            << literal(f.key) << ", 0},\n"
+            << "                                      \"missing required "
+               "key\");\n";
+    }
+    out << "}\n\n";
+}
+
+std::string generate(const cpptoml::table& schema, const std::string& name,
+                     const std::string& ns, const std::string& schema_file)
+{
+    std::vector<record> records;
+    std::set<std::string> names;
+    build_record(schema, name, "", records, names);
+
+    std::string guard = "CPPTOML_GENERATED_";
+    for (auto c : (ns.empty() ? name : ns + "_" + name))
+        guard += static_cast<char>(
+            std::isalnum(static_cast<unsigned char>(c))
+                ? std::toupper(static_cast<unsigned char>(c))
+                : '_');
+    guard += "_H";
+
+    std::ostringstream out;
+    auto slash = schema_file.find_last_of("/\\");
+    out << "// Generated by cpptoml-codegen from "
+        << schema_file.substr(slash == std::string::npos ? 0 : slash + 1)
+        << ". Do not edit.\n\n"
+        << "#ifndef " << guard << "\n"
+        << "#define " << guard << "\n\n"
+        << "#include \"cpptoml.h\"\n\n"
+        << "#include <cstring>\n"
+        << "#include <istream>\n"
+        << "#include <string>\n"
+        << "#include <vector>\n\n";
+    if (!ns.empty())
+        out << "namespace " << ns << "\n{\n";
+
+    for (const auto& rec : records)
+        write_struct(out, rec);
+
+    // declared up front since a struct's decoder calls those of the
+    // structs in it through cpptoml::detail::decode_value()
+    for (const auto& rec : records)
+        out << "inline void decode(const cpptoml::table& t, " << rec.name
+            << "& out,\n"
+            << "                   const cpptoml::detail::decode_path& "
+               "path);\n";
+    out << "\n";
+    for (const auto& rec : records)
+        write_decoder(out, rec);
+
+    out << "inline void decode(const cpptoml::table& t, " << name
+        << "& out)\n"
+        << "{\n"
+        << "    decode(t, out, cpptoml::detail::decode_path{nullptr, "
+           "nullptr, 0});\n"
+        << "}\n\n"
+        << "inline " << name << " parse_" << name
+        << "(std::istream& stream)\n"
+        << "{\n"
+        << "    cpptoml::parser p{stream};\n"
+        << "    " << name << " result;\n"
+        << "    decode(*p.parse(), result);\n"
+        << "    return result;\n"
+        << "}\n\n"
+        << "inline " << name << " parse_" << name
+        << "_file(const std::string& filename)\n"
+        << "{\n"
+        << "    " << name << " result;\n"
+        << "    decode(*cpptoml::parse_file(filename), result);\n"
+        << "    return result;\n"
+        << "}\n";
+
+    if (!ns.empty())
+        out << "}\n";
+    out << "#endif\n";
+    return out.str();
+}
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<std::string> files;
+    std::string name;
+    std::string ns;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg{argv[i]};
+        if (arg == "--name" && i + 1 < argc)
+            name = argv[++i];
+        else if (arg == "--namespace" && i + 1 < argc)
+            ns = argv[++i];
+        else
+            files.push_back(arg);
+    }
+
+    if (files.size() != 2)
+    {
+        std::cerr << "Usage: " << argv[0]
+                  << " schema.toml output.h [--name name] [--namespace ns]"
+                  << std::endl;
+        return 1;
+    }
+
+    const auto& schema_file = files[0];
+    if (name.empty())
+    {
+        auto slash = schema_file.find_last_of("/\\");
+        name = schema_file.substr(slash == std::string::npos ? 0 : slash + 1);
+        name = name.substr(0, name.find('.'));
+    }
+    name = identifier(name);
+
+    std::string header;
+    try
+    {
+        auto schema = cpptoml::parse_file(schema_file);
+        header = generate(*schema, name, ns, schema_file);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << schema_file << ": " << e.what() << std::endl;
+        return 1;
+    }
+
+    std::ofstream out{files[1], std::ios::binary};
+    out << header;
+    if (!out)
+    {
+        std::cerr << "Could not write " << files[1] << std::endl;
+        return 1;
+    }
+    return 0;
+}
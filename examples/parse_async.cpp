@@ -0,0 +1,75 @@
+#define CPPTOML_ASYNC
+#include "cpptoml.h"
+
+#include <future>
+#include <iostream>
+
+// A coroutine type that starts immediately and is never awaited; a real
+// program would use the task type of its event loop instead.
+struct detached
+{
+    struct promise_type
+    {
+        detached get_return_object()
+        {
+            return {};
+        }
+
+        std::suspend_never initial_suspend() noexcept
+        {
+            return {};
+        }
+
+        std::suspend_never final_suspend() noexcept
+        {
+            return {};
+        }
+
+        void return_void()
+        {
+        }
+
+        void unhandled_exception()
+        {
+            std::terminate();
+        }
+    };
+};
+
+detached load(std::string filename,
+              std::promise<std::shared_ptr<cpptoml::table>>& result)
+{
+    try
+    {
+        result.set_value(co_await cpptoml::parse_file_async(filename));
+    }
+    catch (...)
+    {
+        result.set_exception(std::current_exception());
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        std::cout << "Usage: " << argv[0] << " filename" << std::endl;
+        return 1;
+    }
+
+    std::promise<std::shared_ptr<cpptoml::table>> result;
+    load(argv[1], result);
+
+    try
+    {
+        std::shared_ptr<cpptoml::table> g = result.get_future().get();
+        std::cout << (*g) << std::endl;
+    }
+    catch (const cpptoml::parse_exception& e)
+    {
+        std::cerr << "Failed to parse " << argv[1] << ": " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
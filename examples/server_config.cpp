@@ -0,0 +1,38 @@
+#include "server_config.h"
+
+#include <iostream>
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        std::cout << "Usage: " << argv[0] << " filename" << std::endl;
+        return 1;
+    }
+
+    try
+    {
+        auto config = parse_server_config_file(argv[1]);
+        std::cout << "name: " << config.name << "\n";
+        for (const auto& port : config.ports)
+            std::cout << "port: " << port << "\n";
+        if (config.timeout)
+            std::cout << "timeout: " << *config.timeout << "\n";
+        std::cout << "tls: " << (config.tls.enabled ? "on" : "off") << "\n";
+        for (const auto& route : config.routes)
+        {
+            std::cout << "route: " << route.path;
+            for (const auto& method : route.methods)
+                std::cout << " " << method;
+            std::cout << "\n";
+        }
+    }
+    catch (const cpptoml::parse_exception& e)
+    {
+        std::cerr << "Failed to load " << argv[1] << ": " << e.what()
+                  << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
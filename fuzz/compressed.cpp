@@ -0,0 +1,175 @@
+/**
+ * @file compressed.cpp
+ *
+ * Checks that compressed input is decompressed in full. A document
+ * several times larger than the decompression buffers, ending in a long
+ * run that compresses to almost nothing, is compressed with each format
+ * that support was built for and parsed back through the decompressor,
+ * with the compressed bytes handed over in pieces of various sizes. Each
+ * result must be written out the same as the document parsed directly.
+ * Exits with a non-zero status on the first mismatch or error.
+ */
+
+#include "cpptoml.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace
+{
+/**
+ * A read-only stream buffer over a string that returns at most a given
+ * number of bytes from each read.
+ */
+class piecewise_streambuf : public std::streambuf
+{
+  public:
+    piecewise_streambuf(const std::string& data, std::size_t piece)
+        : data_(data), piece_(piece)
+    {
+        // nothing
+    }
+
+  protected:
+    std::streamsize xsgetn(char* s, std::streamsize n) override
+    {
+        auto len = std::min({static_cast<std::size_t>(n), piece_,
+                             data_.size() - pos_});
+        data_.copy(s, len, pos_);
+        pos_ += len;
+        return static_cast<std::streamsize>(len);
+    }
+
+    int_type underflow() override
+    {
+        if (pos_ == data_.size())
+            return traits_type::eof();
+        return traits_type::to_int_type(data_[pos_]);
+    }
+
+    int_type uflow() override
+    {
+        if (pos_ == data_.size())
+            return traits_type::eof();
+        return traits_type::to_int_type(data_[pos_++]);
+    }
+
+  private:
+    const std::string& data_;
+    std::size_t piece_;
+    std::size_t pos_ = 0;
+};
+
+std::string document()
+{
+    std::ostringstream out;
+    for (int i = 0; i < 20000; ++i)
+        out << "key" << i << " = \"" << std::string(i % 97, 'a' + i % 26)
+            << "\"\n";
+    out << "tail = \"" << std::string(1 << 20, 'x') << "\"\n";
+    return out.str();
+}
+
+std::string written(std::istream& stream)
+{
+    cpptoml::parser p{stream};
+    std::ostringstream out;
+    out << *p.parse();
+    return out.str();
+}
+
+#if defined(CPPTOML_USE_ZLIB)
+std::string gzip(const std::string& input)
+{
+    z_stream stream;
+    std::memset(&stream, 0, sizeof(stream));
+    if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS,
+                     8, Z_DEFAULT_STRATEGY)
+        != Z_OK)
+        throw std::runtime_error{"deflateInit2 failed"};
+
+    std::string output(deflateBound(&stream, input.size()), '\0');
+    stream.next_in
+        = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+    stream.avail_in = static_cast<uInt>(input.size());
+    stream.next_out = reinterpret_cast<Bytef*>(&output[0]);
+    stream.avail_out = static_cast<uInt>(output.size());
+    auto ret = deflate(&stream, Z_FINISH);
+    output.resize(stream.total_out);
+    deflateEnd(&stream);
+    if (ret != Z_STREAM_END)
+        throw std::runtime_error{"deflate failed"};
+    return output;
+}
+#endif
+
+#if defined(CPPTOML_USE_ZSTD)
+std::string zstd(const std::string& input, int level)
+{
+    std::string output(ZSTD_compressBound(input.size()), '\0');
+    auto size = ZSTD_compress(&output[0], output.size(), input.data(),
+                              input.size(), level);
+    if (ZSTD_isError(size))
+        throw std::runtime_error{ZSTD_getErrorName(size)};
+    output.resize(size);
+    return output;
+}
+#endif
+
+/**
+ * Parses compressed through the decompressor with each piece size,
+ * returning false if any result differs from expected.
+ */
+bool check(const std::string& name, const std::string& compressed,
+           const std::string& expected)
+{
+    const std::size_t pieces[] = {1, 7, 4096, 1 << 16, compressed.size()};
+    bool ok = true;
+    for (auto piece : pieces)
+    {
+        try
+        {
+            piecewise_streambuf source{compressed, piece};
+            auto decompressor = cpptoml::detail::make_decompressor(source,
+                                                                   name);
+            if (!decompressor)
+                throw std::runtime_error{"not detected as compressed"};
+            std::istream stream{decompressor.get()};
+            if (written(stream) != expected)
+                throw std::runtime_error{"document differs"};
+        }
+        catch (const std::exception& e)
+        {
+            std::cout << name << ", " << piece
+                      << "-byte reads: FAIL: " << e.what() << "\n";
+            ok = false;
+            continue;
+        }
+        std::cout << name << ", " << piece << "-byte reads: ok\n";
+    }
+    return ok;
+}
+}
+
+int main()
+{
+    auto input = document();
+    std::istringstream plain{input};
+    auto expected = written(plain);
+
+    bool ok = true;
+#if defined(CPPTOML_USE_ZLIB)
+    ok = check("gzip", gzip(input), expected) && ok;
+#endif
+#if defined(CPPTOML_USE_ZSTD)
+    ok = check("zstd", zstd(input, 3), expected) && ok;
+    ok = check("zstd -19", zstd(input, 19), expected) && ok;
+#endif
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
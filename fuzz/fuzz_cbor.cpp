@@ -0,0 +1,38 @@
+/**
+ * @file fuzz_cbor.cpp
+ *
+ * Fuzz target for the CBOR decoder: any input that decodes must encode
+ * back into CBOR that decodes again.
+ */
+
+#define CPPTOML_CBOR
+#include "fuzz_common.h"
+
+#include <cstdlib>
+#include <iostream>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, std::size_t size)
+{
+    std::shared_ptr<cpptoml::table> doc;
+    try
+    {
+        doc = cpptoml::from_cbor(data, size, fuzz::limits());
+    }
+    catch (const cpptoml::parse_exception&)
+    {
+        return 0;
+    }
+
+    auto encoded = cpptoml::to_cbor(*doc);
+    try
+    {
+        cpptoml::from_cbor(encoded, fuzz::limits());
+    }
+    catch (const cpptoml::parse_exception& e)
+    {
+        std::cerr << "Re-encoded document failed to decode: " << e.what()
+                  << std::endl;
+        std::abort();
+    }
+    return 0;
+}
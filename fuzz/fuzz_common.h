@@ -0,0 +1,48 @@
+/**
+ * @file fuzz_common.h
+ *
+ * Helpers shared by the fuzz targets.
+ */
+
+#ifndef CPPTOML_FUZZ_COMMON_H_
+#define CPPTOML_FUZZ_COMMON_H_
+
+#include "cpptoml.h"
+
+#include <cstdint>
+#include <string>
+
+namespace fuzz
+{
+
+/**
+ * Limits applied to every fuzz input so that the fuzzer spends its time
+ * on parser logic rather than on building huge documents.
+ */
+inline cpptoml::parse_limits limits()
+{
+    cpptoml::parse_limits limits;
+    limits.max_input_bytes = 1 << 20;
+    limits.max_nesting_depth = 256;
+    limits.max_nodes = 1 << 16;
+    return limits;
+}
+
+/**
+ * Parses the given input, returning nullptr if it isn't valid TOML.
+ */
+inline std::shared_ptr<cpptoml::table> parse(const std::string& input)
+{
+    std::istringstream stream{input};
+    cpptoml::parser p{stream, limits()};
+    try
+    {
+        return p.parse();
+    }
+    catch (const cpptoml::parse_exception&)
+    {
+        return nullptr;
+    }
+}
+}
+#endif
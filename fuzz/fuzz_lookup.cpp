@@ -0,0 +1,82 @@
+/**
+ * @file fuzz_lookup.cpp
+ *
+ * Fuzz target for the lookup API. The input is a document, optionally
+ * followed by a NUL byte and a newline-separated list of keys; each key is
+ * looked up with every accessor, both as a plain and as a qualified key.
+ */
+
+#include "fuzz_common.h"
+
+#include <stdexcept>
+
+namespace
+{
+void lookup(const cpptoml::table& tbl, const std::string& key)
+{
+    tbl.contains(key);
+    tbl.contains_qualified(key);
+
+    if (tbl.contains(key))
+        tbl.get(key);
+    if (tbl.contains_qualified(key))
+        tbl.get_qualified(key);
+
+    tbl.get_table(key);
+    tbl.get_table_qualified(key);
+    tbl.get_array(key);
+    tbl.get_array_qualified(key);
+    tbl.get_table_array(key);
+    tbl.get_table_array_qualified(key);
+
+    tbl.get_as<std::string>(key);
+    tbl.get_as<double>(key);
+    tbl.get_as<bool>(key);
+    tbl.get_as<cpptoml::offset_datetime>(key);
+    tbl.get_qualified_as<std::string>(key);
+    tbl.get_qualified_as<double>(key);
+
+    tbl.get_array_of<int64_t>(key);
+    tbl.get_array_of<std::string>(key);
+    tbl.get_array_of<cpptoml::array>(key);
+    tbl.get_qualified_array_of<double>(key);
+    tbl.get_qualified_array_of<cpptoml::array>(key);
+
+    // narrowing conversions are allowed to throw when out of range
+    try
+    {
+        tbl.get_as<int>(key);
+        tbl.get_qualified_as<uint16_t>(key);
+        tbl.get_qualified_as<int64_t>(key);
+    }
+    catch (const std::overflow_error&)
+    {
+    }
+    catch (const std::underflow_error&)
+    {
+    }
+}
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, std::size_t size)
+{
+    std::string input(reinterpret_cast<const char*>(data), size);
+    auto split = input.find('\0');
+
+    auto doc = fuzz::parse(input.substr(0, split));
+    if (!doc || split == std::string::npos)
+        return 0;
+
+    std::istringstream keys{input.substr(split + 1)};
+    std::string key;
+    while (std::getline(keys, key))
+    {
+        lookup(*doc, key);
+        if (auto tarr = doc->get_table_array_qualified(key))
+        {
+            for (const auto& tbl : *tarr)
+                lookup(*tbl, key);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,14 @@
+/**
+ * @file fuzz_parser.cpp
+ *
+ * Fuzz target for the parser: any input must either parse or be rejected
+ * with a parse_exception.
+ */
+
+#include "fuzz_common.h"
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, std::size_t size)
+{
+    fuzz::parse(std::string(reinterpret_cast<const char*>(data), size));
+    return 0;
+}
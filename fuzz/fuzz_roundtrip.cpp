@@ -0,0 +1,174 @@
+/**
+ * @file fuzz_roundtrip.cpp
+ *
+ * Fuzz target for the toml_writer: any document that parses must be
+ * written out as TOML that parses back to an identical document. Built
+ * with CPPTOML_USE_INSERTION_ORDER, the writer must also keep the keys of
+ * an input in its own format in their original order.
+ */
+
+#include "fuzz_common.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+namespace
+{
+template <class T>
+bool equal_values(const cpptoml::base& a, const cpptoml::base& b)
+{
+    auto va = a.as<T>();
+    auto vb = b.as<T>();
+    if (!va || !vb)
+        return false;
+
+    std::ostringstream sa;
+    std::ostringstream sb;
+    sa << va->get();
+    sb << vb->get();
+    return sa.str() == sb.str();
+}
+
+bool equal(const cpptoml::base& a, const cpptoml::base& b);
+
+bool equal_tables(const cpptoml::table& a, const cpptoml::table& b)
+{
+    std::size_t count = 0;
+    for (const auto& kv : a)
+    {
+        if (!b.contains(kv.first) || !equal(*kv.second, *b.get(kv.first)))
+            return false;
+        ++count;
+    }
+    return count == static_cast<std::size_t>(std::distance(b.begin(), b.end()));
+}
+
+bool equal(const cpptoml::base& a, const cpptoml::base& b)
+{
+    if (a.is_table())
+        return b.is_table()
+               && equal_tables(static_cast<const cpptoml::table&>(a),
+                               static_cast<const cpptoml::table&>(b));
+
+    if (a.is_array())
+    {
+        if (!b.is_array())
+            return false;
+        const auto& va = static_cast<const cpptoml::array&>(a).get();
+        const auto& vb = static_cast<const cpptoml::array&>(b).get();
+        if (va.size() != vb.size())
+            return false;
+        for (std::size_t i = 0; i < va.size(); ++i)
+        {
+            if (!equal(*va[i], *vb[i]))
+                return false;
+        }
+        return true;
+    }
+
+    if (a.is_table_array())
+    {
+        if (!b.is_table_array())
+            return false;
+        const auto& va = static_cast<const cpptoml::table_array&>(a).get();
+        const auto& vb = static_cast<const cpptoml::table_array&>(b).get();
+        if (va.size() != vb.size())
+            return false;
+        for (std::size_t i = 0; i < va.size(); ++i)
+        {
+            if (!equal_tables(*va[i], *vb[i]))
+                return false;
+        }
+        return true;
+    }
+
+    // integers compare equal to doubles through as<double>(), so check
+    // the exact type first
+    if (a.as<int64_t>())
+        return equal_values<int64_t>(a, b);
+
+    return equal_values<std::string>(a, b) || equal_values<double>(a, b)
+           || equal_values<bool>(a, b)
+           || equal_values<cpptoml::local_date>(a, b)
+           || equal_values<cpptoml::local_time>(a, b)
+           || equal_values<cpptoml::local_datetime>(a, b)
+           || equal_values<cpptoml::offset_datetime>(a, b);
+}
+
+#if defined(CPPTOML_USE_INSERTION_ORDER)
+/**
+ * Splits text into sections at table headers, each a list of its lines
+ * without indentation. Blank lines are dropped.
+ */
+std::vector<std::vector<std::string>> sections(const std::string& text)
+{
+    std::vector<std::vector<std::string>> result(1);
+    std::istringstream stream{text};
+    std::string line;
+    while (std::getline(stream, line))
+    {
+        auto first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos)
+            continue;
+        line = line.substr(first, line.find_last_not_of(" \t\r") + 1 - first);
+        if (line[0] == '[')
+            result.emplace_back();
+        result.back().push_back(line);
+    }
+    return result;
+}
+
+/**
+ * Tables keep their keys in the order they were parsed in, so an input in
+ * the writer's own format must be written back with its lines in the same
+ * order. Returns false if output holds the same lines as input, section
+ * by section, but in a different order.
+ */
+bool same_order(const std::string& input, const std::string& output)
+{
+    auto a = sections(input);
+    auto b = sections(output);
+    if (a == b || a.size() != b.size())
+        return true;
+    for (std::size_t i = 0; i < a.size(); ++i)
+    {
+        std::sort(a[i].begin(), a[i].end());
+        std::sort(b[i].begin(), b[i].end());
+    }
+    return a != b;
+}
+#endif
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, std::size_t size)
+{
+    std::string input(reinterpret_cast<const char*>(data), size);
+    auto doc = fuzz::parse(input);
+    if (!doc)
+        return 0;
+
+    std::ostringstream out;
+    out.precision(std::numeric_limits<double>::max_digits10);
+    out << *doc;
+
+    auto reparsed = fuzz::parse(out.str());
+    if (!reparsed || !equal(*doc, *reparsed))
+    {
+        std::cerr << "Round trip mismatch; writer produced:\n"
+                  << out.str() << std::endl;
+        std::abort();
+    }
+
+#if defined(CPPTOML_USE_INSERTION_ORDER)
+    if (!same_order(input, out.str()))
+    {
+        std::cerr << "Key order not kept; writer produced:\n"
+                  << out.str() << std::endl;
+        std::abort();
+    }
+#endif
+    return 0;
+}
@@ -0,0 +1,164 @@
+/**
+ * @file scaling.cpp
+ *
+ * Checks that parse time grows linearly with input size. Each input file
+ * is parsed at several prefix lengths (1/16, 1/8, 1/4, 1/2 and all of
+ * it) and the growth exponent of parse time against size is estimated
+ * with a least-squares fit in log-log space. Inputs whose exponent
+ * exceeds the threshold (1.35 by default) are flagged and make the
+ * program exit with a non-zero status.
+ *
+ * Truncating a pathological input generally keeps whatever made it slow,
+ * so this works on inputs found by the fuzzers as well as on hand-written
+ * ones. Prefixes that stop being valid TOML simply throw a parse_exception
+ * once the parser reaches the cut, which is still timed.
+ */
+
+#include "cpptoml.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+namespace
+{
+using clock_type = std::chrono::steady_clock;
+
+/**
+ * Parses input once, returning the time taken in nanoseconds.
+ */
+double parse_once(const std::string& input)
+{
+    cpptoml::parse_limits limits;
+    // nesting is bounded by the input itself; don't let the default cap
+    // cut deep inputs short
+    limits.max_nesting_depth = input.size() + 1;
+
+    std::istringstream stream{input};
+    cpptoml::parser p{stream, limits};
+
+    auto start = clock_type::now();
+    try
+    {
+        p.parse();
+    }
+    catch (const cpptoml::parse_exception&)
+    {
+        // only the time spent matters here
+    }
+    auto elapsed = clock_type::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count();
+}
+
+/**
+ * Estimates the time to parse input, taking the fastest of several runs
+ * (and at least 50ms of parsing in total) to reduce noise.
+ */
+double parse_time(const std::string& input)
+{
+    auto best = parse_once(input);
+    auto total = best;
+    for (int runs = 1; runs < 5 || total < 5e7; ++runs)
+    {
+        auto t = parse_once(input);
+        best = std::min(best, t);
+        total += t;
+    }
+    return best;
+}
+
+/**
+ * Slope of the least-squares line through the points (log x, log y).
+ */
+double growth_exponent(const std::vector<double>& x,
+                       const std::vector<double>& y)
+{
+    double mx = 0;
+    double my = 0;
+    for (std::size_t i = 0; i < x.size(); ++i)
+    {
+        mx += std::log(x[i]);
+        my += std::log(y[i]);
+    }
+    mx /= x.size();
+    my /= y.size();
+
+    double num = 0;
+    double den = 0;
+    for (std::size_t i = 0; i < x.size(); ++i)
+    {
+        auto dx = std::log(x[i]) - mx;
+        num += dx * (std::log(y[i]) - my);
+        den += dx * dx;
+    }
+    return num / den;
+}
+}
+
+int main(int argc, char** argv)
+{
+    double threshold = 1.35;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg{argv[i]};
+        if (arg == "--threshold" && i + 1 < argc)
+            threshold = std::atof(argv[++i]);
+        else
+            files.push_back(arg);
+    }
+
+    if (files.empty())
+    {
+        std::cerr << "Usage: " << argv[0]
+                  << " [--threshold exponent] file [file...]" << std::endl;
+        return 1;
+    }
+
+    int flagged = 0;
+    for (const auto& filename : files)
+    {
+        std::ifstream file{filename, std::ios::binary};
+        if (!file)
+        {
+            std::cerr << "Could not open " << filename << std::endl;
+            return 1;
+        }
+        std::string input{std::istreambuf_iterator<char>{file},
+                          std::istreambuf_iterator<char>{}};
+
+        if (input.size() < 64)
+        {
+            std::cout << filename << ": too small to measure, skipped\n";
+            continue;
+        }
+
+        std::vector<double> sizes;
+        std::vector<double> times;
+        std::cout << filename << ":";
+        for (std::size_t div = 16; div >= 1; div /= 2)
+        {
+            auto prefix = input.substr(0, input.size() / div);
+            auto t = parse_time(prefix);
+            sizes.push_back(static_cast<double>(prefix.size()));
+            times.push_back(t);
+            std::cout << " " << prefix.size() << "B="
+                      << t / prefix.size() << "ns/B";
+        }
+
+        auto exponent = growth_exponent(sizes, times);
+        std::cout << " exponent=" << exponent;
+        if (exponent > threshold)
+        {
+            std::cout << " SUPER-LINEAR";
+            ++flagged;
+        }
+        std::cout << std::endl;
+    }
+
+    return flagged ? 1 : 0;
+}
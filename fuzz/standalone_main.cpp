@@ -0,0 +1,52 @@
+/**
+ * @file standalone_main.cpp
+ *
+ * Minimal driver for the fuzz targets when libFuzzer isn't available. Each
+ * file named on the command line is run through the target once; with no
+ * arguments a single input is read from stdin, which is how AFL and
+ * similar fuzzers invoke their targets.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, std::size_t size);
+
+namespace
+{
+void run(const std::string& input)
+{
+    LLVMFuzzerTestOneInput(reinterpret_cast<const uint8_t*>(input.data()),
+                           input.size());
+}
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        std::string input{std::istreambuf_iterator<char>{std::cin},
+                          std::istreambuf_iterator<char>{}};
+        run(input);
+        return 0;
+    }
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::ifstream file{argv[i], std::ios::binary};
+        if (!file)
+        {
+            std::cerr << "Could not open " << argv[i] << std::endl;
+            return 1;
+        }
+
+        std::string input{std::istreambuf_iterator<char>{file},
+                          std::istreambuf_iterator<char>{}};
+        run(input);
+    }
+    return 0;
+}
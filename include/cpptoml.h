@@ -8,17 +8,25 @@
 #define _CPPTOML_H_
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cmath>
 #include <cstdint>
 #include <cstring>
 #include <fstream>
 #include <iomanip>
+#include <iterator>
+#include <limits>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <type_traits>
 #include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
 #if __cplusplus > 201103L
@@ -35,14 +43,466 @@
 #endif
 #endif
 
+// When CPPTOML_COMPILED_LIB is defined, the untraced parser and writer and
+// the other non-template functions are compiled once into the cpptoml_lib
+// library (see src/cpptoml.cpp) rather than into every translation unit
+// that includes this header.
+#if defined(CPPTOML_COMPILED_LIB)
+#define CPPTOML_INLINE
+#if defined(CPPTOML_IMPLEMENTATION)
+#define CPPTOML_DEFINE_OUT_OF_LINE 1
+#else
+#define CPPTOML_DEFINE_OUT_OF_LINE 0
+#endif
+#else
+#define CPPTOML_INLINE inline
+#define CPPTOML_DEFINE_OUT_OF_LINE 1
+#endif
+
+#if !defined(CPPTOML_NO_SIMD)                                                  \
+    && (defined(__SSE2__) || defined(_M_X64)                                   \
+        || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define CPPTOML_HAS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// parse_file_async() is only declared when CPPTOML_ASYNC is defined, and
+// needs C++20 coroutines; on Linux its reads go through io_uring unless
+// CPPTOML_NO_IO_URING is defined
+#if defined(CPPTOML_ASYNC) && defined(__cpp_impl_coroutine)                    \
+    && __cpp_impl_coroutine >= 201902L && defined(__has_include)
+#if __has_include(<coroutine>)
+#define CPPTOML_HAS_COROUTINES 1
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <thread>
+#endif
+#endif
+
+// static_document is only declared when CPPTOML_STATIC_DOCUMENTS is
+// defined; it parses TOML at compile time, which needs the relaxed
+// constexpr functions of C++14
+#if defined(CPPTOML_STATIC_DOCUMENTS) && defined(__cpp_constexpr)             \
+    && __cpp_constexpr >= 201304L
+#define CPPTOML_HAS_STATIC_DOCUMENTS 1
+#endif
+
+// to_cbor() and from_cbor() are only declared when CPPTOML_CBOR is defined
+
+// parse_file() reads gzip input when CPPTOML_USE_ZLIB is defined and zstd
+// input when CPPTOML_USE_ZSTD is defined (linking zlib or libzstd)
+#if defined(CPPTOML_USE_ZLIB)
+#include <zlib.h>
+#endif
+#if defined(CPPTOML_USE_ZSTD)
+#include <zstd.h>
+#endif
+
+#if defined(CPPTOML_HAS_COROUTINES) && defined(__linux__)                      \
+    && !defined(CPPTOML_NO_IO_URING)
+#if __has_include(<linux/io_uring.h>)
+#include <cerrno>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define CPPTOML_HAS_IO_URING 1
+#endif
+#endif
+#endif
+
 namespace cpptoml
 {
 class writer; // forward declaration
 class base;   // forward declaration
+struct null_tracer; // forward declaration
+template <class Tracer = null_tracer>
+class basic_parser; // forward declaration
+using parser = basic_parser<>;
+template <class Tracer = null_tracer>
+class basic_toml_writer; // forward declaration
+using toml_writer = basic_toml_writer<>;
 #if defined(CPPTOML_USE_MAP)
 // a std::map will ensure that entries a sorted, albeit at a slight
 // performance penalty relative to the (default) unordered_map
 using string_to_base_map = std::map<std::string, std::shared_ptr<base>>;
+#elif defined(CPPTOML_USE_INSERTION_ORDER)
+namespace detail
+{
+/**
+ * A hash map that iterates over its entries in the order they were
+ * inserted, for CPPTOML_USE_INSERTION_ORDER. The entries live in one
+ * vector in that order, and are found through an open-addressed index
+ * of their positions (small maps skip the index and are searched
+ * directly). Erasing an entry only marks it dead, leaving a tombstone
+ * that lookups and iteration step over; once the dead entries outnumber
+ * the live ones they are removed and the index is rebuilt.
+ *
+ * Since entries move within the vector, the key in value_type is not
+ * const, but it must not be changed through an iterator. Inserting or
+ * erasing may invalidate all iterators.
+ */
+template <class Key, class T, class Hash = std::hash<Key>>
+class insertion_ordered_map
+{
+    struct entry
+    {
+        std::pair<Key, T> kv;
+        std::size_t hash;
+        bool live;
+    };
+
+  public:
+    using key_type = Key;
+    using mapped_type = T;
+    using value_type = std::pair<Key, T>;
+    using size_type = std::size_t;
+
+    template <bool Const>
+    class basic_iterator
+    {
+        using entry_pointer =
+            typename std::conditional<Const, const entry*, entry*>::type;
+
+      public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::pair<Key, T>;
+        using difference_type = std::ptrdiff_t;
+        using reference =
+            typename std::conditional<Const, const value_type&,
+                                      value_type&>::type;
+        using pointer = typename std::conditional<Const, const value_type*,
+                                                  value_type*>::type;
+
+        basic_iterator() = default;
+
+        /**
+         * An iterator converts to a const_iterator.
+         */
+        template <bool C = Const, class = typename std::enable_if<C>::type>
+        basic_iterator(const basic_iterator<false>& other)
+            : it_(other.it_), end_(other.end_)
+        {
+            // nothing
+        }
+
+        reference operator*() const
+        {
+            return it_->kv;
+        }
+
+        pointer operator->() const
+        {
+            return &it_->kv;
+        }
+
+        basic_iterator& operator++()
+        {
+            ++it_;
+            skip_dead();
+            return *this;
+        }
+
+        basic_iterator operator++(int)
+        {
+            auto copy = *this;
+            ++*this;
+            return copy;
+        }
+
+        friend bool operator==(const basic_iterator& lhs,
+                               const basic_iterator& rhs)
+        {
+            return lhs.it_ == rhs.it_;
+        }
+
+        friend bool operator!=(const basic_iterator& lhs,
+                               const basic_iterator& rhs)
+        {
+            return lhs.it_ != rhs.it_;
+        }
+
+      private:
+        friend class insertion_ordered_map;
+        template <bool>
+        friend class basic_iterator;
+
+        basic_iterator(entry_pointer it, entry_pointer end)
+            : it_(it), end_(end)
+        {
+            skip_dead();
+        }
+
+        void skip_dead()
+        {
+            while (it_ != end_ && !it_->live)
+                ++it_;
+        }
+
+        entry_pointer it_ = nullptr;
+        entry_pointer end_ = nullptr;
+    };
+
+    using iterator = basic_iterator<false>;
+    using const_iterator = basic_iterator<true>;
+
+    iterator begin()
+    {
+        return at_position(0);
+    }
+
+    const_iterator begin() const
+    {
+        return at_position(0);
+    }
+
+    iterator end()
+    {
+        return at_position(entries_.size());
+    }
+
+    const_iterator end() const
+    {
+        return at_position(entries_.size());
+    }
+
+    bool empty() const
+    {
+        return size_ == 0;
+    }
+
+    size_type size() const
+    {
+        return size_;
+    }
+
+    iterator find(const Key& key)
+    {
+        return at_position(locate(key, Hash{}(key)));
+    }
+
+    const_iterator find(const Key& key) const
+    {
+        return at_position(locate(key, Hash{}(key)));
+    }
+
+    size_type count(const Key& key) const
+    {
+        return locate(key, Hash{}(key)) == entries_.size() ? 0 : 1;
+    }
+
+    T& at(const Key& key)
+    {
+        auto pos = locate(key, Hash{}(key));
+        if (pos == entries_.size())
+            throw std::out_of_range{"insertion_ordered_map::at"};
+        return entries_[pos].kv.second;
+    }
+
+    const T& at(const Key& key) const
+    {
+        auto pos = locate(key, Hash{}(key));
+        if (pos == entries_.size())
+            throw std::out_of_range{"insertion_ordered_map::at"};
+        return entries_[pos].kv.second;
+    }
+
+    T& operator[](const Key& key)
+    {
+        return try_emplace(key).first->second;
+    }
+
+    template <class K, class V>
+    std::pair<iterator, bool> emplace(K&& key, V&& val)
+    {
+        Key k(std::forward<K>(key));
+        auto hash = Hash{}(k);
+        auto pos = locate(k, hash);
+        if (pos != entries_.size())
+            return {at_position(pos), false};
+        append(std::move(k), T(std::forward<V>(val)), hash);
+        return {at_position(entries_.size() - 1), true};
+    }
+
+    std::pair<iterator, bool> try_emplace(const Key& key)
+    {
+        auto hash = Hash{}(key);
+        auto pos = locate(key, hash);
+        if (pos != entries_.size())
+            return {at_position(pos), false};
+        append(Key(key), T(), hash);
+        return {at_position(entries_.size() - 1), true};
+    }
+
+    size_type erase(const Key& key)
+    {
+        auto pos = locate(key, Hash{}(key));
+        if (pos == entries_.size())
+            return 0;
+
+        // leave a tombstone, releasing what the entry held
+        entries_[pos].live = false;
+        entries_[pos].kv = value_type{};
+        --size_;
+
+        auto dead = entries_.size() - size_;
+        if (dead > linear_limit && dead > size_)
+            purge();
+        return 1;
+    }
+
+    void clear()
+    {
+        entries_.clear();
+        index_.clear();
+        size_ = 0;
+    }
+
+    /**
+     * Removes the tombstones and releases the unused capacity of the
+     * entries and the index, returning the bytes freed.
+     */
+    size_type shrink_to_fit()
+    {
+        auto before = memory();
+        if (size_ != entries_.size())
+            purge();
+        entries_.shrink_to_fit();
+        index_.shrink_to_fit();
+        auto after = memory();
+        return before > after ? before - after : 0;
+    }
+
+  private:
+    /**
+     * Maps with at most this many entries (live or dead) have no index.
+     */
+    static const size_type linear_limit = 8;
+
+    iterator at_position(size_type pos)
+    {
+        auto first = entries_.data();
+        return {first + pos, first + entries_.size()};
+    }
+
+    const_iterator at_position(size_type pos) const
+    {
+        auto first = entries_.data();
+        return {first + pos, first + entries_.size()};
+    }
+
+    bool matches(const entry& e, const Key& key, std::size_t hash) const
+    {
+        return e.live && e.hash == hash && e.kv.first == key;
+    }
+
+    /**
+     * The position of the live entry for key, or entries_.size() if
+     * there is none.
+     */
+    size_type locate(const Key& key, std::size_t hash) const
+    {
+        if (index_.empty())
+        {
+            for (size_type pos = 0; pos < entries_.size(); ++pos)
+            {
+                if (matches(entries_[pos], key, hash))
+                    return pos;
+            }
+            return entries_.size();
+        }
+
+        auto mask = index_.size() - 1;
+        for (auto i = hash & mask; index_[i] != 0; i = (i + 1) & mask)
+        {
+            auto pos = index_[i] - 1;
+            if (matches(entries_[pos], key, hash))
+                return pos;
+        }
+        return entries_.size();
+    }
+
+    void append(Key&& key, T&& val, std::size_t hash)
+    {
+        entries_.push_back(entry{value_type{std::move(key), std::move(val)},
+                                 hash, true});
+        ++size_;
+
+        // the index is kept at most half full, counting tombstones
+        if (index_.empty() ? entries_.size() > linear_limit
+                           : entries_.size() * 2 > index_.size())
+            rebuild_index();
+        else if (!index_.empty())
+            place(entries_.size() - 1);
+    }
+
+    void place(size_type pos)
+    {
+        auto mask = index_.size() - 1;
+        auto i = entries_[pos].hash & mask;
+        while (index_[i] != 0)
+            i = (i + 1) & mask;
+        index_[i] = pos + 1;
+    }
+
+    size_type memory() const
+    {
+        return entries_.capacity() * sizeof(entry)
+               + index_.capacity() * sizeof(size_type);
+    }
+
+    void rebuild_index()
+    {
+        index_.clear();
+        if (entries_.size() <= linear_limit)
+            return;
+
+        size_type capacity = 2 * linear_limit;
+        while (capacity < entries_.size() * 2)
+            capacity *= 2;
+        // a new vector, so that a smaller index gives back the old one's
+        std::vector<size_type>(capacity, 0).swap(index_);
+        for (size_type pos = 0; pos < entries_.size(); ++pos)
+        {
+            if (entries_[pos].live)
+                place(pos);
+        }
+    }
+
+    /**
+     * Removes the tombstones, keeping the live entries in order.
+     */
+    void purge()
+    {
+        entries_.erase(std::remove_if(entries_.begin(), entries_.end(),
+                                      [](const entry& e) { return !e.live; }),
+                       entries_.end());
+        rebuild_index();
+    }
+
+    std::vector<entry> entries_;
+    // the position of each entry plus one, or zero for an empty slot
+    std::vector<size_type> index_;
+    size_type size_ = 0;
+};
+
+template <class Key, class T, class Hash>
+std::size_t shrink_map(insertion_ordered_map<Key, T, Hash>& m)
+{
+    return m.shrink_to_fit();
+}
+}
+
+// entries are kept in the order they were inserted (which, for a parsed
+// document, is the order they appear in) while lookups still hash
+using string_to_base_map
+    = detail::insertion_ordered_map<std::string, std::shared_ptr<base>>;
 #else
 // by default an unordered_map is used for best performance as the
 // toml specification does not require entries to be sorted
@@ -395,74 +855,390 @@ inline std::shared_ptr<T> make_element();
 inline std::shared_ptr<table> make_table();
 inline std::shared_ptr<table_array> make_table_array();
 
+#if defined(CPPTOML_RECYCLE_NODES)
+// The most freed nodes of each type kept for reuse by each thread.
+#if !defined(CPPTOML_RECYCLE_MAX_NODES)
+#define CPPTOML_RECYCLE_MAX_NODES 65536
+#endif
+
+namespace detail
+{
 /**
- * A generic base TOML value used for type erasure.
+ * The calling thread's free list of nodes of one type. Freed nodes are
+ * linked through their own storage, so keeping them costs nothing extra.
+ * This is trivially destructible so that nodes freed while the thread
+ * exits (after free_list_drain has run) can still see that the list is
+ * closed.
  */
-class base : public std::enable_shared_from_this<base>
+struct free_list
 {
-  public:
-    virtual ~base() = default;
+    struct link
+    {
+        link* next;
+    };
 
-    virtual std::shared_ptr<base> clone() const = 0;
+    link* head;
+    std::size_t size;
+    bool closed;
+};
 
-    /**
-     * Determines if the given TOML element is a value.
-     */
-    virtual bool is_value() const
+/**
+ * Releases the nodes on a thread's free list when the thread exits.
+ */
+struct free_list_drain
+{
+    free_list* list;
+
+    ~free_list_drain()
     {
-        return false;
+        while (list->head)
+        {
+            auto next = list->head->next;
+            ::operator delete(list->head);
+            list->head = next;
+        }
+        list->size = 0;
+        list->closed = true;
     }
+};
 
-    /**
-     * Determines if the given TOML element is a table.
-     */
-    virtual bool is_table() const
+/**
+ * Allocates nodes (together with their shared_ptr control blocks, via
+ * allocate_shared) from a per-thread free list for each node type, so
+ * that the nodes of a retired document are reused by the next one parsed
+ * on the same thread instead of going back to the general allocator.
+ */
+template <class T>
+class recycling_allocator
+{
+  public:
+    using value_type = T;
+
+    recycling_allocator() = default;
+
+    template <class U>
+    recycling_allocator(const recycling_allocator<U>&)
     {
-        return false;
+        // nothing
     }
 
-    /**
-     * Converts the TOML element into a table.
-     */
-    std::shared_ptr<table> as_table()
+    T* allocate(std::size_t n)
     {
-        if (is_table())
-            return std::static_pointer_cast<table>(shared_from_this());
-        return nullptr;
+        auto& list = local_list();
+        if (n == 1 && list.head)
+        {
+            auto node = list.head;
+            list.head = node->next;
+            --list.size;
+#if defined(__GNUC__)
+            // the next node is usually cold by now
+            if (list.head)
+                __builtin_prefetch(list.head, 1);
+#endif
+            return reinterpret_cast<T*>(node);
+        }
+        return static_cast<T*>(::operator new(n * sizeof(T)));
     }
-    /**
-     * Determines if the TOML element is an array of "leaf" elements.
-     */
-    virtual bool is_array() const
+
+    void deallocate(T* p, std::size_t n)
     {
-        return false;
+        auto& list = local_list();
+        if (n == 1 && !list.closed && list.size < CPPTOML_RECYCLE_MAX_NODES)
+        {
+            auto node = reinterpret_cast<free_list::link*>(p);
+            node->next = list.head;
+            list.head = node;
+            ++list.size;
+            return;
+        }
+        ::operator delete(p);
     }
 
-    /**
-     * Converts the TOML element to an array.
-     */
-    std::shared_ptr<array> as_array()
+    template <class U>
+    bool operator==(const recycling_allocator<U>&) const
     {
-        if (is_array())
-            return std::static_pointer_cast<array>(shared_from_this());
-        return nullptr;
+        return true;
     }
 
-    /**
-     * Determines if the given TOML element is an array of tables.
-     */
-    virtual bool is_table_array() const
+    template <class U>
+    bool operator!=(const recycling_allocator<U>&) const
     {
         return false;
     }
 
-    /**
-     * Converts the TOML element into a table array.
-     */
-    std::shared_ptr<table_array> as_table_array()
+  private:
+    static_assert(sizeof(T) >= sizeof(free_list::link),
+                  "nodes must be large enough to link freed ones together");
+
+    static free_list& local_list()
     {
-        if (is_table_array())
-            return std::static_pointer_cast<table_array>(shared_from_this());
+        static thread_local free_list list;
+        if (!list.closed)
+        {
+            static thread_local free_list_drain drain{&list};
+            (void)drain;
+        }
+        return list;
+    }
+};
+}
+#endif
+
+namespace detail
+{
+/**
+ * Memory that table::compact() allocates a document's nodes from one
+ * after another, so that they end up next to each other. Nodes are not
+ * freed individually: the arena counts the nodes in it, plus one for its
+ * creator, and frees all of its memory once that count drops to zero.
+ */
+class node_arena
+{
+  public:
+    void* allocate(std::size_t size, std::size_t align)
+    {
+        auto space = static_cast<std::size_t>(end_ - next_);
+        auto pad = (align - reinterpret_cast<std::uintptr_t>(next_) % align)
+                   % align;
+        if (!next_ || pad + size > space)
+        {
+            // blocks double in size so that small documents waste little
+            block_size_ = std::max(block_size_ * 2, size + align);
+            blocks_.emplace_back(new char[block_size_]);
+            next_ = blocks_.back().get();
+            end_ = next_ + block_size_;
+            pad = (align - reinterpret_cast<std::uintptr_t>(next_) % align)
+                  % align;
+        }
+        auto p = next_ + pad;
+        next_ = p + size;
+        refs_.fetch_add(1, std::memory_order_relaxed);
+        return p;
+    }
+
+    /**
+     * Drops one reference, for a node or for the creator.
+     */
+    void release()
+    {
+        if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            delete this;
+    }
+
+  private:
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    char* next_ = nullptr;
+    char* end_ = nullptr;
+    std::size_t block_size_ = 512;
+    std::atomic<std::size_t> refs_{1};
+};
+
+/**
+ * Allocates nodes (with their shared_ptr control blocks) from a
+ * node_arena.
+ */
+template <class T>
+class arena_allocator
+{
+  public:
+    using value_type = T;
+
+    explicit arena_allocator(node_arena* arena) : arena_(arena)
+    {
+        // nothing
+    }
+
+    template <class U>
+    arena_allocator(const arena_allocator<U>& other) : arena_(other.arena_)
+    {
+        // nothing
+    }
+
+    T* allocate(std::size_t n)
+    {
+        return static_cast<T*>(arena_->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T*, std::size_t)
+    {
+        arena_->release();
+    }
+
+    template <class U>
+    bool operator==(const arena_allocator<U>& other) const
+    {
+        return arena_ == other.arena_;
+    }
+
+    template <class U>
+    bool operator!=(const arena_allocator<U>& other) const
+    {
+        return arena_ != other.arena_;
+    }
+
+  private:
+    template <class>
+    friend class arena_allocator;
+
+    node_arena* arena_;
+};
+
+/**
+ * The arena that make_node() allocates from on the calling thread, if
+ * any.
+ */
+inline node_arena*& current_node_arena()
+{
+    static thread_local node_arena* arena = nullptr;
+    return arena;
+}
+
+/**
+ * Allocates the nodes made on the calling thread from a new arena for
+ * the lifetime of a scope.
+ */
+class node_arena_scope
+{
+  public:
+    node_arena_scope() : previous_(current_node_arena())
+    {
+        current_node_arena() = new node_arena;
+    }
+
+    ~node_arena_scope()
+    {
+        current_node_arena()->release();
+        current_node_arena() = previous_;
+    }
+
+    node_arena_scope(const node_arena_scope&) = delete;
+    node_arena_scope& operator=(const node_arena_scope&) = delete;
+
+  private:
+    node_arena* previous_;
+};
+
+/**
+ * Allocates a node of type T, from the current node_arena if there is
+ * one, recycling freed nodes when CPPTOML_RECYCLE_NODES is defined.
+ */
+template <class T, class... Args>
+std::shared_ptr<T> make_node(Args&&... args)
+{
+    if (auto arena = current_node_arena())
+        return std::allocate_shared<T>(arena_allocator<T>{arena},
+                                       std::forward<Args>(args)...);
+#if defined(CPPTOML_RECYCLE_NODES)
+    return std::allocate_shared<T>(recycling_allocator<T>{},
+                                   std::forward<Args>(args)...);
+#else
+    return std::make_shared<T>(std::forward<Args>(args)...);
+#endif
+}
+
+/**
+ * Releases the unused capacity of a vector, returning the bytes freed.
+ */
+template <class T>
+std::size_t shrink_vector(std::vector<T>& v)
+{
+    auto before = v.capacity();
+    v.shrink_to_fit();
+    return before > v.capacity() ? (before - v.capacity()) * sizeof(T) : 0;
+}
+
+/**
+ * Rehashes a map to the fewest buckets that hold its elements, returning
+ * the bytes freed.
+ */
+template <class Key, class T, class Hash, class Equal, class Alloc>
+std::size_t shrink_map(std::unordered_map<Key, T, Hash, Equal, Alloc>& m)
+{
+    auto before = m.bucket_count();
+    m.rehash(0);
+    return before > m.bucket_count()
+               ? (before - m.bucket_count()) * sizeof(void*)
+               : 0;
+}
+
+/**
+ * A std::map has no spare capacity to release.
+ */
+template <class Key, class T, class Compare, class Alloc>
+std::size_t shrink_map(std::map<Key, T, Compare, Alloc>&)
+{
+    return 0;
+}
+}
+
+/**
+ * A generic base TOML value used for type erasure.
+ */
+class base : public std::enable_shared_from_this<base>
+{
+  public:
+    virtual ~base() = default;
+
+    virtual std::shared_ptr<base> clone() const = 0;
+
+    /**
+     * Determines if the given TOML element is a value.
+     */
+    virtual bool is_value() const
+    {
+        return false;
+    }
+
+    /**
+     * Determines if the given TOML element is a table.
+     */
+    virtual bool is_table() const
+    {
+        return false;
+    }
+
+    /**
+     * Converts the TOML element into a table.
+     */
+    std::shared_ptr<table> as_table()
+    {
+        if (is_table())
+            return std::static_pointer_cast<table>(shared_from_this());
+        return nullptr;
+    }
+    /**
+     * Determines if the TOML element is an array of "leaf" elements.
+     */
+    virtual bool is_array() const
+    {
+        return false;
+    }
+
+    /**
+     * Converts the TOML element to an array.
+     */
+    std::shared_ptr<array> as_array()
+    {
+        if (is_array())
+            return std::static_pointer_cast<array>(shared_from_this());
+        return nullptr;
+    }
+
+    /**
+     * Determines if the given TOML element is an array of tables.
+     */
+    virtual bool is_table_array() const
+    {
+        return false;
+    }
+
+    /**
+     * Converts the TOML element into a table array.
+     */
+    std::shared_ptr<table_array> as_table_array()
+    {
+        if (is_table_array())
+            return std::static_pointer_cast<table_array>(shared_from_this());
         return nullptr;
     }
 
@@ -479,11 +1255,37 @@ class base : public std::enable_shared_from_this<base>
     template <class Visitor, class... Args>
     void accept(Visitor&& visitor, Args&&... args) const;
 
+#if defined(CPPTOML_TRACK_ACCESS)
+    /**
+     * Gets the number of times this element has been looked up by key
+     * since it was created or its count was last reset.
+     */
+    uint64_t access_count() const
+    {
+        return access_count_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Resets the access count of this element (but not of its children).
+     */
+    void reset_access_count() const
+    {
+        access_count_.store(0, std::memory_order_relaxed);
+    }
+#endif
+
   protected:
     base()
     {
         // nothing
     }
+
+#if defined(CPPTOML_TRACK_ACCESS)
+  private:
+    friend class table;
+
+    mutable std::atomic<uint64_t> access_count_{0};
+#endif
 };
 
 /**
@@ -547,12 +1349,23 @@ class value : public base
     value& operator=(const value& val) = delete;
 };
 
+#if defined(CPPTOML_COMPILED_LIB) && !defined(CPPTOML_IMPLEMENTATION)
+extern template class value<std::string>;
+extern template class value<int64_t>;
+extern template class value<double>;
+extern template class value<bool>;
+extern template class value<local_date>;
+extern template class value<local_time>;
+extern template class value<local_datetime>;
+extern template class value<offset_datetime>;
+#endif
+
 template <class T>
 std::shared_ptr<typename value_traits<T>::type> make_value(T&& val)
 {
     using value_type = typename value_traits<T>::type;
     using enabler = typename value_type::make_shared_enabler;
-    return std::make_shared<value_type>(
+    return detail::make_node<value_type>(
         enabler{}, value_traits<T>::construct(std::forward<T>(val)));
 }
 
@@ -862,7 +1675,7 @@ inline std::shared_ptr<array> make_array()
         }
     };
 
-    return std::make_shared<make_shared_enabler>();
+    return detail::make_node<make_shared_enabler>();
 }
 
 template <>
@@ -895,9 +1708,24 @@ array::get_array_of<array>() const
 
 class table;
 
+/**
+ * Represents an array of tables.
+ *
+ * When every table in an array parsed from [[headers]] has the same keys,
+ * the parser stores the rows compactly: one shared list of keys and a
+ * row-major block of their values, rather than a table (and a hash map)
+ * per row. The rows are turned back into tables the first time they are
+ * needed as tables, i.e. by iterating, calling get(), or modifying the
+ * array; size(), at() and get_as() read the compact form directly.
+ */
 class table_array : public base
 {
     friend class table;
+    template <class>
+    friend class basic_parser;
+    template <class>
+    friend class basic_toml_writer;
+    friend class cbor_writer;
     friend std::shared_ptr<table_array> make_table_array();
 
   public:
@@ -917,21 +1745,25 @@ class table_array : public base
 
     iterator begin()
     {
+        materialize();
         return array_.begin();
     }
 
     const_iterator begin() const
     {
+        materialize();
         return array_.begin();
     }
 
     iterator end()
     {
+        materialize();
         return array_.end();
     }
 
     const_iterator end() const
     {
+        materialize();
         return array_.end();
     }
 
@@ -942,19 +1774,49 @@ class table_array : public base
 
     std::vector<std::shared_ptr<table>>& get()
     {
+        materialize();
         return array_;
     }
 
     const std::vector<std::shared_ptr<table>>& get() const
     {
+        materialize();
         return array_;
     }
 
+    /**
+     * Gets the number of tables in the array.
+     */
+    size_type size() const
+    {
+        if (compact_rows_.load(std::memory_order_acquire) != 0)
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            return compact_rows_.load(std::memory_order_relaxed)
+                   + array_.size();
+        }
+        return array_.size();
+    }
+
+    /**
+     * Obtains the element for the given key in the given row.
+     * @throw std::out_of_range if the row or key does not exist
+     */
+    std::shared_ptr<base> at(size_type row, const std::string& key) const;
+
+    /**
+     * Helper function that attempts to get a value corresponding to the
+     * template parameter from the given key in the given row.
+     */
+    template <class T>
+    option<T> get_as(size_type row, const std::string& key) const;
+
     /**
      * Add a table to the end of the array
      */
     void push_back(const std::shared_ptr<table>& val)
     {
+        materialize();
         array_.push_back(val);
     }
 
@@ -979,6 +1841,7 @@ class table_array : public base
      */
     void clear()
     {
+        materialize();
         array_.clear();
     }
 
@@ -987,6 +1850,7 @@ class table_array : public base
      */
     void reserve(size_type n)
     {
+        materialize();
         array_.reserve(n);
     }
 
@@ -999,7 +1863,49 @@ class table_array : public base
     table_array(const table_array& obj) = delete;
     table_array& operator=(const table_array& rhs) = delete;
 
-    std::vector<std::shared_ptr<table>> array_;
+    /**
+     * The keys shared by the compact rows, and the column of each.
+     */
+    struct record_schema
+    {
+        std::vector<std::string> keys;
+        std::unordered_map<std::string, size_type> columns;
+    };
+
+    /**
+     * Moves the last table in array_ into the compact rows if it has the
+     * same keys as the rows before it (in the same order, when tables keep
+     * their keys in insertion order, since compact rows are rebuilt in the
+     * first row's order). Once a table with different keys is seen, the
+     * array is materialized and stays that way. Used by the parser just
+     * before it appends the next table, since only the last table can
+     * still be added to. Returns the emptied table for reuse as the next
+     * row if it was compacted, or nullptr otherwise.
+     */
+    std::shared_ptr<table> compact_back();
+
+    /**
+     * Turns the compact rows back into tables at the front of array_.
+     */
+    void materialize() const;
+
+    /**
+     * Builds a table holding compact row i.
+     */
+    std::shared_ptr<table> make_row(size_type i) const;
+
+    /**
+     * Gets row i as a table without materializing the array; compact
+     * rows are returned as new tables sharing the row's elements.
+     */
+    std::shared_ptr<table> row(size_type i) const;
+
+    mutable std::vector<std::shared_ptr<table>> array_;
+    mutable std::vector<std::shared_ptr<base>> cells_;
+    mutable std::atomic<size_type> compact_rows_{0};
+    mutable std::mutex mutex_;
+    std::shared_ptr<const record_schema> schema_;
+    bool uniform_ = true;
 };
 
 inline std::shared_ptr<table_array> make_table_array()
@@ -1012,7 +1918,7 @@ inline std::shared_ptr<table_array> make_table_array()
         }
     };
 
-    return std::make_shared<make_shared_enabler>();
+    return detail::make_node<make_shared_enabler>();
 }
 
 template <>
@@ -1094,6 +2000,8 @@ class table : public base
 {
   public:
     friend class table_array;
+    template <class>
+    friend class basic_parser;
     friend std::shared_ptr<table> make_table();
 
     std::shared_ptr<base> clone() const override;
@@ -1138,6 +2046,14 @@ class table : public base
         return map_.empty();
     }
 
+    /**
+     * Gets the number of keys in the table.
+     */
+    std::size_t size() const
+    {
+        return map_.size();
+    }
+
     /**
      * Determines if this key table contains the given key.
      */
@@ -1162,7 +2078,7 @@ class table : public base
      */
     std::shared_ptr<base> get(const std::string& key) const
     {
-        return map_.at(key);
+        return accessed(map_.at(key));
     }
 
     /**
@@ -1176,7 +2092,7 @@ class table : public base
     {
         std::shared_ptr<base> p;
         resolve_qualified(key, &p);
-        return p;
+        return accessed(p);
     }
 
     /**
@@ -1184,8 +2100,9 @@ class table : public base
      */
     std::shared_ptr<table> get_table(const std::string& key) const
     {
-        if (contains(key) && get(key)->is_table())
-            return std::static_pointer_cast<table>(get(key));
+        auto it = map_.find(key);
+        if (it != map_.end() && it->second->is_table())
+            return std::static_pointer_cast<table>(accessed(it->second));
         return nullptr;
     }
 
@@ -1195,9 +2112,13 @@ class table : public base
      */
     std::shared_ptr<table> get_table_qualified(const std::string& key) const
     {
-        if (contains_qualified(key) && get_qualified(key)->is_table())
-            return std::static_pointer_cast<table>(get_qualified(key));
-        return nullptr;
+        if (!contains_qualified(key))
+            return nullptr;
+        std::shared_ptr<base> p;
+        resolve_qualified(key, &p);
+        if (!p->is_table())
+            return nullptr;
+        return std::static_pointer_cast<table>(accessed(p));
     }
 
     /**
@@ -1247,17 +2168,7 @@ class table : public base
      * to the template parameter from a given key.
      */
     template <class T>
-    option<T> get_as(const std::string& key) const
-    {
-        try
-        {
-            return get_impl<T>(get(key));
-        }
-        catch (const std::out_of_range&)
-        {
-            return {};
-        }
-    }
+    option<T> get_as(const std::string& key) const;
 
     /**
      * Helper function that attempts to get a value corresponding
@@ -1265,17 +2176,7 @@ class table : public base
      * keys".
      */
     template <class T>
-    option<T> get_qualified_as(const std::string& key) const
-    {
-        try
-        {
-            return get_impl<T>(get_qualified(key));
-        }
-        catch (const std::out_of_range&)
-        {
-            return {};
-        }
-    }
+    option<T> get_qualified_as(const std::string& key) const;
 
     /**
      * Helper function that attempts to get an array of values of a given
@@ -1367,6 +2268,33 @@ class table : public base
         map_.erase(key);
     }
 
+    /**
+     * Releases the memory this table and everything in it hold for
+     * growth: the spare capacity of arrays, table arrays and strings, and
+     * the buckets of each table beyond the fewest its keys need (and,
+     * with CPPTOML_USE_INSERTION_ORDER, its tombstones). Returns the
+     * number of bytes released. For documents that are kept for a long
+     * time once they are parsed.
+     *
+     * If relayout is true, everything below this table is also replaced
+     * by a copy whose node objects (with their reference counts) are
+     * allocated one after another from a contiguous arena, depth first in
+     * the order the tables iterate over their keys, for locality when it
+     * is read. The tables' own storage and the contents of strings are
+     * allocated as usual. The arena is freed once every node in it is,
+     * and the bytes this saves are not counted.
+     *
+     * Relayout replaces every node below this table, so nodes obtained
+     * from it beforehand are no longer part of it: a handle bound to the
+     * table keeps reading its old node (and keeps it alive) until it is
+     * bound again. Handles bound to a table_publisher re-bind if the
+     * table is published again afterwards. Access counts, when
+     * CPPTOML_TRACK_ACCESS is defined, are carried over to the copies.
+     * Compacting a table that other threads are reading is not safe;
+     * compact a document before publishing it.
+     */
+    std::size_t compact(bool relayout = false);
+
   private:
     table()
     {
@@ -1376,7 +2304,52 @@ class table : public base
     table(const table& obj) = delete;
     table& operator=(const table& rhs) = delete;
 
-    std::vector<std::string> split(const std::string& value,
+    /**
+     * Releases the spare capacity held by a node and everything in it,
+     * returning the number of bytes released.
+     */
+    static std::size_t shrink(base& b);
+
+#if defined(CPPTOML_TRACK_ACCESS)
+    /**
+     * Copies the access counts of from and everything in it to to, a
+     * clone of it.
+     */
+    static void carry_access(const base& from, const base& to);
+#endif
+
+    /**
+     * Finds the element for the given key, inserting an empty slot for it
+     * if it is absent. Returns the slot and whether it was inserted. Used
+     * by the parser so that lookup-or-insert costs a single probe when the
+     * key already exists (and always, with C++17).
+     */
+    std::pair<iterator, bool> try_emplace(const std::string& key)
+    {
+#if __cplusplus >= 201703L
+        return map_.try_emplace(key);
+#else
+        auto it = map_.find(key);
+        if (it != map_.end())
+            return {it, false};
+        return map_.emplace(key, nullptr);
+#endif
+    }
+
+    /**
+     * Records a lookup of the given element when CPPTOML_TRACK_ACCESS is
+     * defined, and returns it.
+     */
+    static const std::shared_ptr<base>&
+    accessed(const std::shared_ptr<base>& b)
+    {
+#if defined(CPPTOML_TRACK_ACCESS)
+        b->access_count_.fetch_add(1, std::memory_order_relaxed);
+#endif
+        return b;
+    }
+
+    std::vector<std::string> split(const std::string& value,
                                    char separator) const
     {
         std::vector<std::string> result;
@@ -1406,14 +2379,17 @@ class table : public base
         auto table = this;
         for (const auto& part : parts)
         {
-            table = table->get_table(part).get();
-            if (!table)
+            // look the intermediate tables up directly so that they don't
+            // count as accessed
+            auto it = table->map_.find(part);
+            if (it == table->map_.end() || !it->second->is_table())
             {
                 if (!p)
                     return false;
 
                 throw std::out_of_range{key + " is not a valid key"};
             }
+            table = static_cast<const cpptoml::table*>(it->second.get());
         }
 
         if (!p)
@@ -1490,7 +2466,81 @@ table::get_qualified_array_of<array>(const std::string& key) const
     return {};
 }
 
-std::shared_ptr<table> make_table()
+template <class T>
+option<T> table::get_as(const std::string& key) const
+{
+    try
+    {
+        return get_impl<T>(get(key));
+    }
+    catch (const std::out_of_range&)
+    {
+        return {};
+    }
+}
+
+template <class T>
+option<T> table::get_qualified_as(const std::string& key) const
+{
+    try
+    {
+        return get_impl<T>(get_qualified(key));
+    }
+    catch (const std::out_of_range&)
+    {
+        return {};
+    }
+}
+
+template <class T>
+option<T> table_array::get_as(size_type row, const std::string& key) const
+{
+    try
+    {
+        return get_impl<T>(at(row, key));
+    }
+    catch (const std::out_of_range&)
+    {
+        return {};
+    }
+}
+
+#if defined(CPPTOML_COMPILED_LIB) && !defined(CPPTOML_IMPLEMENTATION)
+extern template option<std::string>
+table::get_as<std::string>(const std::string&) const;
+extern template option<int64_t>
+table::get_as<int64_t>(const std::string&) const;
+extern template option<double>
+table::get_as<double>(const std::string&) const;
+extern template option<bool>
+table::get_as<bool>(const std::string&) const;
+extern template option<local_date>
+table::get_as<local_date>(const std::string&) const;
+extern template option<local_time>
+table::get_as<local_time>(const std::string&) const;
+extern template option<local_datetime>
+table::get_as<local_datetime>(const std::string&) const;
+extern template option<offset_datetime>
+table::get_as<offset_datetime>(const std::string&) const;
+extern template option<std::string>
+table::get_qualified_as<std::string>(const std::string&) const;
+extern template option<int64_t>
+table::get_qualified_as<int64_t>(const std::string&) const;
+extern template option<double>
+table::get_qualified_as<double>(const std::string&) const;
+extern template option<bool>
+table::get_qualified_as<bool>(const std::string&) const;
+extern template option<local_date>
+table::get_qualified_as<local_date>(const std::string&) const;
+extern template option<local_time>
+table::get_qualified_as<local_time>(const std::string&) const;
+extern template option<local_datetime>
+table::get_qualified_as<local_datetime>(const std::string&) const;
+extern template option<offset_datetime>
+table::get_qualified_as<offset_datetime>(const std::string&) const;
+#endif
+
+inline std::shared_ptr<table> make_table()
 {
     struct make_shared_enabler : public table
     {
@@ -1500,7 +2550,7 @@ std::shared_ptr<table> make_table()
         }
     };
 
-    return std::make_shared<make_shared_enabler>();
+    return detail::make_node<make_shared_enabler>();
 }
 
 template <>
@@ -1509,13 +2559,165 @@ inline std::shared_ptr<table> make_element<table>()
     return make_table();
 }
 
+/**
+ * Holds the current version of a document so that handles bound to it
+ * follow along as new versions are published, e.g. when a configuration
+ * file is reloaded. Publishing and reading may happen on different
+ * threads.
+ */
+class table_publisher
+{
+  public:
+    table_publisher(std::shared_ptr<table> root = nullptr)
+        : root_(std::move(root))
+    {
+        // nothing
+    }
+
+    /**
+     * Makes root the current document. Handles bound to this publisher
+     * re-bind to it the next time they are read.
+     */
+    void publish(std::shared_ptr<table> root)
+    {
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            root_ = std::move(root);
+        }
+        version_.fetch_add(1, std::memory_order_release);
+    }
+
+    /**
+     * Gets the current document.
+     */
+    std::shared_ptr<table> current() const
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        return root_;
+    }
+
+    /**
+     * Gets the number of documents published so far.
+     */
+    uint64_t version() const
+    {
+        return version_.load(std::memory_order_acquire);
+    }
+
+  private:
+    mutable std::mutex mutex_;
+    std::shared_ptr<table> root_;
+    std::atomic<uint64_t> version_{0};
+};
+
+/**
+ * A typed reference to the value at a (qualified) key, resolved once so
+ * that reading it again costs a pointer load rather than a hash lookup
+ * and a dynamic cast.
+ *
+ * A handle bound to a table keeps referring to the value it was bound to
+ * even if the table is modified later. A handle bound to a
+ * table_publisher checks the publisher's version on every read and
+ * re-binds to the newest document when it has changed. A handle is not
+ * itself safe to read from several threads at once; give each thread its
+ * own copy.
+ */
+template <class T>
+class handle
+{
+  public:
+    static_assert(valid_value<T>::value, "invalid handle type");
+
+    /**
+     * Constructs a handle that is not bound to any value.
+     */
+    handle() = default;
+
+    /**
+     * Binds a handle to the value at the given key of tbl.
+     */
+    handle(const table& tbl, std::string key) : key_(std::move(key))
+    {
+        bind(tbl);
+    }
+
+    /**
+     * Binds a handle to the value at the given key of the document most
+     * recently published by publisher, which must outlive the handle.
+     */
+    handle(const table_publisher& publisher, std::string key)
+        : publisher_(&publisher), key_(std::move(key))
+    {
+        refresh();
+    }
+
+    /**
+     * Determines if the key exists and holds a value of type T.
+     */
+    explicit operator bool() const
+    {
+        return resolve() != nullptr;
+    }
+
+    /**
+     * Gets the value. The handle must not be empty.
+     */
+    const T& operator*() const
+    {
+        return resolve()->get();
+    }
+
+    const T* operator->() const
+    {
+        return &resolve()->get();
+    }
+
+    /**
+     * Gets the value, or the given alternative if the handle is empty.
+     */
+    const T& value_or(const T& alternative) const
+    {
+        if (auto v = resolve())
+            return v->get();
+        return alternative;
+    }
+
+  private:
+    const value<T>* resolve() const
+    {
+        if (publisher_ && publisher_->version() != version_)
+            refresh();
+        return value_.get();
+    }
+
+    void refresh() const
+    {
+        version_ = publisher_->version();
+        value_ = nullptr;
+        if (auto root = publisher_->current())
+            bind(*root);
+    }
+
+    void bind(const table& tbl) const
+    {
+        if (tbl.contains_qualified(key_))
+            value_ = tbl.get_qualified(key_)->template as<T>();
+    }
+
+    const table_publisher* publisher_ = nullptr;
+    std::string key_;
+    mutable uint64_t version_ = 0;
+    mutable std::shared_ptr<const value<T>> value_;
+};
+
 template <class T>
 std::shared_ptr<base> value<T>::clone() const
 {
     return make_value(data_);
 }
 
-inline std::shared_ptr<base> array::clone() const
+#if CPPTOML_DEFINE_OUT_OF_LINE
+CPPTOML_INLINE std::shared_ptr<base> array::clone() const
 {
     auto result = make_array();
     result->reserve(values_.size());
@@ -1524,16 +2726,148 @@ inline std::shared_ptr<base> array::clone() const
     return result;
 }
 
-inline std::shared_ptr<base> table_array::clone() const
+CPPTOML_INLINE std::shared_ptr<base> table_array::clone() const
 {
     auto result = make_table_array();
-    result->reserve(array_.size());
+    std::lock_guard<std::mutex> lock{mutex_};
+    result->schema_ = schema_;
+    result->uniform_ = uniform_;
+    result->cells_.reserve(cells_.size());
+    for (const auto& ptr : cells_)
+        result->cells_.push_back(ptr->clone());
+    result->compact_rows_.store(compact_rows_.load(std::memory_order_relaxed),
+                                std::memory_order_relaxed);
+    result->array_.reserve(array_.size());
     for (const auto& ptr : array_)
         result->array_.push_back(ptr->clone()->as_table());
     return result;
 }
 
-inline std::shared_ptr<base> table::clone() const
+CPPTOML_INLINE std::shared_ptr<base>
+table_array::at(size_type row, const std::string& key) const
+{
+    if (compact_rows_.load(std::memory_order_acquire) != 0)
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        auto rows = compact_rows_.load(std::memory_order_relaxed);
+        if (row < rows)
+        {
+            auto col = schema_->columns.find(key);
+            if (col == schema_->columns.end())
+                throw std::out_of_range{key + " is not a valid key"};
+            return table::accessed(
+                cells_[row * schema_->keys.size() + col->second]);
+        }
+        if (rows != 0)
+            return array_.at(row - rows)->get(key);
+    }
+    return array_.at(row)->get(key);
+}
+
+CPPTOML_INLINE std::shared_ptr<table> table_array::compact_back()
+{
+    if (!uniform_)
+        return nullptr;
+    if (array_.size() != 1)
+    {
+        uniform_ = false;
+        return nullptr;
+    }
+
+    const auto& row = array_.back()->map_;
+    if (!schema_)
+    {
+        auto schema = std::make_shared<record_schema>();
+        for (const auto& pr : row)
+        {
+            schema->columns.emplace(pr.first, schema->keys.size());
+            schema->keys.push_back(pr.first);
+        }
+        schema_ = std::move(schema);
+    }
+
+    auto width = schema_->keys.size();
+    auto first = cells_.size();
+    bool same_keys = row.size() == width;
+    if (same_keys)
+    {
+        cells_.resize(first + width);
+        size_type pos = 0;
+        for (const auto& pr : row)
+        {
+            auto col = schema_->columns.find(pr.first);
+            same_keys = col != schema_->columns.end();
+#if defined(CPPTOML_USE_INSERTION_ORDER)
+            same_keys = same_keys && col->second == pos;
+#endif
+            if (!same_keys)
+                break;
+            cells_[first + col->second] = pr.second;
+            ++pos;
+        }
+    }
+
+    if (!same_keys)
+    {
+        cells_.resize(first);
+        uniform_ = false;
+        materialize();
+        return nullptr;
+    }
+
+    auto last = std::move(array_.back());
+    array_.clear();
+    compact_rows_.fetch_add(1, std::memory_order_release);
+    last->map_.clear();
+    return last;
+}
+
+CPPTOML_INLINE void table_array::materialize() const
+{
+    if (compact_rows_.load(std::memory_order_acquire) == 0)
+        return;
+
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto rows = compact_rows_.load(std::memory_order_relaxed);
+    if (rows == 0)
+        return;
+
+    std::vector<std::shared_ptr<table>> tables;
+    tables.reserve(rows + array_.size());
+    for (size_type i = 0; i < rows; ++i)
+        tables.push_back(make_row(i));
+    tables.insert(tables.end(), array_.begin(), array_.end());
+    array_.swap(tables);
+
+    cells_.clear();
+    cells_.shrink_to_fit();
+    compact_rows_.store(0, std::memory_order_release);
+}
+
+CPPTOML_INLINE std::shared_ptr<table> table_array::make_row(size_type i) const
+{
+    auto width = schema_->keys.size();
+    auto result = make_table();
+    for (size_type col = 0; col < width; ++col)
+        result->map_.emplace(schema_->keys[col], cells_[i * width + col]);
+    return result;
+}
+
+CPPTOML_INLINE std::shared_ptr<table> table_array::row(size_type i) const
+{
+    if (compact_rows_.load(std::memory_order_acquire) != 0)
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        auto rows = compact_rows_.load(std::memory_order_relaxed);
+        if (i < rows)
+            return make_row(i);
+        if (rows != 0)
+            return array_[i - rows];
+    }
+    return array_[i];
+}
+
+CPPTOML_INLINE std::shared_ptr<base> table::clone() const
 {
     auto result = make_table();
     for (const auto& pr : map_)
@@ -1541,6 +2875,99 @@ inline std::shared_ptr<base> table::clone() const
     return result;
 }
 
+CPPTOML_INLINE std::size_t table::compact(bool relayout)
+{
+    auto reclaimed = shrink(*this);
+    if (relayout)
+    {
+        {
+            detail::node_arena_scope scope;
+            for (auto& pr : map_)
+            {
+                auto copy = pr.second->clone();
+#if defined(CPPTOML_TRACK_ACCESS)
+                carry_access(*pr.second, *copy);
+#endif
+                pr.second = std::move(copy);
+            }
+        }
+        // the copies have slack of their own
+        shrink(*this);
+    }
+    return reclaimed;
+}
+
+CPPTOML_INLINE std::size_t table::shrink(base& b)
+{
+    std::size_t reclaimed = 0;
+    if (b.is_table())
+    {
+        auto& t = static_cast<table&>(b);
+        reclaimed += detail::shrink_map(t.map_);
+        for (auto& pr : t.map_)
+            reclaimed += shrink(*pr.second);
+    }
+    else if (b.is_array())
+    {
+        auto& values = static_cast<array&>(b).get();
+        reclaimed += detail::shrink_vector(values);
+        for (auto& v : values)
+            reclaimed += shrink(*v);
+    }
+    else if (b.is_table_array())
+    {
+        auto& ta = static_cast<table_array&>(b);
+        std::lock_guard<std::mutex> lock{ta.mutex_};
+        reclaimed += detail::shrink_vector(ta.array_);
+        reclaimed += detail::shrink_vector(ta.cells_);
+        for (auto& t : ta.array_)
+            reclaimed += shrink(*t);
+        for (auto& cell : ta.cells_)
+            reclaimed += shrink(*cell);
+    }
+    else if (auto v = dynamic_cast<value<std::string>*>(&b))
+    {
+        auto& str = v->get();
+        auto before = str.capacity();
+        str.shrink_to_fit();
+        if (before > str.capacity())
+            reclaimed += before - str.capacity();
+    }
+    return reclaimed;
+}
+
+#if defined(CPPTOML_TRACK_ACCESS)
+CPPTOML_INLINE void table::carry_access(const base& from, const base& to)
+{
+    to.access_count_.store(from.access_count(), std::memory_order_relaxed);
+    if (from.is_table())
+    {
+        const auto& dest = static_cast<const table&>(to).map_;
+        for (const auto& pr : static_cast<const table&>(from).map_)
+            carry_access(*pr.second, *dest.at(pr.first));
+    }
+    else if (from.is_array())
+    {
+        const auto& src = static_cast<const array&>(from).get();
+        const auto& dest = static_cast<const array&>(to).get();
+        for (std::size_t i = 0; i < src.size(); ++i)
+            carry_access(*src[i], *dest[i]);
+    }
+    else if (from.is_table_array())
+    {
+        // the clone has the same rows, compact or not, as the original
+        const auto& src = static_cast<const table_array&>(from);
+        const auto& dest = static_cast<const table_array&>(to);
+        std::lock_guard<std::mutex> lock{src.mutex_};
+        for (std::size_t i = 0; i < src.array_.size(); ++i)
+            carry_access(*src.array_[i], *dest.array_[i]);
+        for (std::size_t i = 0; i < src.cells_.size(); ++i)
+            carry_access(*src.cells_[i], *dest.cells_[i]);
+    }
+}
+#endif
+#endif
+
 /**
  * Exception class for all TOML parsing errors.
  */
@@ -1621,11 +3048,43 @@ consumer<OnError> make_consumer(std::string::iterator& it,
     return consumer<OnError>(it, end, std::forward<OnError>(on_error));
 }
 
+namespace detail
+{
+/**
+ * A read-only stream buffer over a range of memory owned by the caller.
+ */
+class memory_streambuf : public std::streambuf
+{
+  public:
+    void reset(char* begin, char* end)
+    {
+        setg(begin, begin, end);
+    }
+};
+}
+
 // replacement for std::getline to handle incorrectly line-ended files
 // https://stackoverflow.com/questions/6089231/getting-std-ifstream-to-handle-lf-cr-and-crlf
 namespace detail
 {
-inline std::istream& getline(std::istream& input, std::string& line)
+//
+// at most max_len characters are stored; if the line is longer than that,
+// reading stops early and the rest of the line is left in the stream
+CPPTOML_INLINE std::istream&
+getline(std::istream& input, std::string& line,
+        std::size_t max_len = std::numeric_limits<std::size_t>::max());
+
+/**
+ * Determines whether the given buffer is well-formed UTF-8: no stray
+ * continuation bytes, overlong encodings, surrogates, or code points
+ * beyond U+10FFFF. Runs of ASCII are skipped a block at a time (16 bytes
+ * with SSE2, 8 bytes otherwise) so that plain-ASCII input is cheap.
+ */
+CPPTOML_INLINE bool is_valid_utf8(const char* str, std::size_t len);
+
+#if CPPTOML_DEFINE_OUT_OF_LINE
+CPPTOML_INLINE std::istream& getline(std::istream& input, std::string& line,
+                                     std::size_t max_len)
 {
     line.clear();
 
@@ -1652,1627 +3111,7631 @@ inline std::istream& getline(std::istream& input, std::string& line)
         }
 
         line.push_back(static_cast<char>(c));
+        if (line.size() >= max_len)
+            return input;
     }
 }
-}
 
-/**
- * The parser class.
- */
-class parser
+CPPTOML_INLINE bool is_valid_utf8(const char* str, std::size_t len)
 {
-  public:
-    /**
-     * Parsers are constructed from streams.
-     */
-    parser(std::istream& stream) : input_(stream)
+    auto s = reinterpret_cast<const unsigned char*>(str);
+    std::size_t i = 0;
+    while (i < len)
     {
-        // nothing
-    }
-
-    parser& operator=(const parser& parser) = delete;
+#if defined(CPPTOML_HAS_SSE2)
+        while (len - i >= 16)
+        {
+            auto chunk
+                = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+            if (_mm_movemask_epi8(chunk) != 0)
+                break;
+            i += 16;
+        }
+#endif
+        while (len - i >= 8)
+        {
+            uint64_t chunk;
+            std::memcpy(&chunk, s + i, sizeof(chunk));
+            if (chunk & 0x8080808080808080ull)
+                break;
+            i += 8;
+        }
 
-    /**
-     * Parses the stream this parser was created on until EOF.
-     * @throw parse_exception if there are errors in parsing
-     */
-    std::shared_ptr<table> parse()
-    {
-        std::shared_ptr<table> root = make_table();
+        if (i == len)
+            break;
 
-        table* curr_table = root.get();
+        auto c = s[i];
+        if (c < 0x80)
+        {
+            ++i;
+            continue;
+        }
 
-        while (detail::getline(input_, line_))
+        // See Table 3-7 of the Unicode standard: the first continuation
+        // byte has a narrower range for some lead bytes
+        std::size_t trailing;
+        unsigned char lo = 0x80;
+        unsigned char hi = 0xbf;
+        if (c >= 0xc2 && c <= 0xdf)
         {
-            line_number_++;
-            auto it = line_.begin();
-            auto end = line_.end();
-            consume_whitespace(it, end);
-            if (it == end || *it == '#')
-                continue;
-            if (*it == '[')
-            {
-                curr_table = root.get();
-                parse_table(it, end, curr_table);
-            }
-            else
-            {
-                parse_key_value(it, end, curr_table);
-                consume_whitespace(it, end);
-                eol_or_comment(it, end);
-            }
+            trailing = 1;
+        }
+        else if (c >= 0xe0 && c <= 0xef)
+        {
+            trailing = 2;
+            if (c == 0xe0)
+                lo = 0xa0;
+            else if (c == 0xed)
+                hi = 0x9f;
+        }
+        else if (c >= 0xf0 && c <= 0xf4)
+        {
+            trailing = 3;
+            if (c == 0xf0)
+                lo = 0x90;
+            else if (c == 0xf4)
+                hi = 0x8f;
         }
-        return root;
-    }
-
-  private:
-#if defined _MSC_VER
-    __declspec(noreturn)
-#elif defined __GNUC__
-    __attribute__((noreturn))
-#endif
-        void throw_parse_exception(const std::string& err)
-    {
-        throw parse_exception{err, line_number_};
-    }
-
-    void parse_table(std::string::iterator& it,
-                     const std::string::iterator& end, table*& curr_table)
-    {
-        // remove the beginning keytable marker
-        ++it;
-        if (it == end)
-            throw_parse_exception("Unexpected end of table");
-        if (*it == '[')
-            parse_table_array(it, end, curr_table);
         else
-            parse_single_table(it, end, curr_table);
-    }
-
-    void parse_single_table(std::string::iterator& it,
-                            const std::string::iterator& end,
-                            table*& curr_table)
-    {
-        if (it == end || *it == ']')
-            throw_parse_exception("Table name cannot be empty");
-
-        std::string full_table_name;
-        bool inserted = false;
-        while (it != end && *it != ']')
         {
-            auto part = parse_key(it, end,
-                                  [](char c) { return c == '.' || c == ']'; });
+            return false;
+        }
 
-            if (part.empty())
-                throw_parse_exception("Empty component of table name");
+        if (len - i <= trailing)
+            return false;
 
-            if (!full_table_name.empty())
-                full_table_name += ".";
-            full_table_name += part;
+        if (s[i + 1] < lo || s[i + 1] > hi)
+            return false;
 
-            if (curr_table->contains(part))
-            {
-                auto b = curr_table->get(part);
-                if (b->is_table())
-                    curr_table = static_cast<table*>(b.get());
-                else if (b->is_table_array())
-                    curr_table = std::static_pointer_cast<table_array>(b)
-                                     ->get()
-                                     .back()
-                                     .get();
-                else
-                    throw_parse_exception("Key " + full_table_name
-                                          + "already exists as a value");
-            }
-            else
-            {
-                inserted = true;
-                curr_table->insert(part, make_table());
-                curr_table = static_cast<table*>(curr_table->get(part).get());
-            }
-            consume_whitespace(it, end);
-            if (it != end && *it == '.')
-                ++it;
-            consume_whitespace(it, end);
+        for (std::size_t j = 2; j <= trailing; ++j)
+        {
+            if ((s[i + j] & 0xc0) != 0x80)
+                return false;
         }
 
-        if (it == end)
-            throw_parse_exception(
-                "Unterminated table declaration; did you forget a ']'?");
+        i += trailing + 1;
+    }
+    return true;
+}
+#endif
+}
 
-        // table already existed
-        if (!inserted)
-        {
-            auto is_value
-                = [](const std::pair<const std::string&,
-                                     const std::shared_ptr<base>&>& p) {
-                      return p.second->is_value();
-                  };
+/**
+ * Limits on the documents a parser will accept, for use with untrusted
+ * input. Each limit is checked as the document is read, so input that
+ * exceeds one is rejected with a parse_exception before it is fully
+ * consumed. All limits except max_nesting_depth are unbounded by default.
+ */
+struct parse_limits
+{
+    /// Maximum number of bytes read, counting one byte per line break.
+    std::size_t max_input_bytes = std::numeric_limits<std::size_t>::max();
 
-            // if there are any values, we can't add values to this table
-            // since it has already been defined. If there aren't any
-            // values, then it was implicitly created by something like
-            // [a.b]
-            if (curr_table->empty() || std::any_of(curr_table->begin(),
-                                                   curr_table->end(), is_value))
-            {
-                throw_parse_exception("Redefinition of table "
-                                      + full_table_name);
-            }
-        }
+    /// Maximum length in bytes of a (decoded) string value or quoted key.
+    std::size_t max_string_length = std::numeric_limits<std::size_t>::max();
 
-        ++it;
-        consume_whitespace(it, end);
-        eol_or_comment(it, end);
-    }
+    /// Maximum number of elements in an array or table array.
+    std::size_t max_array_elements = std::numeric_limits<std::size_t>::max();
 
-    void parse_table_array(std::string::iterator& it,
-                           const std::string::iterator& end, table*& curr_table)
-    {
-        ++it;
-        if (it == end || *it == ']')
-            throw_parse_exception("Table array name cannot be empty");
+    /// Maximum number of keys in a single table.
+    std::size_t max_table_keys = std::numeric_limits<std::size_t>::max();
 
-        std::string full_ta_name;
-        while (it != end && *it != ']')
-        {
-            auto part = parse_key(it, end,
-                                  [](char c) { return c == '.' || c == ']'; });
+    /// Maximum depth to which arrays and inline tables may be nested
+    /// inside a single value.
+    std::size_t max_nesting_depth = 1024;
 
-            if (part.empty())
-                throw_parse_exception("Empty component of table array name");
+    /// Maximum number of nodes (values, arrays, tables and table arrays)
+    /// in the document, not counting the root table.
+    std::size_t max_nodes = std::numeric_limits<std::size_t>::max();
+};
 
-            if (!full_ta_name.empty())
-                full_ta_name += ".";
-            full_ta_name += part;
+namespace detail
+{
+/**
+ * Where a check is in the document: a chain of links on the stack, one
+ * per key or array index, that is only turned into a dotted path for an
+ * error message. Used by schema checks in the parser and by decoders
+ * generated by cpptoml-codegen.
+ */
+struct decode_path
+{
+    const decode_path* parent;
+    // the key of a table member, or nullptr for an array element
+    const char* key;
+    std::size_t index;
 
-            consume_whitespace(it, end);
-            if (it != end && *it == '.')
-                ++it;
-            consume_whitespace(it, end);
+    std::string str() const
+    {
+        std::vector<const decode_path*> links;
+        for (auto p = this; p && p->parent; p = p->parent)
+            links.push_back(p);
 
-            if (curr_table->contains(part))
+        std::string path;
+        for (auto it = links.rbegin(); it != links.rend(); ++it)
+        {
+            if ((*it)->key)
             {
-                auto b = curr_table->get(part);
-
-                // if this is the end of the table array name, add an
-                // element to the table array that we just looked up
-                if (it != end && *it == ']')
-                {
-                    if (!b->is_table_array())
-                        throw_parse_exception("Key " + full_ta_name
-                                              + " is not a table array");
-                    auto v = b->as_table_array();
-                    v->get().push_back(make_table());
-                    curr_table = v->get().back().get();
-                }
-                // otherwise, just keep traversing down the key name
-                else
-                {
-                    if (b->is_table())
-                        curr_table = static_cast<table*>(b.get());
-                    else if (b->is_table_array())
-                        curr_table = std::static_pointer_cast<table_array>(b)
-                                         ->get()
-                                         .back()
-                                         .get();
-                    else
-                        throw_parse_exception("Key " + full_ta_name
-                                              + " already exists as a value");
-                }
+                if (!path.empty())
+                    path += '.';
+                path += (*it)->key;
             }
             else
             {
-                // if this is the end of the table array name, add a new
-                // table array and a new table inside that array for us to
-                // add keys to next
-                if (it != end && *it == ']')
-                {
-                    curr_table->insert(part, make_table_array());
-                    auto arr = std::static_pointer_cast<table_array>(
-                        curr_table->get(part));
-                    arr->get().push_back(make_table());
-                    curr_table = arr->get().back().get();
-                }
-                // otherwise, create the implicitly defined table and move
-                // down to it
-                else
-                {
-                    curr_table->insert(part, make_table());
-                    curr_table
-                        = static_cast<table*>(curr_table->get(part).get());
-                }
+                path += "[" + std::to_string((*it)->index) + "]";
             }
         }
+        return path;
+    }
+};
+}
 
-        // consume the last "]]"
-        if (it == end)
-            throw_parse_exception("Unterminated table array name");
-        ++it;
-        if (it == end)
-            throw_parse_exception("Unterminated table array name");
-        ++it;
+/**
+ * A compiled description of the documents a parser should accept, which
+ * the parser checks each key and value against as it inserts them (see
+ * parser::schema()), so that a document that does not match is rejected
+ * with the line of the offending key rather than by a second pass over
+ * the parsed tables.
+ *
+ * Schemas are compiled by make_schema() from a TOML document with the
+ * shape of the documents it describes and the name of a type in place
+ * of each value: string, int64, double, bool, local_date, local_time,
+ * local_datetime or offset_datetime, in brackets for an array of them
+ * (as in "[int64]"), and followed by '?' if the key is optional. A value
+ * may instead be a table of constraints with the type under "type":
+ *
+ *     port = { type = "int64", min = 1, max = 65535 }
+ *     level = { type = "string?", enum = ["debug", "info"] }
+ *     hosts = { type = "[string]", min_length = 1, max_length = 8 }
+ *
+ * min, max and enum constrain the scalars (the elements of an array),
+ * while min_length and max_length constrain the number of elements of an
+ * array or the bytes of a string. A table describes a table, which is
+ * required if any of its keys are, and an array of tables with a single
+ * table describes an array of tables, which is optional. Keys that are
+ * not in the schema are rejected. (To describe a table with a key named
+ * "type", give that key as a table of constraints.)
+ *
+ * A compiled schema is immutable and may be shared by any number of
+ * parsers on any number of threads.
+ */
+class schema
+{
+  public:
+    /**
+     * Compiles a schema from its description.
+     * @throw std::invalid_argument if the description is not a valid
+     * schema
+     */
+    explicit schema(const table& description);
 
-        consume_whitespace(it, end);
-        eol_or_comment(it, end);
-    }
+  private:
+    template <class>
+    friend class basic_parser;
 
-    void parse_key_value(std::string::iterator& it, std::string::iterator& end,
-                         table* curr_table)
+    enum class kind
     {
-        auto key = parse_key(it, end, [](char c) { return c == '='; });
-        if (curr_table->contains(key))
-            throw_parse_exception("Key " + key + " already present");
-        if (it == end || *it != '=')
-            throw_parse_exception("Value must follow after a '='");
-        ++it;
-        consume_whitespace(it, end);
-        curr_table->insert(key, parse_value(it, end));
-        consume_whitespace(it, end);
-    }
+        TABLE,
+        TABLE_ARRAY,
+        ARRAY,
+        STRING,
+        INTEGER,
+        FLOAT,
+        BOOLEAN,
+        LOCAL_DATE,
+        LOCAL_TIME,
+        LOCAL_DATETIME,
+        OFFSET_DATETIME
+    };
 
-    template <class Function>
-    std::string parse_key(std::string::iterator& it,
-                          const std::string::iterator& end, Function&& fun)
+    struct node
+    {
+        kind type;
+        bool required = true;
+        // the node of the elements of an array or table array
+        std::size_t element = 0;
+        std::size_t min_length = 0;
+        std::size_t max_length = std::numeric_limits<std::size_t>::max();
+        int64_t int_min = std::numeric_limits<int64_t>::min();
+        int64_t int_max = std::numeric_limits<int64_t>::max();
+        double float_min = -std::numeric_limits<double>::infinity();
+        double float_max = std::numeric_limits<double>::infinity();
+        // the values allowed by an enum, sorted
+        std::vector<std::string> strings;
+        std::vector<int64_t> integers;
+        // the keys of a table, and the ones that are required
+        std::unordered_map<std::string, std::size_t> members;
+        std::vector<std::string> required_members;
+    };
+
+    static const std::size_t npos = static_cast<std::size_t>(-1);
+
+    std::size_t compile_table(const table& t, const std::string& path);
+
+    std::size_t compile_member(const base& b, const std::string& path);
+
+    std::size_t compile_type(const std::string& name, const table* spec,
+                             const std::string& path);
+
+    void compile_constraints(std::size_t scalar, std::size_t outer,
+                             const table& spec, const std::string& path);
+
+    /**
+     * The node of the given key in a table node, or npos if the table has
+     * no such key.
+     */
+    std::size_t member(std::size_t table_node, const std::string& key) const
     {
-        consume_whitespace(it, end);
-        if (*it == '"')
-        {
-            return parse_quoted_key(it, end);
-        }
-        else
-        {
-            auto bke = std::find_if(it, end, std::forward<Function>(fun));
-            return parse_bare_key(it, bke);
-        }
+        const auto& members = nodes_[table_node].members;
+        auto it = members.find(key);
+        return it == members.end() ? npos : it->second;
     }
 
-    std::string parse_bare_key(std::string::iterator& it,
-                               const std::string::iterator& end)
-    {
-        if (it == end)
-        {
-            throw_parse_exception("Bare key missing name");
-        }
+    /**
+     * Checks a value (and everything in it) against a node.
+     * @throw parse_exception, at the given line, if it does not match
+     */
+    void check(std::size_t n, const base& b, const detail::decode_path& path,
+               std::size_t line) const;
 
-        auto key_end = end;
-        --key_end;
-        consume_backwards_whitespace(key_end, it);
-        ++key_end;
-        std::string key{it, key_end};
+    /**
+     * Checks that a table has all of the required keys of a table node.
+     * @throw parse_exception, at the given line, if it does not
+     */
+    void check_required(std::size_t n, const table& t,
+                        const std::string& path, std::size_t line) const;
 
-        if (std::find(it, key_end, '#') != key_end)
-        {
-            throw_parse_exception("Bare key " + key + " cannot contain #");
-        }
+    /**
+     * How an error message names what a node accepts, as in "an integer".
+     */
+    std::string describe(std::size_t n) const;
 
-        if (std::find_if(it, key_end,
-                         [](char c) { return c == ' ' || c == '\t'; })
-            != key_end)
-        {
-            throw_parse_exception("Bare key " + key
-                                  + " cannot contain whitespace");
-        }
+#if defined _MSC_VER
+    __declspec(noreturn)
+#elif defined __GNUC__
+    __attribute__((noreturn))
+#endif
+        static void fail(const std::string& err, std::size_t line);
+
+    std::vector<node> nodes_;
+};
 
-        if (std::find_if(it, key_end,
-                         [](char c) { return c == '[' || c == ']'; })
-            != key_end)
+/**
+ * Compiles a schema from its description, for use by any number of
+ * parsers.
+ * @throw std::invalid_argument if the description is not a valid schema
+ */
+inline std::shared_ptr<const schema> make_schema(const table& description)
+{
+    return std::make_shared<const schema>(description);
+}
+
+#if CPPTOML_DEFINE_OUT_OF_LINE
+CPPTOML_INLINE schema::schema(const table& description)
+{
+    compile_table(description, "");
+}
+
+CPPTOML_INLINE std::size_t schema::compile_table(const table& t,
+                                                 const std::string& path)
+{
+    auto n = nodes_.size();
+    nodes_.emplace_back();
+    nodes_[n].type = kind::TABLE;
+    nodes_[n].required = false;
+
+    for (const auto& entry : t)
+    {
+        auto key_path = path.empty() ? entry.first : path + "." + entry.first;
+        auto m = compile_member(*entry.second, key_path);
+        nodes_[n].members.emplace(entry.first, m);
+        if (nodes_[m].required)
         {
-            throw_parse_exception("Bare key " + key
-                                  + " cannot contain '[' or ']'");
+            nodes_[n].required_members.push_back(entry.first);
+            nodes_[n].required = true;
         }
-
-        it = end;
-        return key;
     }
+    return n;
+}
 
-    std::string parse_quoted_key(std::string::iterator& it,
-                                 const std::string::iterator& end)
+CPPTOML_INLINE std::size_t schema::compile_member(const base& b,
+                                                  const std::string& path)
+{
+    if (auto name = b.as<std::string>())
+        return compile_type(name->get(), nullptr, path);
+
+    if (b.is_table())
     {
-        return string_literal(it, end, '"');
+        const auto& t = static_cast<const table&>(b);
+        if (auto name = t.get_as<std::string>("type"))
+            return compile_type(*name, &t, path);
+        return compile_table(t, path);
     }
 
-    enum class parse_type
+    if (b.is_table_array())
     {
-        STRING = 1,
-        LOCAL_TIME,
-        LOCAL_DATE,
-        LOCAL_DATETIME,
-        OFFSET_DATETIME,
-        INT,
-        FLOAT,
-        BOOL,
-        ARRAY,
-        INLINE_TABLE
-    };
-
-    std::shared_ptr<base> parse_value(std::string::iterator& it,
-                                      std::string::iterator& end)
-    {
-        parse_type type = determine_value_type(it, end);
-        switch (type)
-        {
-            case parse_type::STRING:
-                return parse_string(it, end);
-            case parse_type::LOCAL_TIME:
-                return parse_time(it, end);
-            case parse_type::LOCAL_DATE:
-            case parse_type::LOCAL_DATETIME:
-            case parse_type::OFFSET_DATETIME:
-                return parse_date(it, end);
-            case parse_type::INT:
-            case parse_type::FLOAT:
-                return parse_number(it, end);
-            case parse_type::BOOL:
-                return parse_bool(it, end);
-            case parse_type::ARRAY:
-                return parse_array(it, end);
-            case parse_type::INLINE_TABLE:
-                return parse_inline_table(it, end);
-            default:
-                throw_parse_exception("Failed to parse value");
-        }
+        const auto& tables = static_cast<const table_array&>(b).get();
+        if (tables.size() != 1)
+            throw std::invalid_argument{"Schema table array " + path
+                                        + " must be described by one table"};
+        auto elem = compile_table(*tables.front(), path);
+        auto n = nodes_.size();
+        nodes_.emplace_back();
+        nodes_[n].type = kind::TABLE_ARRAY;
+        nodes_[n].required = false;
+        nodes_[n].element = elem;
+        return n;
     }
 
-    parse_type determine_value_type(const std::string::iterator& it,
-                                    const std::string::iterator& end)
+    throw std::invalid_argument{"Schema key " + path
+                                + " must name a type or be a table"};
+}
+
+CPPTOML_INLINE std::size_t schema::compile_type(const std::string& name,
+                                                const table* spec,
+                                                const std::string& path)
+{
+    auto type = name;
+    bool optional = !type.empty() && type.back() == '?';
+    if (optional)
+        type.pop_back();
+    if (spec)
+    {
+        if (auto opt = spec->get_as<bool>("optional"))
+            optional = optional || *opt;
+    }
+
+    std::size_t depth = 0;
+    while (depth < type.size() / 2 && type[depth] == '['
+           && type[type.size() - 1 - depth] == ']')
+        ++depth;
+    type = type.substr(depth, type.size() - 2 * depth);
+
+    static const std::pair<const char*, kind> kinds[]
+        = {{"string", kind::STRING},
+           {"int64", kind::INTEGER},
+           {"double", kind::FLOAT},
+           {"bool", kind::BOOLEAN},
+           {"local_date", kind::LOCAL_DATE},
+           {"local_time", kind::LOCAL_TIME},
+           {"local_datetime", kind::LOCAL_DATETIME},
+           {"offset_datetime", kind::OFFSET_DATETIME}};
+
+    auto k = std::find_if(std::begin(kinds), std::end(kinds),
+                          [&](const std::pair<const char*, kind>& p) {
+                              return type == p.first;
+                          });
+    if (k == std::end(kinds))
+        throw std::invalid_argument{"Unknown type \"" + name
+                                    + "\" for schema key " + path};
+
+    auto scalar = nodes_.size();
+    nodes_.emplace_back();
+    nodes_[scalar].type = k->second;
+
+    auto outer = scalar;
+    for (std::size_t i = 0; i < depth; ++i)
+    {
+        auto n = nodes_.size();
+        nodes_.emplace_back();
+        nodes_[n].type = kind::ARRAY;
+        nodes_[n].element = outer;
+        outer = n;
+    }
+    nodes_[outer].required = !optional;
+
+    if (spec)
+        compile_constraints(scalar, outer, *spec, path);
+    return outer;
+}
+
+CPPTOML_INLINE void schema::compile_constraints(std::size_t scalar,
+                                                std::size_t outer,
+                                                const table& spec,
+                                                const std::string& path)
+{
+    auto invalid = [&](const std::string& what) {
+        return std::invalid_argument{"Schema key " + path + ": " + what};
+    };
+
+    auto& s = nodes_[scalar];
+    auto& o = nodes_[outer];
+    for (const auto& entry : spec)
     {
-        if(it == end)
-        {
-            throw_parse_exception("Failed to parse value type");
-        }
-        if (*it == '"' || *it == '\'')
+        const auto& key = entry.first;
+        const auto& b = *entry.second;
+        if (key == "type" || key == "optional")
         {
-            return parse_type::STRING;
+            if (key == "optional" && !b.as<bool>())
+                throw invalid("optional must be a boolean");
         }
-        else if (is_time(it, end))
+        else if (key == "min" || key == "max")
         {
-            return parse_type::LOCAL_TIME;
+            bool is_min = key == "min";
+            auto i = b.as<int64_t>();
+            if (s.type == kind::INTEGER && i)
+            {
+                (is_min ? s.int_min : s.int_max) = i->get();
+            }
+            else if (s.type == kind::FLOAT && b.as<double>())
+            {
+                (is_min ? s.float_min : s.float_max) = b.as<double>()->get();
+            }
+            else
+            {
+                throw invalid(key + " must be a number of the key's type");
+            }
         }
-        else if (auto dtype = date_type(it, end))
+        else if (key == "min_length" || key == "max_length")
         {
-            return *dtype;
+            auto i = b.as<int64_t>();
+            if (!i || i->get() < 0)
+                throw invalid(key + " must be a non-negative integer");
+            if (o.type != kind::STRING && o.type != kind::ARRAY)
+                throw invalid(key + " only applies to strings and arrays");
+            (key == "min_length" ? o.min_length : o.max_length)
+                = static_cast<std::size_t>(i->get());
         }
-        else if (is_number(*it) || *it == '-' || *it == '+')
+        else if (key == "enum")
         {
-            return determine_number_type(it, end);
+            if (!b.is_array())
+                throw invalid("enum must be an array");
+            for (const auto& elem : static_cast<const array&>(b).get())
+            {
+                if (s.type == kind::STRING && elem->as<std::string>())
+                    s.strings.push_back(elem->as<std::string>()->get());
+                else if (s.type == kind::INTEGER && elem->as<int64_t>())
+                    s.integers.push_back(elem->as<int64_t>()->get());
+                else
+                    throw invalid("enum must hold values of the key's "
+                                  "type, which must be string or int64");
+            }
+            std::sort(s.strings.begin(), s.strings.end());
+            std::sort(s.integers.begin(), s.integers.end());
         }
-        else if (*it == 't' || *it == 'f')
+        else
         {
-            return parse_type::BOOL;
+            throw invalid("unknown constraint " + key);
         }
-        else if (*it == '[')
+    }
+}
+
+CPPTOML_INLINE void schema::check(std::size_t n, const base& b,
+                                  const detail::decode_path& path,
+                                  std::size_t line) const
+{
+    const auto& nd = nodes_[n];
+    auto must = [&](const std::string& what) {
+        return "Key " + path.str() + " must " + what;
+    };
+
+    auto check_length = [&](std::size_t length, const char* unit) {
+        if (length < nd.min_length)
+            fail(must("have at least " + std::to_string(nd.min_length) + " "
+                      + unit),
+                 line);
+        if (length > nd.max_length)
+            fail(must("have at most " + std::to_string(nd.max_length) + " "
+                      + unit),
+                 line);
+    };
+
+    switch (nd.type)
+    {
+        case kind::TABLE:
         {
-            return parse_type::ARRAY;
+            if (!b.is_table())
+                fail(must("be " + describe(n)), line);
+            const auto& t = static_cast<const table&>(b);
+            for (const auto& entry : t)
+            {
+                detail::decode_path at{&path, entry.first.c_str(), 0};
+                auto m = member(n, entry.first);
+                if (m == npos)
+                    fail("Unknown key " + at.str(), line);
+                check(m, *entry.second, at, line);
+            }
+            check_required(n, t, path.str(), line);
+            break;
         }
-        else if (*it == '{')
+
+        case kind::TABLE_ARRAY:
         {
-            return parse_type::INLINE_TABLE;
+            if (!b.is_table_array())
+                fail(must("be " + describe(n)), line);
+            const auto& tables = static_cast<const table_array&>(b).get();
+            for (std::size_t i = 0; i < tables.size(); ++i)
+                check(nd.element, *tables[i], {&path, nullptr, i}, line);
+            break;
         }
-        throw_parse_exception("Failed to parse value type");
-    }
 
-    parse_type determine_number_type(const std::string::iterator& it,
-                                     const std::string::iterator& end)
-    {
-        // determine if we are an integer or a float
-        auto check_it = it;
-        if (*check_it == '-' || *check_it == '+')
-            ++check_it;
-        while (check_it != end && is_number(*check_it))
-            ++check_it;
-        if (check_it != end && *check_it == '.')
+        case kind::ARRAY:
         {
-            ++check_it;
-            while (check_it != end && is_number(*check_it))
-                ++check_it;
-            return parse_type::FLOAT;
+            if (!b.is_array())
+                fail(must("be " + describe(n)), line);
+            const auto& elems = static_cast<const array&>(b).get();
+            check_length(elems.size(), "elements");
+            for (std::size_t i = 0; i < elems.size(); ++i)
+                check(nd.element, *elems[i], {&path, nullptr, i}, line);
+            break;
         }
-        else
+
+        case kind::STRING:
         {
-            return parse_type::INT;
+            auto v = dynamic_cast<const value<std::string>*>(&b);
+            if (!v)
+                fail(must("be " + describe(n)), line);
+            check_length(v->get().size(), "bytes");
+            if (!nd.strings.empty()
+                && !std::binary_search(nd.strings.begin(), nd.strings.end(),
+                                       v->get()))
+            {
+                std::string allowed;
+                for (const auto& str : nd.strings)
+                    allowed += (allowed.empty() ? "\"" : ", \"") + str + "\"";
+                fail(must("be one of " + allowed), line);
+            }
+            break;
         }
-    }
-
-    std::shared_ptr<value<std::string>> parse_string(std::string::iterator& it,
-                                                     std::string::iterator& end)
-    {
-        auto delim = *it;
-        assert(delim == '"' || delim == '\'');
 
-        // end is non-const here because we have to be able to potentially
-        // parse multiple lines in a string, not just one
-        auto check_it = it;
-        ++check_it;
-        if (check_it != end && *check_it == delim)
+        case kind::INTEGER:
         {
-            ++check_it;
-            if (check_it != end && *check_it == delim)
+            auto v = dynamic_cast<const value<int64_t>*>(&b);
+            if (!v)
+                fail(must("be " + describe(n)), line);
+            auto i = v->get();
+            if (i < nd.int_min)
+                fail(must("be at least " + std::to_string(nd.int_min)), line);
+            if (i > nd.int_max)
+                fail(must("be at most " + std::to_string(nd.int_max)), line);
+            if (!nd.integers.empty()
+                && !std::binary_search(nd.integers.begin(),
+                                       nd.integers.end(), i))
             {
-                it = ++check_it;
-                return parse_multiline_string(it, end, delim);
+                std::string allowed;
+                for (auto allowed_int : nd.integers)
+                    allowed += (allowed.empty() ? "" : ", ")
+                               + std::to_string(allowed_int);
+                fail(must("be one of " + allowed), line);
             }
+            break;
         }
-        return make_value<std::string>(string_literal(it, end, delim));
-    }
 
-    std::shared_ptr<value<std::string>>
-    parse_multiline_string(std::string::iterator& it,
-                           std::string::iterator& end, char delim)
-    {
-        std::stringstream ss;
+        case kind::FLOAT:
+        {
+            // integers are accepted as floats, as with base::as<double>()
+            double d = 0;
+            if (auto i = dynamic_cast<const value<int64_t>*>(&b))
+                d = static_cast<double>(i->get());
+            else if (auto v = dynamic_cast<const value<double>*>(&b))
+                d = v->get();
+            else
+                fail(must("be " + describe(n)), line);
 
-        auto is_ws = [](char c) { return c == ' ' || c == '\t'; };
+            auto bound = [](double x) {
+                std::ostringstream out;
+                out << x;
+                return out.str();
+            };
+            // written so that NaN is out of any range
+            if (!(d >= nd.float_min))
+                fail(must("be at least " + bound(nd.float_min)), line);
+            if (!(d <= nd.float_max))
+                fail(must("be at most " + bound(nd.float_max)), line);
+            break;
+        }
 
-        bool consuming = false;
-        std::shared_ptr<value<std::string>> ret;
+        case kind::BOOLEAN:
+            if (!dynamic_cast<const value<bool>*>(&b))
+                fail(must("be " + describe(n)), line);
+            break;
 
-        auto handle_line
-            = [&](std::string::iterator& it, std::string::iterator& end) {
-                  if (consuming)
-                  {
-                      it = std::find_if_not(it, end, is_ws);
+        case kind::LOCAL_DATE:
+            if (!dynamic_cast<const value<local_date>*>(&b))
+                fail(must("be " + describe(n)), line);
+            break;
 
-                      // whole line is whitespace
-                      if (it == end)
-                          return;
-                  }
+        case kind::LOCAL_TIME:
+            if (!dynamic_cast<const value<local_time>*>(&b))
+                fail(must("be " + describe(n)), line);
+            break;
 
-                  consuming = false;
+        case kind::LOCAL_DATETIME:
+            if (!dynamic_cast<const value<local_datetime>*>(&b))
+                fail(must("be " + describe(n)), line);
+            break;
 
-                  while (it != end)
-                  {
-                      // handle escaped characters
-                      if (delim == '"' && *it == '\\')
-                      {
-                          auto check = it;
-                          // check if this is an actual escape sequence or a
-                          // whitespace escaping backslash
-                          ++check;
-                          consume_whitespace(check, end);
-                          if (check == end)
-                          {
-                              consuming = true;
-                              break;
-                          }
-
-                          ss << parse_escape_code(it, end);
-                          continue;
-                      }
+        case kind::OFFSET_DATETIME:
+            if (!dynamic_cast<const value<offset_datetime>*>(&b))
+                fail(must("be " + describe(n)), line);
+            break;
+    }
+}
 
-                      // if we can end the string
-                      if (std::distance(it, end) >= 3)
-                      {
-                          auto check = it;
-                          // check for """
-                          if (*check++ == delim && *check++ == delim
-                              && *check++ == delim)
-                          {
-                              it = check;
-                              ret = make_value<std::string>(ss.str());
-                              break;
-                          }
-                      }
+CPPTOML_INLINE void schema::check_required(std::size_t n, const table& t,
+                                           const std::string& path,
+                                           std::size_t line) const
+{
+    for (const auto& key : nodes_[n].required_members)
+    {
+        if (!t.contains(key))
+            fail("Missing required key "
+                     + (path.empty() ? key : path + "." + key),
+                 line);
+    }
+}
 
-                      ss << *it++;
-                  }
-              };
+CPPTOML_INLINE std::string schema::describe(std::size_t n) const
+{
+    switch (nodes_[n].type)
+    {
+        case kind::TABLE:
+            return "a table";
+        case kind::TABLE_ARRAY:
+            return "an array of tables";
+        case kind::ARRAY:
+            return "an array";
+        case kind::STRING:
+            return "a string";
+        case kind::INTEGER:
+            return "an integer";
+        case kind::FLOAT:
+            return "a float";
+        case kind::BOOLEAN:
+            return "a boolean";
+        case kind::LOCAL_DATE:
+            return "a local date";
+        case kind::LOCAL_TIME:
+            return "a local time";
+        case kind::LOCAL_DATETIME:
+            return "a local date-time";
+        case kind::OFFSET_DATETIME:
+            return "an offset date-time";
+    }
+    return "";
+}
 
-        // handle the remainder of the current line
-        handle_line(it, end);
-        if (ret)
-            return ret;
+CPPTOML_INLINE void schema::fail(const std::string& err, std::size_t line)
+{
+    if (line == 0)
+        throw parse_exception{err};
+    throw parse_exception{err, line};
+}
+#endif
 
-        // start eating lines
-        while (detail::getline(input_, line_))
-        {
-            ++line_number_;
+#if defined(CPPTOML_PROFILE_STAGES)
+/**
+ * The stages of parsing reported to a stage_observer when
+ * CPPTOML_PROFILE_STAGES is defined.
+ */
+enum class parse_stage
+{
+    LINE,       ///< reading and validating a line of input
+    WHITESPACE, ///< skipping whitespace and comments
+    KEY,        ///< parsing a key and finding its slot in the table
+    STRING,     ///< parsing a string value
+    NUMBER,     ///< parsing an integer or float value
+    DATE,       ///< parsing a date, time or date-time value
+    HEADER      ///< parsing a [table] or [[table array]] header
+};
 
-            it = line_.begin();
-            end = line_.end();
+/**
+ * Receives the stages of parsing entered and left by parsers on the
+ * thread it is installed on with set_stage_observer(). Stages nest: a
+ * table header, for instance, encloses the keys that name it.
+ */
+class stage_observer
+{
+  public:
+    virtual ~stage_observer() = default;
 
-            handle_line(it, end);
+    virtual void enter(parse_stage stage) = 0;
 
-            if (ret)
-                return ret;
+    virtual void leave(parse_stage stage) = 0;
+};
 
-            if (!consuming)
-                ss << std::endl;
-        }
+namespace detail
+{
+inline stage_observer*& current_stage_observer()
+{
+    static thread_local stage_observer* observer = nullptr;
+    return observer;
+}
 
-        throw_parse_exception("Unterminated multi-line basic string");
+/**
+ * Reports a stage to the current observer for the lifetime of a scope.
+ */
+class stage_scope
+{
+  public:
+    explicit stage_scope(parse_stage stage)
+        : observer_(current_stage_observer()), stage_(stage)
+    {
+        if (observer_)
+            observer_->enter(stage_);
     }
 
-    std::string string_literal(std::string::iterator& it,
-                               const std::string::iterator& end, char delim)
+    ~stage_scope()
     {
-        ++it;
-        std::string val;
-        while (it != end)
-        {
-            // handle escaped characters
-            if (delim == '"' && *it == '\\')
-            {
-                val += parse_escape_code(it, end);
-            }
-            else if (*it == delim)
-            {
-                ++it;
-                consume_whitespace(it, end);
-                return val;
-            }
-            else
-            {
-                val += *it++;
-            }
-        }
-        throw_parse_exception("Unterminated string literal");
+        if (observer_)
+            observer_->leave(stage_);
     }
 
-    std::string parse_escape_code(std::string::iterator& it,
-                                  const std::string::iterator& end)
+    stage_scope(const stage_scope&) = delete;
+    stage_scope& operator=(const stage_scope&) = delete;
+
+  private:
+    stage_observer* observer_;
+    parse_stage stage_;
+};
+}
+
+/**
+ * Installs observer to be told about the stages of every parse on the
+ * calling thread, replacing (and returning) the previous one. Passing
+ * nullptr stops reporting.
+ */
+inline stage_observer* set_stage_observer(stage_observer* observer)
+{
+    auto previous = detail::current_stage_observer();
+    detail::current_stage_observer() = observer;
+    return previous;
+}
+
+#define CPPTOML_STAGE(stage)                                                   \
+    ::cpptoml::detail::stage_scope cpptoml_stage_scope_{                       \
+        ::cpptoml::parse_stage::stage}
+#else
+#define CPPTOML_STAGE(stage)
+#endif
+
+/**
+ * Describes how consecutive documents in one stream are separated, for
+ * reading them one at a time with parser::next_document().
+ */
+class document_framing
+{
+  public:
+    /**
+     * Each document ends at a line consisting of exactly the given
+     * delimiter (such as "---"), or at the end of the stream. The
+     * delimiter must not appear as a line of its own inside a document.
+     */
+    static document_framing delimiter(std::string line)
     {
-        ++it;
-        if (it == end)
-            throw_parse_exception("Invalid escape sequence");
-        char value;
-        if (*it == 'b')
-        {
-            value = '\b';
-        }
-        else if (*it == 't')
-        {
-            value = '\t';
-        }
-        else if (*it == 'n')
-        {
-            value = '\n';
-        }
-        else if (*it == 'f')
-        {
-            value = '\f';
-        }
-        else if (*it == 'r')
-        {
-            value = '\r';
-        }
-        else if (*it == '"')
-        {
-            value = '"';
-        }
-        else if (*it == '\\')
-        {
-            value = '\\';
-        }
-        else if (*it == 'u' || *it == 'U')
-        {
-            return parse_unicode(it, end);
-        }
-        else
-        {
-            throw_parse_exception("Invalid escape sequence");
-        }
-        ++it;
-        return std::string(1, value);
+        return document_framing{std::move(line), false};
     }
 
-    std::string parse_unicode(std::string::iterator& it,
-                              const std::string::iterator& end)
+    /**
+     * Each document is preceded by a line holding its length in bytes as
+     * a decimal number. The document itself may contain any text.
+     */
+    static document_framing length_prefix()
     {
-        bool large = *it++ == 'U';
-        auto codepoint = parse_hex(it, end, large ? 0x10000000 : 0x1000);
-
-        if ((codepoint > 0xd7ff && codepoint < 0xe000) || codepoint > 0x10ffff)
-        {
-            throw_parse_exception(
-                "Unicode escape sequence is not a Unicode scalar value");
-        }
-
-        std::string result;
-        // See Table 3-6 of the Unicode standard
-        if (codepoint <= 0x7f)
-        {
-            // 1-byte codepoints: 00000000 0xxxxxxx
-            // repr: 0xxxxxxx
-            result += static_cast<char>(codepoint & 0x7f);
-        }
-        else if (codepoint <= 0x7ff)
-        {
-            // 2-byte codepoints: 00000yyy yyxxxxxx
-            // repr: 110yyyyy 10xxxxxx
-            //
-            // 0x1f = 00011111
-            // 0xc0 = 11000000
-            //
-            result += static_cast<char>(0xc0 | ((codepoint >> 6) & 0x1f));
-            //
-            // 0x80 = 10000000
-            // 0x3f = 00111111
-            //
-            result += static_cast<char>(0x80 | (codepoint & 0x3f));
-        }
-        else if (codepoint <= 0xffff)
-        {
-            // 3-byte codepoints: zzzzyyyy yyxxxxxx
-            // repr: 1110zzzz 10yyyyyy 10xxxxxx
-            //
-            // 0xe0 = 11100000
-            // 0x0f = 00001111
-            //
-            result += static_cast<char>(0xe0 | ((codepoint >> 12) & 0x0f));
-            result += static_cast<char>(0x80 | ((codepoint >> 6) & 0x1f));
-            result += static_cast<char>(0x80 | (codepoint & 0x3f));
-        }
-        else
-        {
-            // 4-byte codepoints: 000uuuuu zzzzyyyy yyxxxxxx
-            // repr: 11110uuu 10uuzzzz 10yyyyyy 10xxxxxx
-            //
-            // 0xf0 = 11110000
-            // 0x07 = 00000111
-            //
-            result += static_cast<char>(0xf0 | ((codepoint >> 18) & 0x07));
-            result += static_cast<char>(0x80 | ((codepoint >> 12) & 0x3f));
-            result += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3f));
-            result += static_cast<char>(0x80 | (codepoint & 0x3f));
-        }
-        return result;
+        return document_framing{"", true};
     }
 
-    uint32_t parse_hex(std::string::iterator& it,
-                       const std::string::iterator& end, uint32_t place)
+  private:
+    template <class>
+    friend class basic_parser;
+
+    document_framing(std::string delimiter, bool length_prefixed)
+        : delimiter_(std::move(delimiter)), length_prefixed_(length_prefixed)
     {
-        uint32_t value = 0;
-        while (place > 0)
-        {
-            if (it == end)
-                throw_parse_exception("Unexpected end of unicode sequence");
+        // nothing
+    }
 
-            if (!is_hex(*it))
-                throw_parse_exception("Invalid unicode escape sequence");
+    std::string delimiter_;
+    bool length_prefixed_;
+};
 
-            value += place * hex_to_digit(*it++);
-            place /= 16;
-        }
-        return value;
+/**
+ * The default tracing policy for basic_parser and basic_toml_writer,
+ * which ignores every event. Its hooks are empty inline functions, so a
+ * parser or writer using it compiles to the same code as one without
+ * tracing.
+ *
+ * A tracing policy is any copyable class with the same member functions.
+ * The hooks are called in nested begin/end pairs:
+ *
+ * - begin_document() and end_document() around each document parsed, or
+ *   each table written from the root;
+ * - begin_table(keys) and end_table() around each [table] or
+ *   [[table array]] section of a document, with the components of its
+ *   name (the parser reports sections in the order of their headers, the
+ *   writer each table it writes below the root);
+ * - begin_array() and end_array(size) around each array, with its number
+ *   of elements (the size is only known once the array has been read).
+ *
+ * When parsing stops with an exception, the spans still open are ended
+ * before the exception leaves the parser. Hooks must not throw.
+ */
+struct null_tracer
+{
+    void begin_document()
+    {
+        // nothing
     }
 
-    bool is_hex(char c)
+    void end_document()
     {
-        return is_number(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+        // nothing
     }
 
-    uint32_t hex_to_digit(char c)
+    void begin_table(const std::vector<std::string>&)
     {
-        if (is_number(c))
-            return static_cast<uint32_t>(c - '0');
-        return 10 + static_cast<uint32_t>(
-                        c - ((c >= 'a' && c <= 'f') ? 'a' : 'A'));
+        // nothing
     }
 
-    std::shared_ptr<base> parse_number(std::string::iterator& it,
-                                       const std::string::iterator& end)
+    void end_table()
     {
-        auto check_it = it;
-        auto check_end = find_end_of_number(it, end);
-
-        auto eat_sign = [&]() {
-            if (check_it != end && (*check_it == '-' || *check_it == '+'))
-                ++check_it;
-        };
-
-        eat_sign();
-
-        auto eat_numbers = [&]() {
-            auto beg = check_it;
-            while (check_it != end && is_number(*check_it))
-            {
-                ++check_it;
-                if (check_it != end && *check_it == '_')
-                {
-                    ++check_it;
-                    if (check_it == end || !is_number(*check_it))
-                        throw_parse_exception("Malformed number");
-                }
-            }
-
-            if (check_it == beg)
-                throw_parse_exception("Malformed number");
-        };
-
-        auto check_no_leading_zero = [&]() {
-            if (check_it != end && *check_it == '0' && check_it + 1 != check_end
-                && check_it[1] != '.')
-            {
-                throw_parse_exception("Numbers may not have leading zeros");
-            }
-        };
-
-        check_no_leading_zero();
-        eat_numbers();
+        // nothing
+    }
 
-        if (check_it != end
-            && (*check_it == '.' || *check_it == 'e' || *check_it == 'E'))
-        {
-            bool is_exp = *check_it == 'e' || *check_it == 'E';
+    void begin_array()
+    {
+        // nothing
+    }
 
-            ++check_it;
-            if (check_it == end)
-                throw_parse_exception("Floats must have trailing digits");
+    void end_array(std::size_t)
+    {
+        // nothing
+    }
+};
 
-            auto eat_exp = [&]() {
-                eat_sign();
-                check_no_leading_zero();
-                eat_numbers();
-            };
+/**
+ * The parser class, reporting what it parses to a tracing policy (see
+ * null_tracer). Most code uses the untraced cpptoml::parser.
+ */
+template <class Tracer>
+class basic_parser
+{
+  public:
+    /**
+     * Parsers are constructed from streams.
+     */
+    basic_parser(std::istream& stream,
+                 const parse_limits& limits = parse_limits{},
+                 Tracer tracer = Tracer{})
+        : stream_(&stream),
+          input_(&stream),
+          limits_(limits),
+          framing_{"", false},
+          tracer_(std::move(tracer))
+    {
+        // nothing
+    }
 
-            if (is_exp)
-                eat_exp();
-            else
-                eat_numbers();
+    /**
+     * Constructs a parser that reads a stream of several documents with
+     * next_document(). The limits apply to each document separately.
+     */
+    basic_parser(std::istream& stream, const document_framing& framing,
+                 const parse_limits& limits = parse_limits{},
+                 Tracer tracer = Tracer{})
+        : stream_(&stream),
+          input_(&stream),
+          limits_(limits),
+          framing_(framing),
+          framed_(true),
+          tracer_(std::move(tracer))
+    {
+        // nothing
+    }
 
-            if (!is_exp && check_it != end
-                && (*check_it == 'e' || *check_it == 'E'))
-            {
-                ++check_it;
-                eat_exp();
-            }
+    basic_parser& operator=(const basic_parser& parser) = delete;
 
-            return parse_float(it, check_it);
-        }
-        else
-        {
-            return parse_int(it, check_it);
-        }
+    /**
+     * Gets the tracing policy this parser reports to.
+     */
+    Tracer& tracer()
+    {
+        return tracer_;
     }
 
-    std::shared_ptr<value<int64_t>> parse_int(std::string::iterator& it,
-                                              const std::string::iterator& end)
+    /**
+     * Points the parser at a new stream, as if it had just been
+     * constructed on it. The limits, schema and framing are kept, as is the
+     * capacity of the parser's internal buffers, so a parser that is
+     * reset and reused for many small documents stops allocating for
+     * anything but the tables it returns.
+     */
+    void reset(std::istream& stream)
     {
-        std::string v{it, end};
-        v.erase(std::remove(v.begin(), v.end(), '_'), v.end());
-        it = end;
-        try
-        {
-            return make_value<int64_t>(std::stoll(v));
-        }
-        catch (const std::invalid_argument& ex)
-        {
-            throw_parse_exception("Malformed number (invalid argument: "
-                                  + std::string{ex.what()} + ")");
-        }
-        catch (const std::out_of_range& ex)
-        {
-            throw_parse_exception("Malformed number (out of range: "
-                                  + std::string{ex.what()} + ")");
-        }
+        stream_ = &stream;
+        input_ = &stream;
+        line_number_ = 0;
+        delimited_ = false;
+        in_document_ = false;
     }
 
-    std::shared_ptr<value<double>> parse_float(std::string::iterator& it,
-                                               const std::string::iterator& end)
+    /**
+     * Sets the limits on documents this parser will accept.
+     */
+    void limits(const parse_limits& limits)
     {
-        std::string v{it, end};
-        v.erase(std::remove(v.begin(), v.end(), '_'), v.end());
-        it = end;
-        try
-        {
-            return make_value<double>(std::stod(v));
-        }
-        catch (const std::invalid_argument& ex)
-        {
-            throw_parse_exception("Malformed number (invalid argument: "
-                                  + std::string{ex.what()} + ")");
-        }
-        catch (const std::out_of_range& ex)
-        {
-            throw_parse_exception("Malformed number (out of range: "
-                                  + std::string{ex.what()} + ")");
-        }
+        limits_ = limits;
     }
 
-    std::shared_ptr<value<bool>> parse_bool(std::string::iterator& it,
-                                            const std::string::iterator& end)
+    /**
+     * Gets the limits on documents this parser will accept.
+     */
+    const parse_limits& limits() const
     {
-        auto eat = make_consumer(it, end, [this]() {
-            throw_parse_exception("Attempted to parse invalid boolean value");
-        });
-
-        if (*it == 't')
-        {
-            eat("true");
-            return make_value<bool>(true);
-        }
-        else if (*it == 'f')
-        {
-            eat("false");
-            return make_value<bool>(false);
-        }
-
-        eat.error();
-        return nullptr;
+        return limits_;
     }
 
-    std::string::iterator find_end_of_number(std::string::iterator it,
-                                             std::string::iterator end)
+    /**
+     * Sets the schema that documents must match, or nullptr (the
+     * default) to accept any document. Each key is checked against the
+     * schema as it is inserted, and the required keys of each table once
+     * the table is complete, so a document that does not match is
+     * rejected with a parse_exception giving the line of the key (or of
+     * the header of the table missing one).
+     */
+    void schema(std::shared_ptr<const cpptoml::schema> s)
     {
-        return std::find_if(it, end, [](char c) {
-            return !is_number(c) && c != '_' && c != '.' && c != 'e' && c != 'E'
-                   && c != '-' && c != '+';
-        });
+        schema_ = std::move(s);
     }
 
-    std::string::iterator find_end_of_date(std::string::iterator it,
-                                           std::string::iterator end)
+    /**
+     * Gets the schema that documents must match, if any.
+     */
+    const std::shared_ptr<const cpptoml::schema>& schema() const
     {
-        return std::find_if(it, end, [](char c) {
-            return !is_number(c) && c != 'T' && c != 'Z' && c != ':' && c != '-'
-                   && c != '+' && c != '.';
-        });
+        return schema_;
     }
 
-    std::string::iterator find_end_of_time(std::string::iterator it,
-                                           std::string::iterator end)
+    /**
+     * Sets the maximum depth to which arrays and inline tables may be
+     * nested inside a single value (default 1024). Deeper input is
+     * rejected with a parse_exception.
+     */
+    void max_nesting_depth(std::size_t depth)
     {
-        return std::find_if(it, end, [](char c) {
-            return !is_number(c) && c != ':' && c != '.';
-        });
+        limits_.max_nesting_depth = depth;
     }
 
-    local_time read_time(std::string::iterator& it,
-                         const std::string::iterator& end)
+    /**
+     * Gets the maximum nesting depth for arrays and inline tables.
+     */
+    std::size_t max_nesting_depth() const
     {
-        auto time_end = find_end_of_time(it, end);
+        return limits_.max_nesting_depth;
+    }
 
-        auto eat = make_consumer(
-            it, time_end, [&]() { throw_parse_exception("Malformed time"); });
+    /**
+     * Parses the stream this parser was created on until EOF.
+     * @throw parse_exception if there are errors in parsing
+     */
+    std::shared_ptr<table> parse();
 
-        local_time ltime;
+    /**
+     * Parses the next document from a stream holding several, separated
+     * as described by the document_framing the parser was constructed
+     * with. Returns nullptr once the stream is exhausted. Line numbers in
+     * errors count from the start of the document, and the parser's
+     * buffers are reused from one document to the next.
+     *
+     * If a document fails to parse, the next call skips whatever is left
+     * of it and continues with the document after it.
+     *
+     * @throw parse_exception if there are errors in parsing
+     */
+    std::shared_ptr<table> next_document();
 
-        ltime.hour = eat.eat_digits(2);
-        eat(':');
-        ltime.minute = eat.eat_digits(2);
-        eat(':');
-        ltime.second = eat.eat_digits(2);
+  private:
+    /**
+     * Reports a document, and the table sections in it, to the tracer for
+     * as long as it is alive. Ends the spans of any table section and
+     * arrays still open when parsing stops early with an exception.
+     */
+    class document_span
+    {
+      public:
+        explicit document_span(basic_parser& parser) : parser_(parser)
+        {
+            parser_.tracer_.begin_document();
+        }
 
-        int power = 100000;
-        if (it != time_end && *it == '.')
+        ~document_span()
         {
-            ++it;
-            while (it != time_end && is_number(*it))
+            for (auto it = parser_.nested_.rbegin();
+                 it != parser_.nested_.rend(); ++it)
             {
-                ltime.microsecond += power * (*it++ - '0');
-                power /= 10;
+                if (it->is_array)
+                    parser_.tracer_.end_array(array_size(*it));
             }
+            end_table();
+            parser_.tracer_.end_document();
         }
 
-        if (it != time_end)
-            throw_parse_exception("Malformed time");
+        document_span(const document_span&) = delete;
+        document_span& operator=(const document_span&) = delete;
+
+        /**
+         * Ends the span of the current table section and begins one for
+         * the section whose header was just parsed.
+         */
+        void next_table()
+        {
+            end_table();
+            parser_.tracer_.begin_table(parser_.header_keys_);
+            in_table_ = true;
+        }
+
+      private:
+        void end_table()
+        {
+            if (in_table_)
+                parser_.tracer_.end_table();
+            in_table_ = false;
+        }
+
+        basic_parser& parser_;
+        bool in_table_ = false;
+    };
+
+#if defined _MSC_VER
+    __declspec(noreturn)
+#elif defined __GNUC__
+    __attribute__((noreturn))
+#endif
+        void throw_parse_exception(const std::string& err);
+
+    /**
+     * Reads the next line of input into line_. Lines that are not valid
+     * UTF-8 are rejected here so the rest of the parser never sees them.
+     */
+    bool read_line();
+
+    void parse_table(std::string::iterator& it,
+                     const std::string::iterator& end, table*& curr_table);
+
+    void parse_single_table(std::string::iterator& it,
+                            const std::string::iterator& end,
+                            table*& curr_table);
+
+    void parse_table_array(std::string::iterator& it,
+                           const std::string::iterator& end,
+                           table*& curr_table);
+
+    /**
+     * Reads the dot-separated components of a table or table array
+     * header into header_keys_, stopping at the closing ']'.
+     */
+    void parse_header_keys(std::string::iterator& it,
+                           const std::string::iterator& end, const char* what);
+
+    /**
+     * Resolves the longest prefix (of at most limit components) that
+     * header_keys_ shares with the previous header from the cache,
+     * moving curr_table to the deepest table found. Returns the number
+     * of components resolved and drops cache entries past them.
+     */
+    std::size_t resume_header_path(table*& curr_table, std::size_t limit);
+
+    /**
+     * Records that header component i resolved to the plain table tbl.
+     * The cache only holds an unbroken prefix of plain tables: once a
+     * component goes through a table array (whose current element changes
+     * as elements are appended) nothing deeper is cached.
+     */
+    void cache_header_table(std::size_t i, table* tbl);
+
+    /**
+     * Joins the first n header components for use in error messages.
+     */
+    std::string header_name(std::size_t n) const;
+
+    /**
+     * Follows the header just parsed through the schema, rejecting
+     * components it does not allow, and leaves the schema node of the
+     * table each component names (of the elements, for a table array) in
+     * header_schema_ and the path of the header in header_path_.
+     */
+    void follow_header_schema(bool table_array);
+
+    /**
+     * Remembers the table or table array created for header component i,
+     * whose required keys can only be checked once nothing more can be
+     * added to it.
+     */
+    void note_schema_table(const base* node, std::size_t i);
+
+    /**
+     * Checks the required keys of the last element of a table array that
+     * is about to have another appended, as it is now complete.
+     */
+    void close_schema_element(const table_array* arr, std::size_t i);
+
+    /**
+     * Checks the required keys of the tables still open at the end of
+     * the document.
+     */
+    void check_schema_tables(const table& root);
+
+    void parse_key_value(std::string::iterator& it, std::string::iterator& end,
+                         table* curr_table);
+
+    /**
+     * Parses the "key =" part of a key/value pair and reserves the key's
+     * slot in curr_table, leaving it at the start of the value.
+     */
+    table::iterator parse_key_assignment(std::string::iterator& it,
+                                         const std::string::iterator& end,
+                                         table* curr_table);
+
+    /**
+     * Finds or inserts the slot for key in tbl, enforcing the per-table
+     * key and total node limits when a new key is added.
+     */
+    std::pair<table::iterator, bool> reserve_key(table* tbl,
+                                                 const std::string& key);
+
+    void count_node();
+
+    void check_array_size(std::size_t size);
+
+    void check_string_length(std::size_t length);
+
+    template <class Function>
+    std::string parse_key(std::string::iterator& it,
+                          const std::string::iterator& end, Function&& fun);
+
+    std::string parse_bare_key(std::string::iterator& it,
+                               const std::string::iterator& end);
+
+    std::string parse_quoted_key(std::string::iterator& it,
+                                 const std::string::iterator& end);
+
+    enum class parse_type
+    {
+        STRING = 1,
+        LOCAL_TIME,
+        LOCAL_DATE,
+        LOCAL_DATETIME,
+        OFFSET_DATETIME,
+        INT,
+        FLOAT,
+        BOOL,
+        ARRAY,
+        INLINE_TABLE
+    };
+
+    /**
+     * An array or inline table that is still being parsed.
+     */
+    struct nested_frame
+    {
+        // array, table_array (for arrays of inline tables), or table
+        std::shared_ptr<base> node;
+        // the type of the array's first element, or INLINE_TABLE
+        parse_type elem;
+        // whether node is an array or table_array rather than a table
+        bool is_array;
+        // for inline tables, the slot of the member being parsed
+        table::iterator slot;
+    };
+
+    /**
+     * The number of elements in the array or table_array of a frame.
+     * Arrays of inline tables are never stored as compact rows, so this
+     * reads the rows directly rather than through table_array::size().
+     */
+    static std::size_t array_size(const nested_frame& frame)
+    {
+        if (frame.elem == parse_type::INLINE_TABLE)
+            return static_cast<const table_array&>(*frame.node).array_.size();
+        return static_cast<const array&>(*frame.node).get().size();
+    }
+
+    std::shared_ptr<base> parse_value(std::string::iterator& it,
+                                      std::string::iterator& end);
+
+    std::shared_ptr<base> parse_scalar(parse_type type,
+                                       std::string::iterator& it,
+                                       std::string::iterator& end);
+
+    parse_type determine_value_type(const std::string::iterator& it,
+                                    const std::string::iterator& end);
+
+    parse_type determine_number_type(const std::string::iterator& it,
+                                     const std::string::iterator& end);
+
+    std::shared_ptr<value<std::string>>
+    parse_string(std::string::iterator& it, std::string::iterator& end);
+
+    std::shared_ptr<value<std::string>>
+    parse_multiline_string(std::string::iterator& it,
+                           std::string::iterator& end, char delim);
+
+    std::string string_literal(std::string::iterator& it,
+                               const std::string::iterator& end, char delim);
+
+    /**
+     * Decodes the escape sequence at it, appending the result directly to
+     * out.
+     */
+    void parse_escape_code(std::string::iterator& it,
+                           const std::string::iterator& end, std::string& out);
+
+    void parse_unicode(std::string::iterator& it,
+                       const std::string::iterator& end, std::string& out);
+
+    uint32_t parse_hex(std::string::iterator& it,
+                       const std::string::iterator& end, uint32_t place);
+
+    bool is_hex(char c);
+
+    uint32_t hex_to_digit(char c);
+
+    std::shared_ptr<base> parse_number(std::string::iterator& it,
+                                       const std::string::iterator& end);
+
+    std::shared_ptr<value<int64_t>> parse_int(std::string::iterator& it,
+                                              const std::string::iterator& end);
+
+    std::shared_ptr<value<double>>
+    parse_float(std::string::iterator& it, const std::string::iterator& end);
+
+    std::shared_ptr<value<bool>> parse_bool(std::string::iterator& it,
+                                            const std::string::iterator& end);
+
+    std::string::iterator find_end_of_number(std::string::iterator it,
+                                             std::string::iterator end);
+
+    std::string::iterator find_end_of_date(std::string::iterator it,
+                                           std::string::iterator end);
+
+    std::string::iterator find_end_of_time(std::string::iterator it,
+                                           std::string::iterator end);
+
+    local_time read_time(std::string::iterator& it,
+                         const std::string::iterator& end);
+
+    std::shared_ptr<value<local_time>>
+    parse_time(std::string::iterator& it, const std::string::iterator& end);
+
+    std::shared_ptr<base> parse_date(std::string::iterator& it,
+                                     const std::string::iterator& end);
+
+    /**
+     * Parses an array or inline table along with everything nested inside
+     * it. Nesting is tracked on an explicit stack (nested_) rather than by
+     * recursion, so the call stack stays bounded however deep the input
+     * goes; input nested deeper than max_nesting_depth() is rejected as
+     * soon as the limit is crossed.
+     */
+    std::shared_ptr<base> parse_nested_value(parse_type type,
+                                             std::string::iterator& it,
+                                             std::string::iterator& end);
+
+    /**
+     * Pushes a frame for the array or inline table starting at it. Returns
+     * the finished container if it turns out to be empty (and so is closed
+     * straight away), or nullptr if it was left open.
+     */
+    std::shared_ptr<base> open_nested(parse_type type,
+                                      std::string::iterator& it,
+                                      std::string::iterator& end);
+
+    /**
+     * Checks that an element of the given type may be added to an array
+     * whose first element had type elem.
+     */
+    void check_array_element(parse_type elem, parse_type type);
+
+    void add_array_element(nested_frame& frame, std::shared_ptr<base> value);
+
+    /**
+     * Determines if a parsed value may be stored in an array whose first
+     * element had type elem. Integers are accepted in arrays of floats,
+     * as with base::as<double>().
+     */
+    bool is_array_element(parse_type elem, const base& b);
+
+    template <class T>
+    static bool holds(const base& b)
+    {
+        return dynamic_cast<const value<T>*>(&b) != nullptr;
+    }
+
+    void skip_whitespace_and_comments(std::string::iterator& start,
+                                      std::string::iterator& end);
+
+    void consume_whitespace(std::string::iterator& it,
+                            const std::string::iterator& end);
+
+    void consume_backwards_whitespace(std::string::iterator& back,
+                                      const std::string::iterator& front);
+
+    void eol_or_comment(const std::string::iterator& it,
+                        const std::string::iterator& end);
+
+    bool is_time(const std::string::iterator& it,
+                 const std::string::iterator& end);
+
+    option<parse_type> date_type(const std::string::iterator& it,
+                                 const std::string::iterator& end);
+
+    struct header_cache_entry
+    {
+        std::string key;
+        table* tbl;
+    };
+
+    struct schema_table
+    {
+        // a table, or a table array whose last element is open
+        const base* node;
+        std::size_t schema;
+        std::string path;
+        std::size_t line;
+    };
+
+    /**
+     * Reads the next length-prefixed document into document_, returning
+     * false at the end of the stream.
+     */
+    bool read_length_prefixed_document();
+
+    std::istream* stream_;
+    std::istream* input_;
+    std::string line_;
+    // scratch space for numbers with their underscores removed
+    std::string number_;
+    std::size_t line_number_ = 0;
+    std::vector<std::string> header_keys_;
+    std::vector<header_cache_entry> header_cache_;
+    std::vector<nested_frame> nested_;
+    parse_limits limits_;
+    std::shared_ptr<const cpptoml::schema> schema_;
+    // the schema node of the table that keys are being added to
+    std::size_t table_schema_ = 0;
+    std::vector<std::size_t> header_schema_;
+    std::vector<detail::decode_path> header_path_;
+    std::vector<schema_table> schema_tables_;
+    std::unordered_map<const table_array*, std::size_t> schema_arrays_;
+    std::size_t bytes_read_ = 0;
+    std::size_t nodes_ = 0;
+    document_framing framing_;
+    bool framed_ = false;
+    // whether read_line() should stop at the framing's delimiter line
+    bool delimited_ = false;
+    // whether the last delimited document ended before its delimiter
+    bool in_document_ = false;
+    std::string document_;
+    detail::memory_streambuf document_buf_;
+    std::istream document_stream_{&document_buf_};
+    Tracer tracer_;
+};
+
+#if defined(CPPTOML_COMPILED_LIB) && !defined(CPPTOML_IMPLEMENTATION)
+extern template class basic_parser<null_tracer>;
+#endif
+
+namespace detail
+{
+/**
+ * Checks the first bytes of source for the magic number of a compressed
+ * format, returning a stream buffer that decompresses source as it is
+ * read. If the input is not compressed, source is rewound to its start
+ * and nullptr is returned, or, when source cannot seek, a stream buffer
+ * that replays the bytes already read before the rest of source.
+ *
+ * @throw parse_exception if the input is compressed in a format that
+ * support was not built for
+ */
+CPPTOML_INLINE std::unique_ptr<std::streambuf>
+make_decompressor(std::streambuf& source, const std::string& filename);
+}
+
+/**
+ * Utility function to parse a file as a TOML file. Returns the root table.
+ * Throws a parse_exception if the file cannot be opened or if it exceeds
+ * the given limits. Files compressed with gzip or zstd are decompressed
+ * while they are parsed when support for the format is built in.
+ */
+CPPTOML_INLINE std::shared_ptr<table>
+parse_file(const std::string& filename,
+           const parse_limits& limits = parse_limits{});
+
+/**
+ * Keeps idle parsers for each thread, so that code parsing many small
+ * documents can reuse a parser (and the capacity of its buffers) rather
+ * than constructing a new one for every document.
+ */
+class parser_pool
+{
+  public:
+    /**
+     * Returns a parser to the pool of the thread that releases it.
+     */
+    struct releaser
+    {
+        void operator()(parser* p) const;
+    };
+
+    using pointer = std::unique_ptr<parser, releaser>;
+
+    /**
+     * The most idle parsers kept for each thread.
+     */
+    static const std::size_t max_idle = 8;
+
+    /**
+     * Takes an idle parser from the calling thread's pool, or creates one
+     * if there is none, and resets it onto stream with the given limits.
+     */
+    static pointer acquire(std::istream& stream,
+                           const parse_limits& limits = parse_limits{});
+
+    /**
+     * Parses stream to EOF with a pooled parser. Returns the root table.
+     * @throw parse_exception if there are errors in parsing
+     */
+    static std::shared_ptr<table>
+    parse(std::istream& stream, const parse_limits& limits = parse_limits{});
+
+  private:
+    static std::vector<std::unique_ptr<parser>>& idle();
+};
+
+template <class Tracer>
+CPPTOML_INLINE std::shared_ptr<table> basic_parser<Tracer>::parse()
+{
+    bytes_read_ = 0;
+    nodes_ = 0;
+    header_cache_.clear();
+    nested_.clear();
+
+    document_span span{*this};
+    std::shared_ptr<table> root = make_table();
+
+    table* curr_table = root.get();
+    if (schema_)
+    {
+        table_schema_ = 0;
+        header_path_.assign(1, detail::decode_path{nullptr, nullptr, 0});
+        schema_tables_.clear();
+        schema_arrays_.clear();
+    }
+
+    while (read_line())
+    {
+        auto it = line_.begin();
+        auto end = line_.end();
+        consume_whitespace(it, end);
+        if (it == end || *it == '#')
+            continue;
+        if (*it == '[')
+        {
+            curr_table = root.get();
+            parse_table(it, end, curr_table);
+            span.next_table();
+        }
+        else
+        {
+            parse_key_value(it, end, curr_table);
+            consume_whitespace(it, end);
+            eol_or_comment(it, end);
+        }
+    }
+    if (schema_)
+        check_schema_tables(*root);
+    return root;
+}
+
+template <class Tracer>
+CPPTOML_INLINE std::shared_ptr<table> basic_parser<Tracer>::next_document()
+{
+    if (!framed_)
+        throw parse_exception{"next_document() requires a parser constructed "
+                              "with a document_framing"};
+
+    line_number_ = 0;
+    if (framing_.length_prefixed_)
+    {
+        if (!read_length_prefixed_document())
+            return nullptr;
+
+        document_buf_.reset(&document_[0], &document_[0] + document_.size());
+        document_stream_.clear();
+        input_ = &document_stream_;
+        try
+        {
+            auto root = parse();
+            input_ = stream_;
+            return root;
+        }
+        catch (...)
+        {
+            input_ = stream_;
+            throw;
+        }
+    }
+
+    // skip the rest of a document that failed to parse, cutting lines
+    // off one byte past the delimiter's length so that a long line is
+    // never buffered whole; the pieces after a cut are not line starts
+    if (in_document_)
+    {
+        auto max_len = framing_.delimiter_.size() + 1;
+        bool line_start = true;
+        while (detail::getline(*stream_, line_, max_len))
+        {
+            if (line_start && line_ == framing_.delimiter_)
+                break;
+            line_start = line_.size() < max_len;
+        }
+        in_document_ = false;
+    }
+
+    if (stream_->peek() == std::istream::traits_type::eof())
+        return nullptr;
+
+    in_document_ = true;
+    delimited_ = true;
+    try
+    {
+        auto root = parse();
+        delimited_ = false;
+        in_document_ = false;
+        return root;
+    }
+    catch (...)
+    {
+        delimited_ = false;
+        throw;
+    }
+}
+
+template <class Tracer>
+CPPTOML_INLINE bool basic_parser<Tracer>::read_length_prefixed_document()
+{
+    // the length is at most 20 digits, so a longer line is invalid
+    if (!detail::getline(*stream_, line_, 21)
+        || (line_.empty() && stream_->eof()))
+        return false;
+
+    if (line_.empty() || line_.size() > 20
+        || !std::all_of(line_.begin(), line_.end(), is_number))
+        throw parse_exception{"Invalid document length \"" + line_ + "\""};
+
+    std::size_t length = 0;
+    bool too_long = false;
+    for (const auto& c : line_)
+    {
+        auto digit = static_cast<std::size_t>(c - '0');
+        if (digit > limits_.max_input_bytes
+            || length > (limits_.max_input_bytes - digit) / 10)
+            too_long = true;
+        else
+            length = length * 10 + digit;
+    }
+
+    if (too_long)
+    {
+        // skip the document when its length still fits in a streamsize
+        if (line_.size() < 19)
+            stream_->ignore(std::stoll(line_));
+        throw parse_exception{"Document exceeds maximum size of "
+                              + std::to_string(limits_.max_input_bytes)
+                              + " bytes"};
+    }
+
+    // read a chunk at a time rather than allocating the whole length up
+    // front, so that a bogus length runs into the end of the stream
+    // instead of exhausting memory
+    const std::size_t chunk_size = 1 << 16;
+    document_.clear();
+    while (document_.size() < length)
+    {
+        auto size = document_.size();
+        auto n = std::min(chunk_size, length - size);
+        document_.resize(size + n);
+        stream_->read(&document_[size], static_cast<std::streamsize>(n));
+        if (static_cast<std::size_t>(stream_->gcount()) != n)
+            throw parse_exception{"Unexpected end of stream in a document of "
+                                  + line_ + " bytes"};
+    }
+    return true;
+}
+
+template <class Tracer>
+CPPTOML_INLINE void
+basic_parser<Tracer>::throw_parse_exception(const std::string& err)
+{
+    throw parse_exception{err, line_number_};
+}
+
+template <class Tracer>
+CPPTOML_INLINE bool basic_parser<Tracer>::read_line()
+{
+    CPPTOML_STAGE(LINE);
+    // read at most one byte more than the limit allows so that an
+    // oversized line is caught without buffering all of it
+    auto remaining = limits_.max_input_bytes - bytes_read_;
+    auto max_len = remaining == std::numeric_limits<std::size_t>::max()
+                       ? remaining
+                       : remaining + 1;
+    if (!detail::getline(*input_, line_, max_len))
+        return false;
+
+    if (delimited_ && line_ == framing_.delimiter_)
+    {
+        in_document_ = false;
+        return false;
+    }
+
+    ++line_number_;
+    bytes_read_ += line_.size();
+    if (bytes_read_ > limits_.max_input_bytes)
+        throw_parse_exception("Input exceeds maximum size of "
+                              + std::to_string(limits_.max_input_bytes)
+                              + " bytes");
+    // count the line break (if any) without overflowing at the limit
+    if (bytes_read_ < limits_.max_input_bytes)
+        ++bytes_read_;
+
+    if (!detail::is_valid_utf8(line_.data(), line_.size()))
+        throw_parse_exception("Invalid UTF-8 sequence");
+    return true;
+}
+
+template <class Tracer>
+CPPTOML_INLINE void basic_parser<Tracer>::parse_table(std::string::iterator& it,
+                                       const std::string::iterator& end,
+                                       table*& curr_table)
+{
+    CPPTOML_STAGE(HEADER);
+    // remove the beginning keytable marker
+    ++it;
+    if (it == end)
+        throw_parse_exception("Unexpected end of table");
+    if (*it == '[')
+        parse_table_array(it, end, curr_table);
+    else
+        parse_single_table(it, end, curr_table);
+}
+
+template <class Tracer>
+CPPTOML_INLINE void
+basic_parser<Tracer>::parse_single_table(std::string::iterator& it,
+                                         const std::string::iterator& end,
+                                         table*& curr_table)
+{
+    if (it == end || *it == ']')
+        throw_parse_exception("Table name cannot be empty");
+
+    parse_header_keys(it, end, "table name");
+
+    if (it == end)
+        throw_parse_exception(
+            "Unterminated table declaration; did you forget a ']'?");
+
+    if (schema_)
+        follow_header_schema(false);
+
+    bool inserted = false;
+    auto i = resume_header_path(curr_table, header_keys_.size());
+    for (; i < header_keys_.size(); ++i)
+    {
+        auto slot = reserve_key(curr_table, header_keys_[i]);
+        if (slot.second)
+        {
+            inserted = true;
+            auto tbl = make_table();
+            curr_table = tbl.get();
+            slot.first->second = std::move(tbl);
+            cache_header_table(i, curr_table);
+            if (schema_)
+                note_schema_table(curr_table, i);
+        }
+        else
+        {
+            const auto& b = slot.first->second;
+            if (b->is_table())
+            {
+                curr_table = static_cast<table*>(b.get());
+                cache_header_table(i, curr_table);
+            }
+            else if (b->is_table_array())
+            {
+                curr_table
+                    = static_cast<table_array*>(b.get())->array_.back().get();
+            }
+            else
+            {
+                throw_parse_exception("Key " + header_name(i + 1)
+                                      + " already exists as a value");
+            }
+        }
+    }
+
+    // table already existed
+    if (!inserted)
+    {
+        auto is_value
+            = [](const std::pair<const std::string&,
+                                 const std::shared_ptr<base>&>& p) {
+                  return p.second->is_value();
+              };
+
+        // if there are any values, we can't add values to this table
+        // since it has already been defined. If there aren't any
+        // values, then it was implicitly created by something like
+        // [a.b]
+        if (curr_table->empty() || std::any_of(curr_table->begin(),
+                                               curr_table->end(), is_value))
+        {
+            throw_parse_exception("Redefinition of table "
+                                  + header_name(header_keys_.size()));
+        }
+    }
+
+    ++it;
+    consume_whitespace(it, end);
+    eol_or_comment(it, end);
+}
+
+template <class Tracer>
+CPPTOML_INLINE void
+basic_parser<Tracer>::parse_table_array(std::string::iterator& it,
+                                        const std::string::iterator& end,
+                                        table*& curr_table)
+{
+    ++it;
+    if (it == end || *it == ']')
+        throw_parse_exception("Table array name cannot be empty");
+
+    parse_header_keys(it, end, "table array name");
+    if (schema_)
+        follow_header_schema(true);
+
+    // the last component always names the table array itself, so it
+    // is never resolved from the cache
+    auto last = header_keys_.size() - 1;
+    auto i = resume_header_path(curr_table, last);
+    for (; i < header_keys_.size(); ++i)
+    {
+        auto slot = reserve_key(curr_table, header_keys_[i]);
+        if (slot.second)
+        {
+            // if this is the end of the table array name, add a new
+            // table array and a new table inside that array for us to
+            // add keys to next
+            if (i == last)
+            {
+                auto arr = make_table_array();
+                check_array_size(0);
+                count_node();
+                arr->get().push_back(make_table());
+                curr_table = arr->get().back().get();
+                if (schema_)
+                    note_schema_table(arr.get(), i);
+                slot.first->second = std::move(arr);
+            }
+            // otherwise, create the implicitly defined table and move
+            // down to it
+            else
+            {
+                auto tbl = make_table();
+                curr_table = tbl.get();
+                slot.first->second = std::move(tbl);
+                cache_header_table(i, curr_table);
+                if (schema_)
+                    note_schema_table(curr_table, i);
+            }
+        }
+        else
+        {
+            const auto& b = slot.first->second;
+
+            // if this is the end of the table array name, add an
+            // element to the table array that we just looked up
+            if (i == last)
+            {
+                if (!b->is_table_array())
+                    throw_parse_exception("Key " + header_name(i + 1)
+                                          + " is not a table array");
+                auto arr = static_cast<table_array*>(b.get());
+                check_array_size(arr->size());
+                count_node();
+                if (schema_)
+                    close_schema_element(arr, i);
+                auto next = arr->compact_back();
+                arr->array_.push_back(next ? std::move(next) : make_table());
+                curr_table = arr->array_.back().get();
+            }
+            // otherwise, just keep traversing down the key name
+            else
+            {
+                if (b->is_table())
+                {
+                    curr_table = static_cast<table*>(b.get());
+                    cache_header_table(i, curr_table);
+                }
+                else if (b->is_table_array())
+                {
+                    curr_table = static_cast<table_array*>(b.get())
+                                     ->array_.back()
+                                     .get();
+                }
+                else
+                {
+                    throw_parse_exception("Key " + header_name(i + 1)
+                                          + " already exists as a value");
+                }
+            }
+        }
+    }
+
+    // consume the last "]]"
+    if (it == end)
+        throw_parse_exception("Unterminated table array name");
+    ++it;
+    if (it == end)
+        throw_parse_exception("Unterminated table array name");
+    ++it;
+
+    consume_whitespace(it, end);
+    eol_or_comment(it, end);
+}
+
+template <class Tracer>
+CPPTOML_INLINE void
+basic_parser<Tracer>::parse_header_keys(std::string::iterator& it,
+                                        const std::string::iterator& end,
+                                        const char* what)
+{
+    header_keys_.clear();
+    while (it != end && *it != ']')
+    {
+        auto part = parse_key(it, end,
+                              [](char c) { return c == '.' || c == ']'; });
+
+        if (part.empty())
+            throw_parse_exception(std::string{"Empty component of "}
+                                  + what);
+
+        header_keys_.push_back(std::move(part));
+
+        consume_whitespace(it, end);
+        if (it != end && *it == '.')
+            ++it;
+        consume_whitespace(it, end);
+    }
+}
+
+template <class Tracer>
+CPPTOML_INLINE std::size_t
+basic_parser<Tracer>::resume_header_path(table*& curr_table, std::size_t limit)
+{
+    std::size_t n = 0;
+    while (n < limit && n < header_cache_.size()
+           && header_cache_[n].key == header_keys_[n])
+    {
+        curr_table = header_cache_[n].tbl;
+        ++n;
+    }
+    header_cache_.resize(n);
+    return n;
+}
+
+template <class Tracer>
+CPPTOML_INLINE void
+basic_parser<Tracer>::cache_header_table(std::size_t i, table* tbl)
+{
+    if (header_cache_.size() == i)
+        header_cache_.push_back({header_keys_[i], tbl});
+}
+
+template <class Tracer>
+CPPTOML_INLINE std::string
+basic_parser<Tracer>::header_name(std::size_t n) const
+{
+    std::string name;
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        if (i > 0)
+            name += ".";
+        name += header_keys_[i];
+    }
+    return name;
+}
+
+template <class Tracer>
+CPPTOML_INLINE void basic_parser<Tracer>::follow_header_schema(bool table_array)
+{
+    header_schema_.clear();
+    header_path_.clear();
+    // reserved up front, since each link points at the one before it
+    header_path_.reserve(header_keys_.size() + 1);
+    header_path_.push_back({nullptr, nullptr, 0});
+
+    using kind = cpptoml::schema::kind;
+    std::size_t n = 0;
+    for (std::size_t i = 0; i < header_keys_.size(); ++i)
+    {
+        header_path_.push_back(
+            {&header_path_.back(), header_keys_[i].c_str(), 0});
+
+        auto m = schema_->member(n, header_keys_[i]);
+        if (m == cpptoml::schema::npos)
+            throw_parse_exception("Unknown key " + header_name(i + 1));
+
+        auto type = schema_->nodes_[m].type;
+        bool allowed;
+        if (i + 1 < header_keys_.size())
+            allowed = type == kind::TABLE || type == kind::TABLE_ARRAY;
+        else
+            allowed = type == (table_array ? kind::TABLE_ARRAY : kind::TABLE);
+        if (!allowed)
+            throw_parse_exception("Key " + header_name(i + 1) + " must be "
+                                  + schema_->describe(m));
+
+        n = type == kind::TABLE_ARRAY ? schema_->nodes_[m].element : m;
+        header_schema_.push_back(n);
+    }
+    table_schema_ = n;
+}
+
+template <class Tracer>
+CPPTOML_INLINE void
+basic_parser<Tracer>::note_schema_table(const base* node, std::size_t i)
+{
+    if (node->is_table_array())
+        schema_arrays_[static_cast<const table_array*>(node)]
+            = schema_tables_.size();
+    schema_tables_.push_back(
+        {node, header_schema_[i], header_name(i + 1), line_number_});
+}
+
+template <class Tracer>
+CPPTOML_INLINE void
+basic_parser<Tracer>::close_schema_element(const table_array* arr,
+                                           std::size_t i)
+{
+    auto found = schema_arrays_.find(arr);
+    if (found == schema_arrays_.end())
+    {
+        // an array of inline tables, which were checked as they were
+        // inserted; only the elements from here on need tracking
+        note_schema_table(arr, i);
+        return;
+    }
+
+    auto& open = schema_tables_[found->second];
+    schema_->check_required(open.schema, *arr->array_.back(), open.path,
+                            open.line);
+    open.line = line_number_;
+}
+
+template <class Tracer>
+CPPTOML_INLINE void
+basic_parser<Tracer>::check_schema_tables(const table& root)
+{
+    schema_->check_required(0, root, "", 0);
+    for (const auto& open : schema_tables_)
+    {
+        const table* tbl;
+        if (open.node->is_table_array())
+            tbl = static_cast<const table_array*>(open.node)
+                      ->array_.back()
+                      .get();
+        else
+            tbl = static_cast<const table*>(open.node);
+        schema_->check_required(open.schema, *tbl, open.path, open.line);
+    }
+}
+
+template <class Tracer>
+CPPTOML_INLINE void
+basic_parser<Tracer>::parse_key_value(std::string::iterator& it,
+                                      std::string::iterator& end,
+                                      table* curr_table)
+{
+    auto slot = parse_key_assignment(it, end, curr_table);
+    if (schema_)
+    {
+        auto line = line_number_;
+        const detail::decode_path at{&header_path_.back(),
+                                     slot->first.c_str(), 0};
+        auto n = schema_->member(table_schema_, slot->first);
+        if (n == cpptoml::schema::npos)
+            throw_parse_exception("Unknown key " + at.str());
+        slot->second = parse_value(it, end);
+        schema_->check(n, *slot->second, at, line);
+    }
+    else
+    {
+        slot->second = parse_value(it, end);
+    }
+    consume_whitespace(it, end);
+}
+
+template <class Tracer>
+CPPTOML_INLINE table::iterator
+basic_parser<Tracer>::parse_key_assignment(std::string::iterator& it,
+                                           const std::string::iterator& end,
+                                           table* curr_table)
+{
+    CPPTOML_STAGE(KEY);
+    auto key = parse_key(it, end, [](char c) { return c == '='; });
+    auto slot = reserve_key(curr_table, key);
+    if (!slot.second)
+        throw_parse_exception("Key " + key + " already present");
+    if (it == end || *it != '=')
+        throw_parse_exception("Value must follow after a '='");
+    ++it;
+    consume_whitespace(it, end);
+    return slot.first;
+}
+
+template <class Tracer>
+CPPTOML_INLINE std::pair<table::iterator, bool>
+basic_parser<Tracer>::reserve_key(table* tbl, const std::string& key)
+{
+    if (tbl->map_.size() >= limits_.max_table_keys && !tbl->contains(key))
+        throw_parse_exception("Table exceeds maximum of "
+                              + std::to_string(limits_.max_table_keys)
+                              + " keys");
+
+    auto slot = tbl->try_emplace(key);
+    if (slot.second)
+        count_node();
+    return slot;
+}
+
+template <class Tracer>
+CPPTOML_INLINE void basic_parser<Tracer>::count_node()
+{
+    if (++nodes_ > limits_.max_nodes)
+        throw_parse_exception("Document exceeds maximum of "
+                              + std::to_string(limits_.max_nodes)
+                              + " nodes");
+}
+
+template <class Tracer>
+CPPTOML_INLINE void basic_parser<Tracer>::check_array_size(std::size_t size)
+{
+    if (size >= limits_.max_array_elements)
+        throw_parse_exception("Array exceeds maximum of "
+                              + std::to_string(limits_.max_array_elements)
+                              + " elements");
+}
+
+template <class Tracer>
+CPPTOML_INLINE void
+basic_parser<Tracer>::check_string_length(std::size_t length)
+{
+    if (length > limits_.max_string_length)
+        throw_parse_exception("String exceeds maximum length of "
+                              + std::to_string(limits_.max_string_length)
+                              + " bytes");
+}
+
+template <class Tracer>
+template <class Function>
+std::string basic_parser<Tracer>::parse_key(std::string::iterator& it,
+                                            const std::string::iterator& end,
+                                            Function&& fun)
+{
+    consume_whitespace(it, end);
+    if (*it == '"')
+    {
+        return parse_quoted_key(it, end);
+    }
+    else
+    {
+        auto bke = std::find_if(it, end, std::forward<Function>(fun));
+        return parse_bare_key(it, bke);
+    }
+}
+
+template <class Tracer>
+CPPTOML_INLINE std::string
+basic_parser<Tracer>::parse_bare_key(std::string::iterator& it,
+                                     const std::string::iterator& end)
+{
+    if (it == end)
+    {
+        throw_parse_exception("Bare key missing name");
+    }
+
+    auto key_end = end;
+    --key_end;
+    consume_backwards_whitespace(key_end, it);
+    ++key_end;
+    std::string key{it, key_end};
+
+    if (std::find(it, key_end, '#') != key_end)
+    {
+        throw_parse_exception("Bare key " + key + " cannot contain #");
+    }
+
+    if (std::find_if(it, key_end,
+                     [](char c) { return c == ' ' || c == '\t'; })
+        != key_end)
+    {
+        throw_parse_exception("Bare key " + key
+                              + " cannot contain whitespace");
+    }
+
+    if (std::find_if(it, key_end,
+                     [](char c) { return c == '[' || c == ']'; })
+        != key_end)
+    {
+        throw_parse_exception("Bare key " + key
+                              + " cannot contain '[' or ']'");
+    }
+
+    it = end;
+    return key;
+}
+
+template <class Tracer>
+CPPTOML_INLINE std::string
+basic_parser<Tracer>::parse_quoted_key(std::string::iterator& it,
+                                       const std::string::iterator& end)
+{
+    return string_literal(it, end, '"');
+}
+
+template <class Tracer>
+CPPTOML_INLINE std::shared_ptr<base>
+basic_parser<Tracer>::parse_value(std::string::iterator& it,
+                                  std::string::iterator& end)
+{
+    parse_type type = determine_value_type(it, end);
+    if (type == parse_type::ARRAY || type == parse_type::INLINE_TABLE)
+        return parse_nested_value(type, it, end);
+    return parse_scalar(type, it, end);
+}
+
+template <class Tracer>
+CPPTOML_INLINE std::shared_ptr<base>
+basic_parser<Tracer>::parse_scalar(parse_type type, std::string::iterator& it,
+                                   std::string::iterator& end)
+{
+    switch (type)
+    {
+        case parse_type::STRING:
+            return parse_string(it, end);
+        case parse_type::LOCAL_TIME:
+            return parse_time(it, end);
+        case parse_type::LOCAL_DATE:
+        case parse_type::LOCAL_DATETIME:
+        case parse_type::OFFSET_DATETIME:
+            return parse_date(it, end);
+        case parse_type::INT:
+        case parse_type::FLOAT:
+            return parse_number(it, end);
+        case parse_type::BOOL:
+            return parse_bool(it, end);
+        default:
+            throw_parse_exception("Failed to parse value");
+    }
+}
+
+template <class Tracer>
+CPPTOML_INLINE typename basic_parser<Tracer>::parse_type
+basic_parser<Tracer>::determine_value_type(const std::string::iterator& it,
+                                           const std::string::iterator& end)
+{
+    if(it == end)
+    {
+        throw_parse_exception("Failed to parse value type");
+    }
+    if (*it == '"' || *it == '\'')
+    {
+        return parse_type::STRING;
+    }
+    else if (is_time(it, end))
+    {
+        return parse_type::LOCAL_TIME;
+    }
+    else if (auto dtype = date_type(it, end))
+    {
+        return *dtype;
+    }
+    else if (is_number(*it) || *it == '-' || *it == '+')
+    {
+        return determine_number_type(it, end);
+    }
+    else if (*it == 't' || *it == 'f')
+    {
+        return parse_type::BOOL;
+    }
+    else if (*it == '[')
+    {
+        return parse_type::ARRAY;
+    }
+    else if (*it == '{')
+    {
+        return parse_type::INLINE_TABLE;
+    }
+    throw_parse_exception("Failed to parse value type");
+}
+
+template <class Tracer>
+CPPTOML_INLINE typename basic_parser<Tracer>::parse_type
+basic_parser<Tracer>::determine_number_type(const std::string::iterator& it,
+                                            const std::string::iterator& end)
+{
+    // determine if we are an integer or a float
+    auto check_it = it;
+    if (*check_it == '-' || *check_it == '+')
+        ++check_it;
+    while (check_it != end && is_number(*check_it))
+        ++check_it;
+    if (check_it != end && *check_it == '.')
+    {
+        ++check_it;
+        while (check_it != end && is_number(*check_it))
+            ++check_it;
+        return parse_type::FLOAT;
+    }
+    else
+    {
+        return parse_type::INT;
+    }
+}
+
+template <class Tracer>
+CPPTOML_INLINE std::shared_ptr<value<std::string>>
+basic_parser<Tracer>::parse_string(std::string::iterator& it,
+                                   std::string::iterator& end)
+{
+    CPPTOML_STAGE(STRING);
+    auto delim = *it;
+    assert(delim == '"' || delim == '\'');
+
+    // end is non-const here because we have to be able to potentially
+    // parse multiple lines in a string, not just one
+    auto check_it = it;
+    ++check_it;
+    if (check_it != end && *check_it == delim)
+    {
+        ++check_it;
+        if (check_it != end && *check_it == delim)
+        {
+            it = ++check_it;
+            return parse_multiline_string(it, end, delim);
+        }
+    }
+    return make_value<std::string>(string_literal(it, end, delim));
+}
+
+template <class Tracer>
+CPPTOML_INLINE std::shared_ptr<value<std::string>>
+basic_parser<Tracer>::parse_multiline_string(std::string::iterator& it,
+                                             std::string::iterator& end,
+                                             char delim)
+{
+    std::string buf;
+
+    auto is_ws = [](char c) { return c == ' ' || c == '\t'; };
+
+    bool consuming = false;
+    std::shared_ptr<value<std::string>> ret;
+
+    auto handle_line
+        = [&](std::string::iterator& it, std::string::iterator& end) {
+              if (consuming)
+              {
+                  it = std::find_if_not(it, end, is_ws);
+
+                  // whole line is whitespace
+                  if (it == end)
+                      return;
+              }
+
+              consuming = false;
+
+              while (it != end)
+              {
+                  // handle escaped characters
+                  if (delim == '"' && *it == '\\')
+                  {
+                      auto check = it;
+                      // check if this is an actual escape sequence or a
+                      // whitespace escaping backslash
+                      ++check;
+                      consume_whitespace(check, end);
+                      if (check == end)
+                      {
+                          consuming = true;
+                          break;
+                      }
+
+                      parse_escape_code(it, end, buf);
+                      continue;
+                  }
+
+                  // if we can end the string
+                  if (std::distance(it, end) >= 3)
+                  {
+                      auto check = it;
+                      // check for """
+                      if (*check++ == delim && *check++ == delim
+                          && *check++ == delim)
+                      {
+                          it = check;
+                          check_string_length(buf.size());
+                          ret = make_value<std::string>(std::move(buf));
+                          break;
+                      }
+                  }
+
+                  buf += *it++;
+              }
+          };
+
+    // handle the remainder of the current line
+    handle_line(it, end);
+    if (ret)
+        return ret;
+
+    // start eating lines
+    while (read_line())
+    {
+        it = line_.begin();
+        end = line_.end();
+
+        handle_line(it, end);
+
+        if (ret)
+            return ret;
+
+        if (!consuming)
+            buf += '\n';
+        check_string_length(buf.size());
+    }
+
+    throw_parse_exception("Unterminated multi-line basic string");
+}
+
+template <class Tracer>
+CPPTOML_INLINE std::string
+basic_parser<Tracer>::string_literal(std::string::iterator& it,
+                                     const std::string::iterator& end,
+                                     char delim)
+{
+    ++it;
+    std::string val;
+    while (it != end)
+    {
+        // handle escaped characters
+        if (delim == '"' && *it == '\\')
+        {
+            parse_escape_code(it, end, val);
+            check_string_length(val.size());
+        }
+        else if (*it == delim)
+        {
+            ++it;
+            consume_whitespace(it, end);
+            return val;
+        }
+        else
+        {
+            // append the run of characters up to the next quote or escape
+            // at once, checking the limit before val grows
+            auto run = it;
+            while (run != end && *run != delim
+                   && (delim != '"' || *run != '\\'))
+                ++run;
+            check_string_length(val.size()
+                                + static_cast<std::size_t>(run - it));
+            val.append(it, run);
+            it = run;
+        }
+    }
+    throw_parse_exception("Unterminated string literal");
+}
+
+template <class Tracer>
+CPPTOML_INLINE void
+basic_parser<Tracer>::parse_escape_code(std::string::iterator& it,
+                                        const std::string::iterator& end,
+                                        std::string& out)
+{
+    ++it;
+    if (it == end)
+        throw_parse_exception("Invalid escape sequence");
+    char value;
+    if (*it == 'b')
+    {
+        value = '\b';
+    }
+    else if (*it == 't')
+    {
+        value = '\t';
+    }
+    else if (*it == 'n')
+    {
+        value = '\n';
+    }
+    else if (*it == 'f')
+    {
+        value = '\f';
+    }
+    else if (*it == 'r')
+    {
+        value = '\r';
+    }
+    else if (*it == '"')
+    {
+        value = '"';
+    }
+    else if (*it == '\\')
+    {
+        value = '\\';
+    }
+    else if (*it == 'u' || *it == 'U')
+    {
+        parse_unicode(it, end, out);
+        return;
+    }
+    else
+    {
+        throw_parse_exception("Invalid escape sequence");
+    }
+    ++it;
+    out += value;
+}
+
+template <class Tracer>
+CPPTOML_INLINE void
+basic_parser<Tracer>::parse_unicode(std::string::iterator& it,
+                                    const std::string::iterator& end,
+                                    std::string& out)
+{
+    bool large = *it++ == 'U';
+    auto codepoint = parse_hex(it, end, large ? 0x10000000 : 0x1000);
+
+    if ((codepoint > 0xd7ff && codepoint < 0xe000) || codepoint > 0x10ffff)
+    {
+        throw_parse_exception(
+            "Unicode escape sequence is not a Unicode scalar value");
+    }
+
+    // See Table 3-6 of the Unicode standard
+    if (codepoint <= 0x7f)
+    {
+        // 1-byte codepoints: 00000000 0xxxxxxx
+        // repr: 0xxxxxxx
+        out += static_cast<char>(codepoint & 0x7f);
+    }
+    else if (codepoint <= 0x7ff)
+    {
+        // 2-byte codepoints: 00000yyy yyxxxxxx
+        // repr: 110yyyyy 10xxxxxx
+        //
+        // 0x1f = 00011111
+        // 0xc0 = 11000000
+        //
+        out += static_cast<char>(0xc0 | ((codepoint >> 6) & 0x1f));
+        //
+        // 0x80 = 10000000
+        // 0x3f = 00111111
+        //
+        out += static_cast<char>(0x80 | (codepoint & 0x3f));
+    }
+    else if (codepoint <= 0xffff)
+    {
+        // 3-byte codepoints: zzzzyyyy yyxxxxxx
+        // repr: 1110zzzz 10yyyyyy 10xxxxxx
+        //
+        // 0xe0 = 11100000
+        // 0x0f = 00001111
+        //
+        out += static_cast<char>(0xe0 | ((codepoint >> 12) & 0x0f));
+        out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3f));
+        out += static_cast<char>(0x80 | (codepoint & 0x3f));
+    }
+    else
+    {
+        // 4-byte codepoints: 000uuuuu zzzzyyyy yyxxxxxx
+        // repr: 11110uuu 10uuzzzz 10yyyyyy 10xxxxxx
+        //
+        // 0xf0 = 11110000
+        // 0x07 = 00000111
+        //
+        out += static_cast<char>(0xf0 | ((codepoint >> 18) & 0x07));
+        out += static_cast<char>(0x80 | ((codepoint >> 12) & 0x3f));
+        out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3f));
+        out += static_cast<char>(0x80 | (codepoint & 0x3f));
+    }
+}
+
+template <class Tracer>
+CPPTOML_INLINE uint32_t
+basic_parser<Tracer>::parse_hex(std::string::iterator& it,
+                                const std::string::iterator& end,
+                                uint32_t place)
+{
+    uint32_t value = 0;
+    while (place > 0)
+    {
+        if (it == end)
+            throw_parse_exception("Unexpected end of unicode sequence");
+
+        if (!is_hex(*it))
+            throw_parse_exception("Invalid unicode escape sequence");
+
+        value += place * hex_to_digit(*it++);
+        place /= 16;
+    }
+    return value;
+}
+
+template <class Tracer>
+CPPTOML_INLINE bool basic_parser<Tracer>::is_hex(char c)
+{
+    return is_number(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+template <class Tracer>
+CPPTOML_INLINE uint32_t basic_parser<Tracer>::hex_to_digit(char c)
+{
+    if (is_number(c))
+        return static_cast<uint32_t>(c - '0');
+    return 10 + static_cast<uint32_t>(
+                    c - ((c >= 'a' && c <= 'f') ? 'a' : 'A'));
+}
+
+template <class Tracer>
+CPPTOML_INLINE std::shared_ptr<base>
+basic_parser<Tracer>::parse_number(std::string::iterator& it,
+                                   const std::string::iterator& end)
+{
+    CPPTOML_STAGE(NUMBER);
+    auto check_it = it;
+    auto check_end = find_end_of_number(it, end);
+
+    auto eat_sign = [&]() {
+        if (check_it != end && (*check_it == '-' || *check_it == '+'))
+            ++check_it;
+    };
+
+    eat_sign();
+
+    auto eat_numbers = [&]() {
+        auto beg = check_it;
+        while (check_it != end && is_number(*check_it))
+        {
+            ++check_it;
+            if (check_it != end && *check_it == '_')
+            {
+                ++check_it;
+                if (check_it == end || !is_number(*check_it))
+                    throw_parse_exception("Malformed number");
+            }
+        }
+
+        if (check_it == beg)
+            throw_parse_exception("Malformed number");
+    };
+
+    auto check_no_leading_zero = [&]() {
+        if (check_it != end && *check_it == '0' && check_it + 1 != check_end
+            && check_it[1] != '.')
+        {
+            throw_parse_exception("Numbers may not have leading zeros");
+        }
+    };
+
+    check_no_leading_zero();
+    eat_numbers();
+
+    if (check_it != end
+        && (*check_it == '.' || *check_it == 'e' || *check_it == 'E'))
+    {
+        bool is_exp = *check_it == 'e' || *check_it == 'E';
+
+        ++check_it;
+        if (check_it == end)
+            throw_parse_exception("Floats must have trailing digits");
+
+        auto eat_exp = [&]() {
+            eat_sign();
+            check_no_leading_zero();
+            eat_numbers();
+        };
+
+        if (is_exp)
+            eat_exp();
+        else
+            eat_numbers();
+
+        if (!is_exp && check_it != end
+            && (*check_it == 'e' || *check_it == 'E'))
+        {
+            ++check_it;
+            eat_exp();
+        }
+
+        return parse_float(it, check_it);
+    }
+    else
+    {
+        return parse_int(it, check_it);
+    }
+}
+
+template <class Tracer>
+CPPTOML_INLINE std::shared_ptr<value<int64_t>>
+basic_parser<Tracer>::parse_int(std::string::iterator& it,
+                                const std::string::iterator& end)
+{
+    number_.assign(it, end);
+    number_.erase(std::remove(number_.begin(), number_.end(), '_'),
+                  number_.end());
+    it = end;
+    try
+    {
+        return make_value<int64_t>(std::stoll(number_));
+    }
+    catch (const std::invalid_argument& ex)
+    {
+        throw_parse_exception("Malformed number (invalid argument: "
+                              + std::string{ex.what()} + ")");
+    }
+    catch (const std::out_of_range& ex)
+    {
+        throw_parse_exception("Malformed number (out of range: "
+                              + std::string{ex.what()} + ")");
+    }
+}
+
+template <class Tracer>
+CPPTOML_INLINE std::shared_ptr<value<double>>
+basic_parser<Tracer>::parse_float(std::string::iterator& it,
+                                  const std::string::iterator& end)
+{
+    number_.assign(it, end);
+    number_.erase(std::remove(number_.begin(), number_.end(), '_'),
+                  number_.end());
+    it = end;
+    try
+    {
+        return make_value<double>(std::stod(number_));
+    }
+    catch (const std::invalid_argument& ex)
+    {
+        throw_parse_exception("Malformed number (invalid argument: "
+                              + std::string{ex.what()} + ")");
+    }
+    catch (const std::out_of_range& ex)
+    {
+        throw_parse_exception("Malformed number (out of range: "
+                              + std::string{ex.what()} + ")");
+    }
+}
+
+template <class Tracer>
+CPPTOML_INLINE std::shared_ptr<value<bool>>
+basic_parser<Tracer>::parse_bool(std::string::iterator& it,
+                                 const std::string::iterator& end)
+{
+    auto eat = make_consumer(it, end, [this]() {
+        throw_parse_exception("Attempted to parse invalid boolean value");
+    });
+
+    if (*it == 't')
+    {
+        eat("true");
+        return make_value<bool>(true);
+    }
+    else if (*it == 'f')
+    {
+        eat("false");
+        return make_value<bool>(false);
+    }
+
+    eat.error();
+    return nullptr;
+}
+
+template <class Tracer>
+CPPTOML_INLINE std::string::iterator
+basic_parser<Tracer>::find_end_of_number(std::string::iterator it,
+                                         std::string::iterator end)
+{
+    return std::find_if(it, end, [](char c) {
+        return !is_number(c) && c != '_' && c != '.' && c != 'e' && c != 'E'
+               && c != '-' && c != '+';
+    });
+}
+
+template <class Tracer>
+CPPTOML_INLINE std::string::iterator
+basic_parser<Tracer>::find_end_of_date(std::string::iterator it,
+                                       std::string::iterator end)
+{
+    return std::find_if(it, end, [](char c) {
+        return !is_number(c) && c != 'T' && c != 'Z' && c != ':' && c != '-'
+               && c != '+' && c != '.';
+    });
+}
+
+template <class Tracer>
+CPPTOML_INLINE std::string::iterator
+basic_parser<Tracer>::find_end_of_time(std::string::iterator it,
+                                       std::string::iterator end)
+{
+    return std::find_if(it, end, [](char c) {
+        return !is_number(c) && c != ':' && c != '.';
+    });
+}
+
+template <class Tracer>
+CPPTOML_INLINE local_time
+basic_parser<Tracer>::read_time(std::string::iterator& it,
+                                const std::string::iterator& end)
+{
+    auto time_end = find_end_of_time(it, end);
+
+    auto eat = make_consumer(
+        it, time_end, [&]() { throw_parse_exception("Malformed time"); });
+
+    local_time ltime;
+
+    ltime.hour = eat.eat_digits(2);
+    eat(':');
+    ltime.minute = eat.eat_digits(2);
+    eat(':');
+    ltime.second = eat.eat_digits(2);
+
+    int power = 100000;
+    if (it != time_end && *it == '.')
+    {
+        ++it;
+        while (it != time_end && is_number(*it))
+        {
+            ltime.microsecond += power * (*it++ - '0');
+            power /= 10;
+        }
+    }
+
+    if (it != time_end)
+        throw_parse_exception("Malformed time");
+
+    return ltime;
+}
+
+template <class Tracer>
+CPPTOML_INLINE std::shared_ptr<value<local_time>>
+basic_parser<Tracer>::parse_time(std::string::iterator& it,
+                                 const std::string::iterator& end)
+{
+    CPPTOML_STAGE(DATE);
+    return make_value(read_time(it, end));
+}
+
+template <class Tracer>
+CPPTOML_INLINE std::shared_ptr<base>
+basic_parser<Tracer>::parse_date(std::string::iterator& it,
+                                 const std::string::iterator& end)
+{
+    CPPTOML_STAGE(DATE);
+    auto date_end = find_end_of_date(it, end);
+
+    auto eat = make_consumer(
+        it, date_end, [&]() { throw_parse_exception("Malformed date"); });
+
+    local_date ldate;
+    ldate.year = eat.eat_digits(4);
+    eat('-');
+    ldate.month = eat.eat_digits(2);
+    eat('-');
+    ldate.day = eat.eat_digits(2);
+
+    if (it == date_end)
+        return make_value(ldate);
+
+    eat('T');
+
+    local_datetime ldt;
+    static_cast<local_date&>(ldt) = ldate;
+    static_cast<local_time&>(ldt) = read_time(it, date_end);
+
+    if (it == date_end)
+        return make_value(ldt);
+
+    offset_datetime dt;
+    static_cast<local_datetime&>(dt) = ldt;
+
+    int hoff = 0;
+    int moff = 0;
+    if (*it == '+' || *it == '-')
+    {
+        auto plus = *it == '+';
+        ++it;
+
+        hoff = eat.eat_digits(2);
+        dt.hour_offset = (plus) ? hoff : -hoff;
+        eat(':');
+        moff = eat.eat_digits(2);
+        dt.minute_offset = (plus) ? moff : -moff;
+    }
+    else if (*it == 'Z')
+    {
+        ++it;
+    }
+
+    if (it != date_end)
+        throw_parse_exception("Malformed date");
+
+    return make_value(dt);
+}
+
+template <class Tracer>
+CPPTOML_INLINE std::shared_ptr<base>
+basic_parser<Tracer>::parse_nested_value(parse_type type,
+                                         std::string::iterator& it,
+                                         std::string::iterator& end)
+{
+    // a previous parse may have thrown and left frames behind
+    nested_.clear();
+
+    auto value = open_nested(type, it, end);
+    while (!nested_.empty())
+    {
+        // if nothing just finished, parse the next element or member
+        // of the innermost open container
+        if (!value)
+        {
+            auto& top = nested_.back();
+            if (top.node->is_table())
+            {
+                if (it == end)
+                    throw_parse_exception("Unterminated inline table");
+                top.slot = parse_key_assignment(
+                    it, end, static_cast<table*>(top.node.get()));
+            }
+
+            type = determine_value_type(it, end);
+            if (!top.node->is_table())
+                check_array_element(top.elem, type);
+
+            if (type == parse_type::ARRAY
+                || type == parse_type::INLINE_TABLE)
+            {
+                value = open_nested(type, it, end);
+                if (!value)
+                    continue;
+            }
+            else
+            {
+                value = parse_scalar(type, it, end);
+            }
+        }
+
+        // hand the finished value to its container, then move past the
+        // separator, closing the container if it has ended
+        auto& top = nested_.back();
+        auto done = false;
+        if (top.node->is_table())
+        {
+            top.slot->second = std::move(value);
+            consume_whitespace(it, end);
+            if (it != end && *it == ',')
+            {
+                ++it;
+                consume_whitespace(it, end);
+            }
+            else if (it != end && *it == '}')
+            {
+                ++it;
+                consume_whitespace(it, end);
+                done = true;
+            }
+            else
+            {
+                throw_parse_exception("Unterminated inline table");
+            }
+        }
+        else
+        {
+            add_array_element(top, std::move(value));
+            skip_whitespace_and_comments(it, end);
+            if (*it == ',')
+            {
+                ++it;
+                skip_whitespace_and_comments(it, end);
+            }
+            else if (*it != ']')
+            {
+                throw_parse_exception("Unterminated array");
+            }
+
+            if (*it == ']')
+            {
+                ++it;
+                done = true;
+            }
+        }
+
+        value = nullptr;
+        if (done)
+        {
+            if (top.is_array)
+                tracer_.end_array(array_size(top));
+            value = std::move(top.node);
+            nested_.pop_back();
+        }
+    }
+    return value;
+}
+
+template <class Tracer>
+CPPTOML_INLINE std::shared_ptr<base>
+basic_parser<Tracer>::open_nested(parse_type type, std::string::iterator& it,
+                                  std::string::iterator& end)
+{
+    if (nested_.size() >= limits_.max_nesting_depth)
+        throw_parse_exception("Exceeded maximum nesting depth of "
+                              + std::to_string(limits_.max_nesting_depth));
+
+    ++it;
+    if (type == parse_type::INLINE_TABLE)
+    {
+        consume_whitespace(it, end);
+        if (it != end && *it == '}')
+        {
+            ++it;
+            consume_whitespace(it, end);
+            return make_table();
+        }
+        nested_.push_back({make_table(), type, false, {}});
+        return nullptr;
+    }
+
+    // this gets ugly because of the "homogeneity" restriction:
+    // arrays can either be of only one type, or contain arrays
+    // (each of those arrays could be of different types, though)
+    //
+    // because of the latter portion, we don't really have a choice
+    // but to represent them as arrays of base values...
+    //
+    // ugh---have to read the first value to determine array type...
+    skip_whitespace_and_comments(it, end);
+
+    // edge case---empty array
+    if (*it == ']')
+    {
+        ++it;
+        tracer_.begin_array();
+        tracer_.end_array(0);
+        return make_array();
+    }
+
+    auto elem = determine_value_type(it, end);
+    if (elem == parse_type::INLINE_TABLE)
+        nested_.push_back({make_table_array(), elem, true, {}});
+    else
+        nested_.push_back({make_array(), elem, true, {}});
+    tracer_.begin_array();
+    return nullptr;
+}
+
+template <class Tracer>
+CPPTOML_INLINE void basic_parser<Tracer>::check_array_element(parse_type elem,
+                                               parse_type type)
+{
+    if (elem == parse_type::ARRAY || elem == parse_type::INLINE_TABLE)
+    {
+        if (type != elem)
+            throw_parse_exception("Unexpected character in array");
+    }
+    else if (type == parse_type::ARRAY
+             || type == parse_type::INLINE_TABLE)
+    {
+        throw_parse_exception("Arrays must be homogeneous");
+    }
+}
+
+template <class Tracer>
+CPPTOML_INLINE void basic_parser<Tracer>::add_array_element(nested_frame& frame,
+                                             std::shared_ptr<base> value)
+{
+    count_node();
+    if (frame.elem == parse_type::INLINE_TABLE)
+    {
+        auto& tables = static_cast<table_array*>(frame.node.get())->get();
+        check_array_size(tables.size());
+        tables.push_back(std::static_pointer_cast<table>(value));
+        return;
+    }
+
+    if (!is_array_element(frame.elem, *value))
+        throw_parse_exception("Arrays must be homogeneous");
+
+    auto& values = static_cast<array*>(frame.node.get())->get();
+    check_array_size(values.size());
+    values.push_back(std::move(value));
+}
+
+template <class Tracer>
+CPPTOML_INLINE bool
+basic_parser<Tracer>::is_array_element(parse_type elem, const base& b)
+{
+    switch (elem)
+    {
+        case parse_type::STRING:
+            return holds<std::string>(b);
+        case parse_type::LOCAL_TIME:
+            return holds<local_time>(b);
+        case parse_type::LOCAL_DATE:
+            return holds<local_date>(b);
+        case parse_type::LOCAL_DATETIME:
+            return holds<local_datetime>(b);
+        case parse_type::OFFSET_DATETIME:
+            return holds<offset_datetime>(b);
+        case parse_type::INT:
+            return holds<int64_t>(b);
+        case parse_type::FLOAT:
+            return holds<double>(b) || holds<int64_t>(b);
+        case parse_type::BOOL:
+            return holds<bool>(b);
+        case parse_type::ARRAY:
+            // an array of inline tables is a table_array
+            return b.is_array() || b.is_table_array();
+        default:
+            return false;
+    }
+}
+
+template <class Tracer>
+void
+basic_parser<Tracer>::skip_whitespace_and_comments(std::string::iterator& start,
+                                                   std::string::iterator& end)
+{
+    CPPTOML_STAGE(WHITESPACE);
+    consume_whitespace(start, end);
+    while (start == end || *start == '#')
+    {
+        if (!read_line())
+            throw_parse_exception("Unclosed array");
+        start = line_.begin();
+        end = line_.end();
+        consume_whitespace(start, end);
+    }
+}
+
+template <class Tracer>
+CPPTOML_INLINE void
+basic_parser<Tracer>::consume_whitespace(std::string::iterator& it,
+                                         const std::string::iterator& end)
+{
+    CPPTOML_STAGE(WHITESPACE);
+    while (it != end && (*it == ' ' || *it == '\t'))
+        ++it;
+}
+
+template <class Tracer>
+CPPTOML_INLINE void basic_parser<Tracer>::consume_backwards_whitespace(
+    std::string::iterator& back, const std::string::iterator& front)
+{
+    while (back != front && (*back == ' ' || *back == '\t'))
+        --back;
+}
+
+template <class Tracer>
+CPPTOML_INLINE void
+basic_parser<Tracer>::eol_or_comment(const std::string::iterator& it,
+                                     const std::string::iterator& end)
+{
+    CPPTOML_STAGE(WHITESPACE);
+    if (it != end && *it != '#')
+        throw_parse_exception("Unidentified trailing character '"
+                              + std::string{*it}
+                              + "'---did you forget a '#'?");
+}
+
+template <class Tracer>
+CPPTOML_INLINE bool
+basic_parser<Tracer>::is_time(const std::string::iterator& it,
+                              const std::string::iterator& end)
+{
+    auto time_end = find_end_of_time(it, end);
+    auto len = std::distance(it, time_end);
+
+    if (len < 8)
+        return false;
+
+    if (it[2] != ':' || it[5] != ':')
+        return false;
+
+    if (len > 8)
+        return it[8] == '.' && len > 9;
+
+    return true;
+}
+
+template <class Tracer>
+CPPTOML_INLINE option<typename basic_parser<Tracer>::parse_type>
+basic_parser<Tracer>::date_type(const std::string::iterator& it,
+                                const std::string::iterator& end)
+{
+    auto date_end = find_end_of_date(it, end);
+    auto len = std::distance(it, date_end);
+
+    if (len < 10)
+        return {};
+
+    if (it[4] != '-' || it[7] != '-')
+        return {};
+
+    if (len >= 19 && it[10] == 'T' && is_time(it + 11, date_end))
+    {
+        // datetime type
+        auto time_end = find_end_of_time(it + 11, date_end);
+        if (time_end == date_end)
+            return {parse_type::LOCAL_DATETIME};
+        else
+            return {parse_type::OFFSET_DATETIME};
+    }
+    else if (len == 10)
+    {
+        // just a regular date
+        return {parse_type::LOCAL_DATE};
+    }
+
+    return {};
+}
+
+#if CPPTOML_DEFINE_OUT_OF_LINE
+namespace detail
+{
+/**
+ * The size of the buffers used to decompress input.
+ */
+const std::size_t decompress_chunk_size = 1 << 16;
+
+/**
+ * The number of bytes read to identify a compressed format.
+ */
+const std::size_t magic_size = 4;
+
+/**
+ * A read-only stream buffer that returns the bytes already read from
+ * another stream buffer before reading the rest of it, for sources that
+ * cannot be rewound.
+ */
+class replay_streambuf : public std::streambuf
+{
+  public:
+    replay_streambuf(std::streambuf& source, const char* prefix,
+                     std::size_t len)
+        : source_(source)
+    {
+        std::memcpy(buf_, prefix, len);
+        setg(buf_, buf_, buf_ + len);
+    }
+
+    replay_streambuf(const replay_streambuf&) = delete;
+    replay_streambuf& operator=(const replay_streambuf&) = delete;
+
+  protected:
+    int_type underflow() override
+    {
+        if (gptr() < egptr())
+            return traits_type::to_int_type(*gptr());
+
+        auto n = source_.sgetn(buf_, sizeof(buf_));
+        if (n <= 0)
+            return traits_type::eof();
+        setg(buf_, buf_, buf_ + n);
+        return traits_type::to_int_type(*gptr());
+    }
+
+  private:
+    std::streambuf& source_;
+    char buf_[decompress_chunk_size];
+};
+
+#if defined(CPPTOML_USE_ZLIB)
+/**
+ * A read-only stream buffer that inflates gzip data from another stream
+ * buffer one chunk at a time. Concatenated gzip members are read as one
+ * stream, as with gunzip.
+ */
+class gzip_streambuf : public std::streambuf
+{
+  public:
+    /**
+     * Reads gzip data that starts with the len bytes at prefix, which
+     * were already read from source, followed by the rest of source.
+     */
+    gzip_streambuf(std::streambuf& source, const std::string& filename,
+                   const char* prefix, std::size_t len)
+        : source_(source), filename_(filename)
+    {
+        std::memset(&stream_, 0, sizeof(stream_));
+        // 16 + MAX_WBITS accepts only the gzip format
+        if (inflateInit2(&stream_, 16 + MAX_WBITS) != Z_OK)
+            throw parse_exception{"Failed to initialize zlib"};
+        std::memcpy(in_, prefix, len);
+        stream_.next_in = reinterpret_cast<Bytef*>(in_);
+        stream_.avail_in = static_cast<uInt>(len);
+    }
+
+    gzip_streambuf(const gzip_streambuf&) = delete;
+    gzip_streambuf& operator=(const gzip_streambuf&) = delete;
+
+    ~gzip_streambuf()
+    {
+        inflateEnd(&stream_);
+    }
+
+  protected:
+    int_type underflow() override
+    {
+        if (gptr() < egptr())
+            return traits_type::to_int_type(*gptr());
+
+        while (true)
+        {
+            // zlib may be partway through writing out a match when the
+            // output buffer fills, so it is called again before more
+            // input is read until it leaves the buffer short of full
+            if (stream_.avail_in == 0 && !output_full_)
+            {
+                auto n = source_.sgetn(in_, sizeof(in_));
+                if (n <= 0)
+                {
+                    if (!at_member_end_)
+                        throw parse_exception{filename_
+                                              + " is truncated gzip data"};
+                    return traits_type::eof();
+                }
+                stream_.next_in = reinterpret_cast<Bytef*>(in_);
+                stream_.avail_in = static_cast<uInt>(n);
+            }
+
+            if (at_member_end_)
+            {
+                inflateReset(&stream_);
+                at_member_end_ = false;
+            }
+
+            stream_.next_out = reinterpret_cast<Bytef*>(out_);
+            stream_.avail_out = sizeof(out_);
+            auto ret = inflate(&stream_, Z_NO_FLUSH);
+            if (ret == Z_STREAM_END)
+                at_member_end_ = true;
+            else if (ret != Z_OK && ret != Z_BUF_ERROR)
+                throw parse_exception{
+                    filename_ + " is not valid gzip data: "
+                    + (stream_.msg ? stream_.msg : zError(ret))};
+
+            output_full_ = !at_member_end_ && stream_.avail_out == 0;
+            auto produced = sizeof(out_) - stream_.avail_out;
+            if (produced > 0)
+            {
+                setg(out_, out_, out_ + produced);
+                return traits_type::to_int_type(*gptr());
+            }
+        }
+    }
+
+  private:
+    std::streambuf& source_;
+    std::string filename_;
+    z_stream stream_;
+    bool at_member_end_ = false;
+    bool output_full_ = false;
+    char in_[decompress_chunk_size];
+    char out_[decompress_chunk_size];
+};
+#endif
+
+#if defined(CPPTOML_USE_ZSTD)
+/**
+ * A read-only stream buffer that decompresses zstd data from another
+ * stream buffer one chunk at a time. Concatenated frames are read as one
+ * stream, as with zstd -d.
+ */
+class zstd_streambuf : public std::streambuf
+{
+  public:
+    /**
+     * Reads zstd data that starts with the len bytes at prefix, which
+     * were already read from source, followed by the rest of source.
+     */
+    zstd_streambuf(std::streambuf& source, const std::string& filename,
+                   const char* prefix, std::size_t len)
+        : source_(source), filename_(filename), ctx_(ZSTD_createDCtx())
+    {
+        if (!ctx_)
+            throw parse_exception{"Failed to initialize zstd"};
+        std::memcpy(in_, prefix, len);
+        input_ = {in_, len, 0};
+    }
+
+    zstd_streambuf(const zstd_streambuf&) = delete;
+    zstd_streambuf& operator=(const zstd_streambuf&) = delete;
+
+    ~zstd_streambuf()
+    {
+        ZSTD_freeDCtx(ctx_);
+    }
+
+  protected:
+    int_type underflow() override
+    {
+        if (gptr() < egptr())
+            return traits_type::to_int_type(*gptr());
+
+        while (true)
+        {
+            // zstd holds decoded data back when the output buffer fills,
+            // so it is called again before more input is read until it
+            // leaves the buffer short of full
+            if (input_.pos == input_.size && !output_full_)
+            {
+                auto n = source_.sgetn(in_, sizeof(in_));
+                if (n <= 0)
+                {
+                    if (!at_frame_end_)
+                        throw parse_exception{filename_
+                                              + " is truncated zstd data"};
+                    return traits_type::eof();
+                }
+                input_ = {in_, static_cast<std::size_t>(n), 0};
+            }
+
+            ZSTD_outBuffer output = {out_, sizeof(out_), 0};
+            auto ret = ZSTD_decompressStream(ctx_, &output, &input_);
+            if (ZSTD_isError(ret))
+                throw parse_exception{filename_ + " is not valid zstd data: "
+                                      + ZSTD_getErrorName(ret)};
+            at_frame_end_ = ret == 0;
+            output_full_ = !at_frame_end_ && output.pos == output.size;
+
+            if (output.pos > 0)
+            {
+                setg(out_, out_, out_ + output.pos);
+                return traits_type::to_int_type(*gptr());
+            }
+        }
+    }
+
+  private:
+    std::streambuf& source_;
+    std::string filename_;
+    ZSTD_DCtx* ctx_;
+    ZSTD_inBuffer input_ = {nullptr, 0, 0};
+    bool at_frame_end_ = false;
+    bool output_full_ = false;
+    char in_[decompress_chunk_size];
+    char out_[decompress_chunk_size];
+};
+#endif
+
+CPPTOML_INLINE std::unique_ptr<std::streambuf>
+make_decompressor(std::streambuf& source, const std::string& filename)
+{
+    char magic[magic_size];
+    std::size_t len = 0;
+    while (len < magic_size)
+    {
+        auto n = source.sgetn(magic + len,
+                              static_cast<std::streamsize>(magic_size - len));
+        if (n <= 0)
+            break;
+        len += static_cast<std::size_t>(n);
+    }
+
+    // the decompressors are given the bytes read here rather than
+    // rewinding, as pipes and other such files cannot seek
+    auto starts_with = [&](const char* prefix, std::size_t size) {
+        return len >= size && std::memcmp(magic, prefix, size) == 0;
+    };
+
+    if (starts_with("\x1f\x8b", 2))
+    {
+#if defined(CPPTOML_USE_ZLIB)
+        return std::unique_ptr<std::streambuf>{
+            new gzip_streambuf{source, filename, magic, len}};
+#else
+        throw parse_exception{filename + " is gzip-compressed, but cpptoml "
+                                         "was built without zlib support"};
+#endif
+    }
+
+    if (starts_with("\x28\xb5\x2f\xfd", 4))
+    {
+#if defined(CPPTOML_USE_ZSTD)
+        return std::unique_ptr<std::streambuf>{
+            new zstd_streambuf{source, filename, magic, len}};
+#else
+        throw parse_exception{filename + " is zstd-compressed, but cpptoml "
+                                         "was built without zstd support"};
+#endif
+    }
+
+    if (source.pubseekpos(0, std::ios_base::in) == std::streampos(0))
+        return nullptr;
+    return std::unique_ptr<std::streambuf>{
+        new replay_streambuf{source, magic, len}};
+}
+}
+
+CPPTOML_INLINE std::shared_ptr<table> parse_file(const std::string& filename,
+                                                 const parse_limits& limits)
+{
+#if defined(BOOST_NOWIDE_FSTREAM_INCLUDED_HPP)
+    boost::nowide::ifstream file{filename.c_str(),
+                                 std::ios::in | std::ios::binary};
+#elif defined(NOWIDE_FSTREAM_INCLUDED_HPP)
+    nowide::ifstream file{filename.c_str(), std::ios::in | std::ios::binary};
+#else
+    std::ifstream file{filename, std::ios::in | std::ios::binary};
+#endif
+    if (!file.is_open())
+        throw parse_exception{filename + " could not be opened for parsing"};
+
+    // line endings are handled by the parser, so the file can be read in
+    // binary mode whether or not it is compressed
+    if (auto decompressor = detail::make_decompressor(*file.rdbuf(), filename))
+    {
+        std::istream stream{decompressor.get()};
+        parser p{stream, limits};
+        return p.parse();
+    }
+    parser p{file, limits};
+    return p.parse();
+}
+
+CPPTOML_INLINE void parser_pool::releaser::operator()(parser* p) const
+{
+    std::unique_ptr<parser> owned{p};
+    auto& parsers = idle();
+    if (parsers.size() < max_idle)
+        parsers.push_back(std::move(owned));
+}
+
+CPPTOML_INLINE parser_pool::pointer
+parser_pool::acquire(std::istream& stream, const parse_limits& limits)
+{
+    auto& parsers = idle();
+    if (parsers.empty())
+        return pointer{new parser{stream, limits}};
+
+    pointer p{parsers.back().release()};
+    parsers.pop_back();
+    p->reset(stream);
+    p->limits(limits);
+    p->schema(nullptr);
+    return p;
+}
+
+CPPTOML_INLINE std::shared_ptr<table>
+parser_pool::parse(std::istream& stream, const parse_limits& limits)
+{
+    return acquire(stream, limits)->parse();
+}
+
+CPPTOML_INLINE std::vector<std::unique_ptr<parser>>& parser_pool::idle()
+{
+    static thread_local std::vector<std::unique_ptr<parser>> parsers;
+    return parsers;
+}
+#endif
+
+#if defined(CPPTOML_HAS_COROUTINES)
+namespace detail
+{
+/**
+ * A fixed-size pool of worker threads on which parse_file_async() reads
+ * and parses files.
+ */
+class thread_pool
+{
+  public:
+    explicit thread_pool(std::size_t threads)
+    {
+        for (std::size_t i = 0; i < threads; ++i)
+            workers_.emplace_back([this]() { run(); });
+    }
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    ~thread_pool()
+    {
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            stop_ = true;
+        }
+        cv_.notify_all();
+        for (auto& worker : workers_)
+            worker.join();
+    }
+
+    /**
+     * Queues a job to be run on one of the workers. Jobs must not throw.
+     */
+    void submit(std::function<void()> job)
+    {
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            jobs_.push_back(std::move(job));
+        }
+        cv_.notify_one();
+    }
+
+    /**
+     * The pool shared by all calls to parse_file_async().
+     */
+    static thread_pool& shared()
+    {
+        static thread_pool pool{
+            std::max(2u, std::min(std::thread::hardware_concurrency(), 4u))};
+        return pool;
+    }
+
+  private:
+    void run()
+    {
+        while (true)
+        {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock{mutex_};
+                cv_.wait(lock, [&]() { return stop_ || !jobs_.empty(); });
+                if (jobs_.empty())
+                    return;
+                job = std::move(jobs_.front());
+                jobs_.pop_front();
+            }
+            job();
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::function<void()>> jobs_;
+    std::vector<std::thread> workers_;
+    bool stop_ = false;
+};
+
+#if defined(CPPTOML_HAS_IO_URING)
+/**
+ * A minimal io_uring instance driven through the raw system calls, so
+ * that nothing beyond the kernel headers is needed. It is only used from
+ * one thread at a time. Errors are returned as errno values.
+ */
+class io_uring_queue
+{
+  public:
+    io_uring_queue() = default;
+    io_uring_queue(const io_uring_queue&) = delete;
+    io_uring_queue& operator=(const io_uring_queue&) = delete;
+
+    ~io_uring_queue()
+    {
+        if (sqes_)
+            munmap(sqes_, sqes_size_);
+        if (cq_ring_)
+            munmap(cq_ring_, cq_ring_size_);
+        if (sq_ring_)
+            munmap(sq_ring_, sq_ring_size_);
+        if (ring_fd_ >= 0)
+            close(ring_fd_);
+    }
+
+    /**
+     * Sets up a queue with room for the given number of requests.
+     */
+    int init(unsigned entries)
+    {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        ring_fd_ = static_cast<int>(
+            syscall(__NR_io_uring_setup, entries, &params));
+        if (ring_fd_ < 0)
+            return errno;
+
+        sq_ring_size_
+            = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_size_ = params.cq_off.cqes
+                        + params.cq_entries * sizeof(io_uring_cqe);
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+
+        sq_ring_ = map(sq_ring_size_, IORING_OFF_SQ_RING);
+        cq_ring_ = map(cq_ring_size_, IORING_OFF_CQ_RING);
+        sqes_ = static_cast<io_uring_sqe*>(map(sqes_size_, IORING_OFF_SQES));
+        if (!sq_ring_ || !cq_ring_ || !sqes_)
+            return errno;
+
+        auto sq = static_cast<char*>(sq_ring_);
+        sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+        auto cq = static_cast<char*>(cq_ring_);
+        cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        return 0;
+    }
+
+    /**
+     * Submits a read from fd at the given offset into the buffer described
+     * by iov, which must stay valid until the read completes.
+     */
+    int read(int fd, iovec* iov, uint64_t offset, uint64_t user_data)
+    {
+        auto tail = *sq_tail_;
+        auto index = tail & sq_mask_;
+        auto& sqe = sqes_[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_READV;
+        sqe.fd = fd;
+        sqe.addr = reinterpret_cast<uint64_t>(iov);
+        sqe.len = 1;
+        sqe.off = offset;
+        sqe.user_data = user_data;
+        sq_array_[index] = index;
+        __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+        return enter(1, 0, 0);
+    }
+
+    /**
+     * Waits for the next completed read, storing its user_data and result
+     * (a byte count or a negated errno value).
+     */
+    int wait(uint64_t& user_data, int& result)
+    {
+        while (true)
+        {
+            auto head = *cq_head_;
+            if (head != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE))
+            {
+                const auto& cqe = cqes_[head & cq_mask_];
+                user_data = cqe.user_data;
+                result = cqe.res;
+                __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+                return 0;
+            }
+            if (auto err = enter(0, 1, IORING_ENTER_GETEVENTS))
+                return err;
+        }
+    }
+
+  private:
+    void* map(std::size_t size, off_t offset)
+    {
+        auto ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring_fd_, offset);
+        return ptr == MAP_FAILED ? nullptr : ptr;
+    }
+
+    int enter(unsigned to_submit, unsigned min_complete, unsigned flags)
+    {
+        while (syscall(__NR_io_uring_enter, ring_fd_, to_submit, min_complete,
+                       flags, nullptr, 0)
+               < 0)
+        {
+            if (errno != EINTR)
+                return errno;
+        }
+        return 0;
+    }
+
+    int ring_fd_ = -1;
+    void* sq_ring_ = nullptr;
+    void* cq_ring_ = nullptr;
+    io_uring_sqe* sqes_ = nullptr;
+    std::size_t sq_ring_size_ = 0;
+    std::size_t cq_ring_size_ = 0;
+    std::size_t sqes_size_ = 0;
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned cq_mask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+};
+
+/**
+ * A read-only stream buffer over a file that keeps several block reads
+ * in flight through io_uring. Each time the parser finishes a block, the
+ * block is resubmitted for the next unread part of the file, so reading
+ * overlaps with parsing.
+ */
+class io_uring_filebuf : public std::streambuf
+{
+  public:
+    static constexpr std::size_t block_size = 1 << 16;
+    static constexpr unsigned depth = 4;
+
+    io_uring_filebuf() = default;
+    io_uring_filebuf(const io_uring_filebuf&) = delete;
+    io_uring_filebuf& operator=(const io_uring_filebuf&) = delete;
+
+    ~io_uring_filebuf()
+    {
+        // the kernel may still write into blocks with reads in flight
+        for (unsigned i = 0; i < depth; ++i)
+        {
+            while (blocks_[i].pending)
+            {
+                if (reap(true) != 0)
+                    break;
+            }
+        }
+        if (fd_ >= 0)
+            close(fd_);
+    }
+
+    /**
+     * Opens filename and starts reading it. Returns false if either the
+     * file cannot be opened or io_uring is unavailable, in which case the
+     * caller should fall back to ordinary reads.
+     */
+    bool open(const std::string& filename)
+    {
+        static std::atomic<bool> unavailable{false};
+        if (unavailable.load(std::memory_order_relaxed))
+            return false;
+
+        auto err = queue_.init(depth);
+        if (err != 0)
+        {
+            // don't try again if the kernel lacks io_uring or it has been
+            // disabled, but other failures may be transient
+            if (err == ENOSYS || err == EPERM)
+                unavailable.store(true, std::memory_order_relaxed);
+            return false;
+        }
+
+        fd_ = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd_ < 0)
+            return false;
+
+        filename_ = filename;
+        data_.reset(new char[block_size * depth]);
+        for (unsigned i = 0; i < depth; ++i)
+        {
+            blocks_[i].data = data_.get() + i * block_size;
+            submit(i);
+        }
+        return true;
+    }
+
+  protected:
+    int_type underflow() override
+    {
+        if (gptr() < egptr())
+            return traits_type::to_int_type(*gptr());
+
+        if (started_)
+        {
+            // the parser is done with the current block, so it can be
+            // reused for the next part of the file
+            if (at_end_)
+                blocks_[current_].filled = 0;
+            else
+                submit(current_);
+            current_ = (current_ + 1) % depth;
+        }
+        started_ = true;
+
+        auto& b = blocks_[current_];
+        while (b.pending)
+        {
+            if (auto err = reap())
+                fail(err);
+        }
+        if (b.error != 0)
+            fail(b.error);
+        if (b.filled == 0)
+            return traits_type::eof();
+
+        setg(b.data, b.data, b.data + b.filled);
+        return traits_type::to_int_type(*gptr());
+    }
+
+    /**
+     * Seeks within the block being read, which is enough to look at the
+     * first bytes of the file and rewind.
+     */
+    pos_type seekpos(pos_type pos, std::ios_base::openmode which) override
+    {
+        auto off = static_cast<off_type>(pos);
+        auto target = static_cast<uint64_t>(off);
+        const auto& b = blocks_[current_];
+        if (!started_ || !(which & std::ios_base::in) || off < 0
+            || target < b.offset || target > b.offset + b.filled)
+            return pos_type(off_type(-1));
+        setg(b.data, b.data + (target - b.offset), b.data + b.filled);
+        return pos;
+    }
+
+  private:
+    struct block
+    {
+        char* data = nullptr;
+        iovec iov;
+        uint64_t offset = 0;
+        std::size_t filled = 0;
+        int error = 0;
+        bool pending = false;
+    };
+
+    void submit(unsigned i)
+    {
+        auto& b = blocks_[i];
+        b.offset = next_offset_;
+        b.filled = 0;
+        next_offset_ += block_size;
+        read_rest(i);
+    }
+
+    /**
+     * Reads the unfilled part of block i.
+     */
+    void read_rest(unsigned i)
+    {
+        auto& b = blocks_[i];
+        b.iov.iov_base = b.data + b.filled;
+        b.iov.iov_len = block_size - b.filled;
+        b.pending = true;
+        if (auto err = queue_.read(fd_, &b.iov, b.offset + b.filled, i))
+        {
+            b.pending = false;
+            fail(err);
+        }
+    }
+
+    /**
+     * Processes one completed read, resubmitting it if the block was only
+     * partly filled before the end of the file. When draining, the read
+     * is only marked done and nothing is resubmitted, so that it cannot
+     * throw.
+     */
+    int reap(bool drain = false)
+    {
+        uint64_t id;
+        int res;
+        if (auto err = queue_.wait(id, res))
+            return err;
+
+        auto& b = blocks_[id];
+        b.pending = false;
+        if (drain)
+            return 0;
+
+        if (res == -EINTR || res == -EAGAIN)
+        {
+            read_rest(static_cast<unsigned>(id));
+        }
+        else if (res < 0)
+        {
+            b.error = -res;
+        }
+        else if (res == 0)
+        {
+            at_end_ = true;
+        }
+        else
+        {
+            b.filled += static_cast<std::size_t>(res);
+            if (b.filled < block_size)
+                read_rest(static_cast<unsigned>(id));
+        }
+        return 0;
+    }
+
+#if defined _MSC_VER
+    __declspec(noreturn)
+#elif defined __GNUC__
+    __attribute__((noreturn))
+#endif
+        void fail(int err)
+    {
+        throw parse_exception{filename_ + " could not be read: "
+                              + std::strerror(err)};
+    }
+
+    io_uring_queue queue_;
+    int fd_ = -1;
+    std::string filename_;
+    std::unique_ptr<char[]> data_;
+    block blocks_[depth];
+    uint64_t next_offset_ = 0;
+    unsigned current_ = 0;
+    bool started_ = false;
+    bool at_end_ = false;
+};
+
+/**
+ * Parses a file that buf has been opened on, with its reads already in
+ * flight.
+ */
+inline std::shared_ptr<table> parse_file_pipelined(io_uring_filebuf& buf,
+                                                   const std::string& filename,
+                                                   const parse_limits& limits)
+{
+    auto decompressor = make_decompressor(buf, filename);
+    std::istream stream{decompressor ? decompressor.get() : &buf};
+    parser p{stream, limits};
+    return p.parse();
+}
+#endif
+
+/**
+ * Reads and parses a file on the calling thread, overlapping the reads
+ * with parsing when io_uring is available.
+ */
+inline std::shared_ptr<table>
+parse_file_pipelined(const std::string& filename, const parse_limits& limits)
+{
+#if defined(CPPTOML_HAS_IO_URING)
+    io_uring_filebuf buf;
+    if (buf.open(filename))
+        return parse_file_pipelined(buf, filename, limits);
+#endif
+    return parse_file(filename, limits);
+}
+}
+
+/**
+ * Called with the handle of a coroutine awaiting parse_file_async() when
+ * the file has been parsed, to resume the coroutine on a thread of the
+ * caller's choosing. It is called on a worker thread and must not throw.
+ */
+using resume_function = std::function<void(std::coroutine_handle<>)>;
+
+/**
+ * The awaitable returned by parse_file_async().
+ */
+class parse_file_awaitable
+{
+  public:
+    parse_file_awaitable(std::string filename, const parse_limits& limits,
+                         resume_function resume)
+        : filename_(std::move(filename)),
+          limits_(limits),
+          resume_(std::move(resume))
+    {
+        // nothing
+    }
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+#if defined(CPPTOML_HAS_IO_URING)
+        // the first reads are submitted from the awaiting thread, so they
+        // are in flight before a worker picks the job up, and the worker
+        // parses blocks as their reads complete
+        auto buf = std::make_shared<detail::io_uring_filebuf>();
+        if (!buf->open(filename_))
+            buf.reset();
+#endif
+        detail::thread_pool::shared().submit([=, this]() mutable {
+            try
+            {
+#if defined(CPPTOML_HAS_IO_URING)
+                if (buf)
+                    result_ = detail::parse_file_pipelined(*buf, filename_,
+                                                           limits_);
+                else
+#endif
+                    result_ = parse_file(filename_, limits_);
+            }
+            catch (...)
+            {
+                error_ = std::current_exception();
+            }
+#if defined(CPPTOML_HAS_IO_URING)
+            // close the file before the coroutine carries on
+            buf.reset();
+#endif
+            if (resume_)
+                resume_(handle);
+            else
+                handle.resume();
+        });
+    }
+
+    std::shared_ptr<table> await_resume()
+    {
+        if (error_)
+            std::rethrow_exception(error_);
+        return std::move(result_);
+    }
+
+  private:
+    std::string filename_;
+    parse_limits limits_;
+    resume_function resume_;
+    std::shared_ptr<table> result_;
+    std::exception_ptr error_;
+};
+
+/**
+ * Parses a file without blocking the calling thread, for use as
+ * `co_await cpptoml::parse_file_async(filename)`. The file is parsed on a
+ * shared pool of worker threads. On Linux, the first reads are submitted
+ * through io_uring from the awaiting thread, and more are kept in flight
+ * ahead of the parser, so that I/O and parsing overlap. Once the root
+ * table is ready, the awaiting coroutine is passed to resume if one is
+ * given (so that an event loop can resume it on its own thread) and is
+ * otherwise resumed on the worker thread. co_await throws a
+ * parse_exception as parse_file() would.
+ */
+inline parse_file_awaitable
+parse_file_async(std::string filename,
+                 const parse_limits& limits = parse_limits{},
+                 resume_function resume = nullptr)
+{
+    return parse_file_awaitable{std::move(filename), limits,
+                                std::move(resume)};
+}
+#endif
+
+template <class... Ts>
+struct value_accept;
+
+template <>
+struct value_accept<>
+{
+    template <class Visitor, class... Args>
+    static void accept(const base&, Visitor&&, Args&&...)
+    {
+        // nothing
+    }
+};
+
+template <class T, class... Ts>
+struct value_accept<T, Ts...>
+{
+    template <class Visitor, class... Args>
+    static void accept(const base& b, Visitor&& visitor, Args&&... args)
+    {
+        if (auto v = b.as<T>())
+        {
+            visitor.visit(*v, std::forward<Args>(args)...);
+        }
+        else
+        {
+            value_accept<Ts...>::accept(b, std::forward<Visitor>(visitor),
+                                        std::forward<Args>(args)...);
+        }
+    }
+};
+
+/**
+ * base implementation of accept() that calls visitor.visit() on the concrete
+ * class.
+ */
+template <class Visitor, class... Args>
+void base::accept(Visitor&& visitor, Args&&... args) const
+{
+    if (is_value())
+    {
+        using value_acceptor
+            = value_accept<std::string, int64_t, double, bool, local_date,
+                           local_time, local_datetime, offset_datetime>;
+        value_acceptor::accept(*this, std::forward<Visitor>(visitor),
+                               std::forward<Args>(args)...);
+    }
+    else if (is_table())
+    {
+        visitor.visit(static_cast<const table&>(*this),
+                      std::forward<Args>(args)...);
+    }
+    else if (is_array())
+    {
+        visitor.visit(static_cast<const array&>(*this),
+                      std::forward<Args>(args)...);
+    }
+    else if (is_table_array())
+    {
+        visitor.visit(static_cast<const table_array&>(*this),
+                      std::forward<Args>(args)...);
+    }
+}
+
+/**
+ * Writer that can be passed to accept() functions of cpptoml objects and
+ * will output valid TOML to a stream.
+ */
+template <class Tracer>
+class basic_toml_writer
+{
+  public:
+    /**
+     * Construct a toml_writer that will write to the given stream,
+     * reporting what it writes to the given tracing policy (see
+     * null_tracer).
+     */
+    basic_toml_writer(std::ostream& s, const std::string& indent_space = "\t",
+                      Tracer tracer = Tracer{})
+        : stream_(s),
+          indent_(indent_space),
+          has_naked_endline_(false),
+          tracer_(std::move(tracer))
+    {
+        // nothing
+    }
+
+    /**
+     * Gets the tracing policy this writer reports to.
+     */
+    Tracer& tracer()
+    {
+        return tracer_;
+    }
+
+  public:
+    /**
+     * Output a base value of the TOML tree.
+     */
+    template <class T>
+    void visit(const value<T>& v, bool = false)
+    {
+        write(v);
+    }
+
+    /**
+     * Output a table element of the TOML tree
+     */
+    void visit(const table& t, bool in_array = false);
+
+    /**
+     * Output an array element of the TOML tree
+     */
+    void visit(const array& a, bool = false);
+
+    /**
+     * Output a table_array element of the TOML tree
+     */
+    void visit(const table_array& t, bool = false);
+
+    /**
+     * Escape a string for output.
+     */
+    static std::string escape_string(const std::string& str);
+
+  protected:
+    /**
+     * Write out a string.
+     */
+    void write(const value<std::string>& v);
+
+    /**
+     * Write out a double.
+     */
+    void write(const value<double>& v);
+
+    /**
+     * Write out an integer, local_date, local_time, local_datetime, or
+     * offset_datetime.
+     */
+    template <class T>
+    typename std::enable_if<is_one_of<T, int64_t, local_date, local_time,
+                                      local_datetime,
+                                      offset_datetime>::value>::type
+    write(const value<T>& v)
+    {
+        write(v.get());
+    }
+
+    /**
+     * Write out a boolean.
+     */
+    void write(const value<bool>& v);
+
+    /**
+     * Write out the header of a table.
+     */
+    void write_table_header(bool in_array = false);
+
+    /**
+     * Write out the identifier for an item in a table.
+     */
+    void write_table_item_header(const base& b);
+
+    /**
+     * Write out a table array nested in an array as an array of inline
+     * tables, since it cannot have a header of its own.
+     */
+    void write_inline(const table_array& t);
+
+    /**
+     * Write out a table as an inline table.
+     */
+    void write_inline(const table& t);
+
+  private:
+    /**
+     * Indent the proper number of tabs given the size of
+     * the path.
+     */
+    void indent();
+
+    /**
+     * Write a value out to the stream.
+     */
+    template <class T>
+    void write(const T& v)
+    {
+        stream_ << v;
+        has_naked_endline_ = false;
+    }
+
+    /**
+     * Write an endline out to the stream
+     */
+    void endline();
+
+  private:
+    std::ostream& stream_;
+    const std::string indent_;
+    std::vector<std::string> path_;
+    bool has_naked_endline_;
+    Tracer tracer_;
+};
+
+#if defined(CPPTOML_COMPILED_LIB) && !defined(CPPTOML_IMPLEMENTATION)
+extern template class basic_toml_writer<null_tracer>;
+#endif
+
+template <class Tracer>
+CPPTOML_INLINE void
+basic_toml_writer<Tracer>::visit(const table& t, bool in_array)
+{
+    auto root = path_.empty();
+    if (root)
+        tracer_.begin_document();
+    else
+        tracer_.begin_table(path_);
+
+    write_table_header(in_array);
+    std::vector<std::string> values;
+    std::vector<std::string> tables;
+
+    for (const auto& i : t)
+    {
+        if (i.second->is_table() || i.second->is_table_array())
+        {
+            tables.push_back(i.first);
+        }
+        else
+        {
+            values.push_back(i.first);
+        }
+    }
+
+    for (unsigned int i = 0; i < values.size(); ++i)
+    {
+        path_.push_back(values[i]);
+
+        if (i > 0)
+            endline();
+
+        write_table_item_header(*t.get(values[i]));
+        t.get(values[i])->accept(*this, false);
+        path_.pop_back();
+    }
+
+    for (unsigned int i = 0; i < tables.size(); ++i)
+    {
+        path_.push_back(tables[i]);
+
+        if (values.size() > 0 || i > 0)
+            endline();
+
+        write_table_item_header(*t.get(tables[i]));
+        t.get(tables[i])->accept(*this, false);
+        path_.pop_back();
+    }
+
+    endline();
+
+    if (root)
+        tracer_.end_document();
+    else
+        tracer_.end_table();
+}
+
+template <class Tracer>
+CPPTOML_INLINE void basic_toml_writer<Tracer>::visit(const array& a, bool)
+{
+    tracer_.begin_array();
+    write("[");
+
+    for (unsigned int i = 0; i < a.get().size(); ++i)
+    {
+        if (i > 0)
+            write(", ");
+
+        if (a.get()[i]->is_array())
+        {
+            a.get()[i]->as_array()->accept(*this, true);
+        }
+        else if (a.get()[i]->is_table_array())
+        {
+            write_inline(static_cast<const table_array&>(*a.get()[i]));
+        }
+        else
+        {
+            a.get()[i]->accept(*this, true);
+        }
+    }
+
+    write("]");
+    tracer_.end_array(a.get().size());
+}
+
+template <class Tracer>
+CPPTOML_INLINE void basic_toml_writer<Tracer>::visit(const table_array& t, bool)
+{
+    tracer_.begin_array();
+    const auto rows = t.size();
+    for (std::size_t j = 0; j < rows; ++j)
+    {
+        if (j > 0)
+            endline();
+
+        t.row(j)->accept(*this, true);
+    }
+
+    endline();
+    tracer_.end_array(rows);
+}
+
+template <class Tracer>
+CPPTOML_INLINE std::string
+basic_toml_writer<Tracer>::escape_string(const std::string& str)
+{
+    std::string res;
+    for (auto it = str.begin(); it != str.end(); ++it)
+    {
+        if (*it == '\b')
+        {
+            res += "\\b";
+        }
+        else if (*it == '\t')
+        {
+            res += "\\t";
+        }
+        else if (*it == '\n')
+        {
+            res += "\\n";
+        }
+        else if (*it == '\f')
+        {
+            res += "\\f";
+        }
+        else if (*it == '\r')
+        {
+            res += "\\r";
+        }
+        else if (*it == '"')
+        {
+            res += "\\\"";
+        }
+        else if (*it == '\\')
+        {
+            res += "\\\\";
+        }
+        else if (*it >= 0x0000 && *it <= 0x001f)
+        {
+            res += "\\u";
+            std::stringstream ss;
+            ss << std::hex << std::setw(4) << std::setfill('0')
+               << static_cast<uint32_t>(*it);
+            res += ss.str();
+        }
+        else
+        {
+            res += *it;
+        }
+    }
+    return res;
+}
+
+template <class Tracer>
+CPPTOML_INLINE void
+basic_toml_writer<Tracer>::write(const value<std::string>& v)
+{
+    write("\"");
+    write(escape_string(v.get()));
+    write("\"");
+}
+
+template <class Tracer>
+CPPTOML_INLINE void basic_toml_writer<Tracer>::write(const value<double>& v)
+{
+    std::ios::fmtflags flags{stream_.flags()};
+
+    stream_ << std::showpoint;
+    write(v.get());
+
+    stream_.flags(flags);
+}
+
+template <class Tracer>
+CPPTOML_INLINE void basic_toml_writer<Tracer>::write(const value<bool>& v)
+{
+    write((v.get() ? "true" : "false"));
+}
+
+template <class Tracer>
+CPPTOML_INLINE void basic_toml_writer<Tracer>::write_table_header(bool in_array)
+{
+    if (!path_.empty())
+    {
+        indent();
+
+        write("[");
+
+        if (in_array)
+        {
+            write("[");
+        }
+
+        for (unsigned int i = 0; i < path_.size(); ++i)
+        {
+            if (i > 0)
+            {
+                write(".");
+            }
+
+            if (path_[i].find_first_not_of("ABCDEFGHIJKLMNOPQRSTUVWXYZabcde"
+                                           "fghijklmnopqrstuvwxyz0123456789"
+                                           "_-")
+                == std::string::npos)
+            {
+                write(path_[i]);
+            }
+            else
+            {
+                write("\"");
+                write(escape_string(path_[i]));
+                write("\"");
+            }
+        }
+
+        if (in_array)
+        {
+            write("]");
+        }
+
+        write("]");
+        endline();
+    }
+}
+
+template <class Tracer>
+CPPTOML_INLINE void
+basic_toml_writer<Tracer>::write_table_item_header(const base& b)
+{
+    if (!b.is_table() && !b.is_table_array())
+    {
+        indent();
+
+        if (path_.back().find_first_not_of("ABCDEFGHIJKLMNOPQRSTUVWXYZabcde"
+                                           "fghijklmnopqrstuvwxyz0123456789"
+                                           "_-")
+            == std::string::npos)
+        {
+            write(path_.back());
+        }
+        else
+        {
+            write("\"");
+            write(escape_string(path_.back()));
+            write("\"");
+        }
+
+        write(" = ");
+    }
+}
+
+template <class Tracer>
+CPPTOML_INLINE void
+basic_toml_writer<Tracer>::write_inline(const table_array& t)
+{
+    tracer_.begin_array();
+    write("[");
+    const auto rows = t.size();
+    for (std::size_t j = 0; j < rows; ++j)
+    {
+        if (j > 0)
+            write(", ");
+        write_inline(*t.row(j));
+    }
+    write("]");
+    tracer_.end_array(rows);
+}
+
+template <class Tracer>
+CPPTOML_INLINE void basic_toml_writer<Tracer>::write_inline(const table& t)
+{
+    write("{");
+    bool first = true;
+    for (const auto& i : t)
+    {
+        if (!first)
+            write(", ");
+        first = false;
+
+        if (i.first.find_first_not_of("ABCDEFGHIJKLMNOPQRSTUVWXYZabcde"
+                                      "fghijklmnopqrstuvwxyz0123456789"
+                                      "_-")
+            == std::string::npos)
+        {
+            write(i.first);
+        }
+        else
+        {
+            write("\"");
+            write(escape_string(i.first));
+            write("\"");
+        }
+        write(" = ");
+
+        if (i.second->is_table())
+            write_inline(static_cast<const table&>(*i.second));
+        else if (i.second->is_table_array())
+            write_inline(static_cast<const table_array&>(*i.second));
+        else
+            i.second->accept(*this, true);
+    }
+    write("}");
+}
+
+template <class Tracer>
+CPPTOML_INLINE void basic_toml_writer<Tracer>::indent()
+{
+    for (std::size_t i = 1; i < path_.size(); ++i)
+        write(indent_);
+}
+
+template <class Tracer>
+CPPTOML_INLINE void basic_toml_writer<Tracer>::endline()
+{
+    if (!has_naked_endline_)
+    {
+        stream_ << "\n";
+        has_naked_endline_ = true;
+    }
+}
+
+inline std::ostream& operator<<(std::ostream& stream, const base& b)
+{
+    toml_writer writer{stream};
+    b.accept(writer);
+    return stream;
+}
+
+template <class T>
+std::ostream& operator<<(std::ostream& stream, const value<T>& v)
+{
+    toml_writer writer{stream};
+    v.accept(writer);
+    return stream;
+}
+
+inline std::ostream& operator<<(std::ostream& stream, const table& t)
+{
+    toml_writer writer{stream};
+    t.accept(writer);
+    return stream;
+}
+
+inline std::ostream& operator<<(std::ostream& stream, const table_array& t)
+{
+    toml_writer writer{stream};
+    t.accept(writer);
+    return stream;
+}
+
+inline std::ostream& operator<<(std::ostream& stream, const array& a)
+{
+    toml_writer writer{stream};
+    a.accept(writer);
+    return stream;
+}
+
+#if defined(CPPTOML_CBOR)
+/**
+ * The CBOR (RFC 8949) tags used for TOML's date and time types, which are
+ * written as tagged text strings in TOML's own format. OFFSET_DATETIME
+ * and LOCAL_DATE are the standard tags for RFC 3339 date/time and
+ * full-date strings. CBOR has no tags for a date and time without an
+ * offset or for a time of day, so LOCAL_DATETIME and LOCAL_TIME are
+ * cpptoml's own, unregistered tag numbers ("TmlD" and "TmlT"). Numeric
+ * EPOCH_DATETIME items from other encoders are read as offset_datetime
+ * values in UTC.
+ */
+enum class cbor_tag : uint64_t
+{
+    OFFSET_DATETIME = 0,
+    EPOCH_DATETIME = 1,
+    LOCAL_DATE = 1004,
+    LOCAL_DATETIME = 0x546d6c44,
+    LOCAL_TIME = 0x546d6c54
+};
+
+/**
+ * Writer that can be passed to accept() functions of cpptoml objects to
+ * encode them as CBOR, appending to a byte buffer. Tables become maps with
+ * text string keys, arrays and table arrays become arrays, and dates and
+ * times become tagged strings (see cbor_tag). The size of every container
+ * is known before its elements are written, so each item is written
+ * exactly once, behind a definite-length head of the smallest size that
+ * holds it.
+ */
+class cbor_writer
+{
+  public:
+    /**
+     * Construct a cbor_writer that will append to the given buffer.
+     */
+    cbor_writer(std::vector<uint8_t>& out) : out_(out)
+    {
+        // nothing
+    }
+
+    /**
+     * Output a base value of the TOML tree.
+     */
+    template <class T>
+    void visit(const value<T>& v)
+    {
+        write(v.get());
+    }
+
+    /**
+     * Output a table of the TOML tree as a map.
+     */
+    void visit(const table& t);
+
+    /**
+     * Output an array of the TOML tree.
+     */
+    void visit(const array& a);
+
+    /**
+     * Output a table_array of the TOML tree as an array of maps.
+     */
+    void visit(const table_array& t);
+
+  private:
+    /**
+     * Write out the head of an item: its major type and its argument (a
+     * value, length, count or tag) in the fewest bytes.
+     */
+    void write_head(uint8_t major, uint64_t arg);
+
+    void write_text(const char* str, std::size_t len);
+
+    void write(const std::string& str);
+
+    void write(int64_t i);
+
+    void write(double d);
+
+    void write(bool b);
+
+    void write(const local_date& d);
+
+    void write(const local_time& t);
+
+    void write(const local_datetime& dt);
+
+    void write(const offset_datetime& dt);
+
+    std::vector<uint8_t>& out_;
+};
+
+/**
+ * Encodes a table as a CBOR map.
+ */
+CPPTOML_INLINE std::vector<uint8_t> to_cbor(const table& root);
+
+/**
+ * Decodes a CBOR map into a table. Maps must have text string keys, and
+ * arrays must hold elements of one type (arrays of maps become table
+ * arrays). Date and time strings tagged as described for cbor_tag become
+ * the corresponding TOML values; other tags are ignored. Input with no
+ * TOML equivalent (null, undefined, byte strings) or using
+ * indefinite-length items is rejected, and the limits are applied as the
+ * parser would apply them to a TOML document.
+ *
+ * @throw parse_exception if the input is not a well-formed CBOR map or
+ * exceeds the given limits
+ */
+CPPTOML_INLINE std::shared_ptr<table>
+from_cbor(const uint8_t* data, std::size_t size,
+          const parse_limits& limits = parse_limits{});
+
+inline std::shared_ptr<table>
+from_cbor(const std::vector<uint8_t>& data,
+          const parse_limits& limits = parse_limits{})
+{
+    return from_cbor(data.data(), data.size(), limits);
+}
+
+namespace detail
+{
+/**
+ * Reads one CBOR map into a table. Containers that are still being read
+ * are kept on an explicit stack, so deeply nested input cannot overflow
+ * the call stack.
+ */
+class cbor_reader
+{
+  public:
+    cbor_reader(const uint8_t* data, std::size_t size,
+                const parse_limits& limits)
+        : data_(data), size_(size), limits_(limits)
+    {
+        // nothing
+    }
+
+    std::shared_ptr<table> read();
+
+  private:
+    enum class kind
+    {
+        STRING,
+        INT,
+        FLOAT,
+        BOOL,
+        LOCAL_DATE,
+        LOCAL_TIME,
+        LOCAL_DATETIME,
+        OFFSET_DATETIME,
+        ARRAY,
+        TABLE
+    };
+
+    struct head
+    {
+        uint8_t major;
+        uint8_t info;
+        uint64_t arg;
+        // the innermost tag on the item, if it had any
+        bool tagged;
+        uint64_t tag;
+    };
+
+    /**
+     * A map or array that is still being read.
+     */
+    struct frame
+    {
+        // the table for a map; for an array, the array or table_array,
+        // created when its first element is known
+        std::shared_ptr<base> node;
+        // the number of values still to be read
+        std::size_t remaining;
+        // whether this is a map rather than an array
+        bool is_map;
+        // for arrays, the kind of the first element
+        kind elem;
+        // for maps, the key of the value being read
+        std::string key;
+    };
+
+#if defined _MSC_VER
+    __declspec(noreturn)
+#elif defined __GNUC__
+    __attribute__((noreturn))
+#endif
+        void throw_decode_exception(const std::string& err) const;
+
+    /**
+     * Reads the head of the next item, along with any tags before it.
+     */
+    head read_head();
+
+    uint64_t read_uint(std::size_t bytes);
+
+    /**
+     * Reads the count of a map or array, rejecting counts that the rest of
+     * the input is too short to hold.
+     */
+    std::size_t read_count(const head& h, std::size_t limit,
+                           const char* what);
+
+    std::string read_text(const head& h);
+
+    /**
+     * Reads a scalar item (anything but a map or array).
+     */
+    std::shared_ptr<base> read_scalar(const head& h, kind& k);
+
+    std::shared_ptr<base> read_tagged_text(const head& h, kind& k);
+
+    /**
+     * Converts a half, single or double precision float item.
+     */
+    static double to_double(const head& h);
+
+    std::shared_ptr<value<offset_datetime>> read_epoch(const head& h);
+
+    /**
+     * Pushes a frame for a map or array with count elements.
+     */
+    void open(std::shared_ptr<base> node, std::size_t count, bool is_map);
+
+    /**
+     * Adds a finished value to the innermost open container.
+     */
+    void add(frame& top, std::shared_ptr<base> value, kind k);
+
+    void count_node();
+
+    const uint8_t* data_;
+    std::size_t size_;
+    std::size_t pos_ = 0;
+    std::size_t nodes_ = 0;
+    const parse_limits& limits_;
+    std::vector<frame> stack_;
+};
+
+/**
+ * Writes value as decimal digits, zero-padded to at least width digits.
+ */
+inline char* format_digits(char* out, int value, int width)
+{
+    char digits[16];
+    int n = 0;
+    auto v = static_cast<unsigned>(value < 0 ? -value : value);
+    do
+    {
+        digits[n++] = static_cast<char>('0' + v % 10);
+        v /= 10;
+    } while (v);
+    while (n < width)
+        digits[n++] = '0';
+    while (n)
+        *out++ = digits[--n];
+    return out;
+}
+
+/**
+ * Reads exactly n decimal digits.
+ */
+inline bool read_fixed_digits(const char*& it, const char* end, int n,
+                              int& out)
+{
+    if (end - it < n)
+        return false;
+    out = 0;
+    for (int i = 0; i < n; ++i, ++it)
+    {
+        if (!is_number(*it))
+            return false;
+        out = out * 10 + (*it - '0');
+    }
+    return true;
+}
+
+inline bool read_date_text(const char*& it, const char* end, local_date& d)
+{
+    return read_fixed_digits(it, end, 4, d.year) && it != end && *it++ == '-'
+           && read_fixed_digits(it, end, 2, d.month) && it != end
+           && *it++ == '-' && read_fixed_digits(it, end, 2, d.day);
+}
+
+inline bool read_time_text(const char*& it, const char* end, local_time& t)
+{
+    if (!read_fixed_digits(it, end, 2, t.hour) || it == end || *it++ != ':'
+        || !read_fixed_digits(it, end, 2, t.minute) || it == end
+        || *it++ != ':' || !read_fixed_digits(it, end, 2, t.second))
+        return false;
+
+    t.microsecond = 0;
+    if (it != end && *it == '.')
+    {
+        ++it;
+        if (it == end || !is_number(*it))
+            return false;
+        // digits past microseconds are dropped
+        int power = 100000;
+        for (; it != end && is_number(*it); ++it, power /= 10)
+            t.microsecond += (*it - '0') * power;
+    }
+    return true;
+}
+
+inline bool read_offset_text(const char*& it, const char* end,
+                             zone_offset& z)
+{
+    if (it == end)
+        return false;
+    if (*it == 'Z' || *it == 'z')
+    {
+        ++it;
+        z.hour_offset = z.minute_offset = 0;
+        return true;
+    }
+    if (*it != '+' && *it != '-')
+        return false;
+    int sign = *it++ == '-' ? -1 : 1;
+    if (!read_fixed_digits(it, end, 2, z.hour_offset) || it == end
+        || *it++ != ':' || !read_fixed_digits(it, end, 2, z.minute_offset))
+        return false;
+    z.hour_offset *= sign;
+    z.minute_offset *= sign;
+    return true;
+}
+}
+
+#if CPPTOML_DEFINE_OUT_OF_LINE
+CPPTOML_INLINE void cbor_writer::visit(const table& t)
+{
+    write_head(5, t.size());
+    for (const auto& kv : t)
+    {
+        write(kv.first);
+        kv.second->accept(*this);
+    }
+}
+
+CPPTOML_INLINE void cbor_writer::visit(const array& a)
+{
+    write_head(4, a.get().size());
+    for (const auto& v : a.get())
+        v->accept(*this);
+}
+
+CPPTOML_INLINE void cbor_writer::visit(const table_array& t)
+{
+    const auto rows = t.size();
+    write_head(4, rows);
+    for (std::size_t j = 0; j < rows; ++j)
+        visit(*t.row(j));
+}
+
+CPPTOML_INLINE void cbor_writer::write_head(uint8_t major, uint64_t arg)
+{
+    auto type = static_cast<uint8_t>(major << 5);
+    if (arg < 24)
+    {
+        out_.push_back(static_cast<uint8_t>(type | arg));
+        return;
+    }
+
+    std::size_t bytes = 8;
+    uint8_t info = 27;
+    if (arg <= 0xff)
+    {
+        bytes = 1;
+        info = 24;
+    }
+    else if (arg <= 0xffff)
+    {
+        bytes = 2;
+        info = 25;
+    }
+    else if (arg <= 0xffffffff)
+    {
+        bytes = 4;
+        info = 26;
+    }
+
+    out_.push_back(static_cast<uint8_t>(type | info));
+    for (auto shift = bytes * 8; shift > 0; shift -= 8)
+        out_.push_back(static_cast<uint8_t>(arg >> (shift - 8)));
+}
+
+CPPTOML_INLINE void cbor_writer::write_text(const char* str, std::size_t len)
+{
+    write_head(3, len);
+    out_.insert(out_.end(), str, str + len);
+}
+
+CPPTOML_INLINE void cbor_writer::write(const std::string& str)
+{
+    write_text(str.data(), str.size());
+}
+
+CPPTOML_INLINE void cbor_writer::write(int64_t i)
+{
+    if (i >= 0)
+        write_head(0, static_cast<uint64_t>(i));
+    else
+        write_head(1, static_cast<uint64_t>(-(i + 1)));
+}
+
+CPPTOML_INLINE void cbor_writer::write(double d)
+{
+    uint64_t bits;
+    std::memcpy(&bits, &d, sizeof(bits));
+    out_.push_back(0xfb);
+    for (int shift = 56; shift >= 0; shift -= 8)
+        out_.push_back(static_cast<uint8_t>(bits >> shift));
+}
+
+CPPTOML_INLINE void cbor_writer::write(bool b)
+{
+    out_.push_back(b ? 0xf5 : 0xf4);
+}
+
+namespace detail
+{
+inline char* format_date(char* out, const local_date& d)
+{
+    out = format_digits(out, d.year, 4);
+    *out++ = '-';
+    out = format_digits(out, d.month, 2);
+    *out++ = '-';
+    return format_digits(out, d.day, 2);
+}
+
+inline char* format_time(char* out, const local_time& t)
+{
+    out = format_digits(out, t.hour, 2);
+    *out++ = ':';
+    out = format_digits(out, t.minute, 2);
+    *out++ = ':';
+    out = format_digits(out, t.second, 2);
+    if (t.microsecond > 0)
+    {
+        *out++ = '.';
+        out = format_digits(out, t.microsecond, 6);
+        while (out[-1] == '0')
+            --out;
+    }
+    return out;
+}
+
+inline char* format_offset(char* out, const zone_offset& z)
+{
+    if (z.hour_offset == 0 && z.minute_offset == 0)
+    {
+        *out++ = 'Z';
+        return out;
+    }
+    *out++ = z.hour_offset < 0 || z.minute_offset < 0 ? '-' : '+';
+    out = format_digits(out, z.hour_offset, 2);
+    *out++ = ':';
+    return format_digits(out, z.minute_offset, 2);
+}
+}
+
+CPPTOML_INLINE void cbor_writer::write(const local_date& d)
+{
+    char buf[64];
+    auto end = detail::format_date(buf, d);
+    write_head(6, static_cast<uint64_t>(cbor_tag::LOCAL_DATE));
+    write_text(buf, static_cast<std::size_t>(end - buf));
+}
+
+CPPTOML_INLINE void cbor_writer::write(const local_time& t)
+{
+    char buf[64];
+    auto end = detail::format_time(buf, t);
+    write_head(6, static_cast<uint64_t>(cbor_tag::LOCAL_TIME));
+    write_text(buf, static_cast<std::size_t>(end - buf));
+}
+
+CPPTOML_INLINE void cbor_writer::write(const local_datetime& dt)
+{
+    char buf[64];
+    auto end = detail::format_date(buf, dt);
+    *end++ = 'T';
+    end = detail::format_time(end, dt);
+    write_head(6, static_cast<uint64_t>(cbor_tag::LOCAL_DATETIME));
+    write_text(buf, static_cast<std::size_t>(end - buf));
+}
+
+CPPTOML_INLINE void cbor_writer::write(const offset_datetime& dt)
+{
+    char buf[64];
+    auto end = detail::format_date(buf, dt);
+    *end++ = 'T';
+    end = detail::format_time(end, dt);
+    end = detail::format_offset(end, dt);
+    write_head(6, static_cast<uint64_t>(cbor_tag::OFFSET_DATETIME));
+    write_text(buf, static_cast<std::size_t>(end - buf));
+}
+
+CPPTOML_INLINE std::vector<uint8_t> to_cbor(const table& root)
+{
+    std::vector<uint8_t> out;
+    cbor_writer writer{out};
+    root.accept(writer);
+    return out;
+}
+
+CPPTOML_INLINE std::shared_ptr<table>
+from_cbor(const uint8_t* data, std::size_t size, const parse_limits& limits)
+{
+    return detail::cbor_reader{data, size, limits}.read();
+}
+
+namespace detail
+{
+CPPTOML_INLINE std::shared_ptr<table> cbor_reader::read()
+{
+    if (size_ > limits_.max_input_bytes)
+        throw parse_exception{"Input exceeds maximum size of "
+                              + std::to_string(limits_.max_input_bytes)
+                              + " bytes"};
+
+    auto h = read_head();
+    if (h.major != 5)
+        throw_decode_exception("CBOR document is not a map");
+
+    auto root = make_table();
+    auto count = read_count(h, limits_.max_table_keys, "keys");
+    stack_.clear();
+    if (count > 0)
+        stack_.push_back({root, count, true, kind::TABLE, {}});
+
+    while (!stack_.empty())
+    {
+        if (stack_.back().is_map)
+        {
+            auto key = read_head();
+            if (key.major != 3)
+                throw_decode_exception("Map keys must be text strings");
+            stack_.back().key = read_text(key);
+            auto tbl = static_cast<table*>(stack_.back().node.get());
+            if (tbl->contains(stack_.back().key))
+                throw_decode_exception("Duplicate key \""
+                                       + stack_.back().key + "\"");
+        }
+
+        h = read_head();
+        count_node();
+        std::shared_ptr<base> value;
+        kind k;
+        if (h.major == 4)
+        {
+            count = read_count(h, limits_.max_array_elements, "elements");
+            k = kind::ARRAY;
+            if (count > 0)
+            {
+                open(nullptr, count, false);
+                continue;
+            }
+            value = make_array();
+        }
+        else if (h.major == 5)
+        {
+            count = read_count(h, limits_.max_table_keys, "keys");
+            k = kind::TABLE;
+            value = make_table();
+            if (count > 0)
+            {
+                open(std::move(value), count, true);
+                continue;
+            }
+        }
+        else
+        {
+            value = read_scalar(h, k);
+        }
+
+        // hand the value to its container, closing any containers that
+        // it completes
+        add(stack_.back(), std::move(value), k);
+        while (!stack_.empty() && stack_.back().remaining == 0)
+        {
+            auto done = std::move(stack_.back());
+            stack_.pop_back();
+            if (stack_.empty())
+                break;
+            if (!done.node)
+                done.node = make_array();
+            add(stack_.back(), std::move(done.node),
+                done.is_map ? kind::TABLE : kind::ARRAY);
+        }
+    }
+
+    if (pos_ != size_)
+        throw_decode_exception("Unexpected data after the CBOR document");
+    return root;
+}
+
+CPPTOML_INLINE void
+cbor_reader::throw_decode_exception(const std::string& err) const
+{
+    throw parse_exception{err + " at byte " + std::to_string(pos_)};
+}
+
+CPPTOML_INLINE cbor_reader::head cbor_reader::read_head()
+{
+    head h;
+    h.tagged = false;
+    h.tag = 0;
+    while (true)
+    {
+        if (pos_ == size_)
+            throw_decode_exception("Unexpected end of CBOR data");
+
+        auto initial = data_[pos_++];
+        h.major = static_cast<uint8_t>(initial >> 5);
+        h.info = static_cast<uint8_t>(initial & 0x1f);
+        if (h.info < 24)
+            h.arg = h.info;
+        else if (h.info < 28)
+            h.arg = read_uint(std::size_t{1} << (h.info - 24));
+        else if (h.info == 31)
+            throw_decode_exception(
+                "Indefinite-length CBOR items are not supported");
+        else
+            throw_decode_exception("Malformed CBOR item");
+
+        if (h.major != 6)
+            return h;
+        h.tagged = true;
+        h.tag = h.arg;
+    }
+}
+
+CPPTOML_INLINE uint64_t cbor_reader::read_uint(std::size_t bytes)
+{
+    if (size_ - pos_ < bytes)
+        throw_decode_exception("Unexpected end of CBOR data");
+    uint64_t arg = 0;
+    for (std::size_t i = 0; i < bytes; ++i)
+        arg = (arg << 8) | data_[pos_++];
+    return arg;
+}
+
+CPPTOML_INLINE std::size_t cbor_reader::read_count(const head& h,
+                                                   std::size_t limit,
+                                                   const char* what)
+{
+    if (h.arg > limit)
+        throw_decode_exception((h.major == 5 ? "Table exceeds maximum of "
+                                             : "Array exceeds maximum of ")
+                               + std::to_string(limit) + " " + what);
+
+    // every element takes at least one byte (two for a key and its value)
+    std::size_t min_size = h.major == 5 ? 2 : 1;
+    if (h.arg > (size_ - pos_) / min_size)
+        throw_decode_exception("Unexpected end of CBOR data");
+    return static_cast<std::size_t>(h.arg);
+}
+
+CPPTOML_INLINE std::string cbor_reader::read_text(const head& h)
+{
+    if (h.arg > limits_.max_string_length)
+        throw_decode_exception("String exceeds maximum length of "
+                               + std::to_string(limits_.max_string_length)
+                               + " bytes");
+    if (h.arg > size_ - pos_)
+        throw_decode_exception("Unexpected end of CBOR data");
+
+    auto len = static_cast<std::size_t>(h.arg);
+    auto str = reinterpret_cast<const char*>(data_ + pos_);
+    if (!is_valid_utf8(str, len))
+        throw_decode_exception("Invalid UTF-8 sequence");
+    pos_ += len;
+    return std::string(str, len);
+}
+
+CPPTOML_INLINE std::shared_ptr<base> cbor_reader::read_scalar(const head& h,
+                                                             kind& k)
+{
+    if (h.tagged && h.tag == static_cast<uint64_t>(cbor_tag::EPOCH_DATETIME)
+        && h.major != 3)
+    {
+        k = kind::OFFSET_DATETIME;
+        return read_epoch(h);
+    }
+
+    switch (h.major)
+    {
+        case 0:
+            if (h.arg > static_cast<uint64_t>(
+                            std::numeric_limits<int64_t>::max()))
+                throw_decode_exception("Integer out of range");
+            k = kind::INT;
+            return make_value<int64_t>(static_cast<int64_t>(h.arg));
+        case 1:
+            if (h.arg > static_cast<uint64_t>(
+                            std::numeric_limits<int64_t>::max()))
+                throw_decode_exception("Integer out of range");
+            k = kind::INT;
+            return make_value<int64_t>(-1 - static_cast<int64_t>(h.arg));
+        case 2:
+            throw_decode_exception("Byte strings are not supported");
+        case 3:
+            return read_tagged_text(h, k);
+        default:
+            break;
+    }
+
+    // major type 7: simple values and floats
+    switch (h.info)
+    {
+        case 20:
+        case 21:
+            k = kind::BOOL;
+            return make_value<bool>(h.info == 21);
+        case 22:
+            throw_decode_exception("Null values are not supported");
+        case 23:
+            throw_decode_exception("Undefined values are not supported");
+        case 25:
+        case 26:
+        case 27:
+            k = kind::FLOAT;
+            return make_value<double>(to_double(h));
+        default:
+            throw_decode_exception("Unsupported CBOR simple value");
+    }
+}
+
+CPPTOML_INLINE double cbor_reader::to_double(const head& h)
+{
+    if (h.info == 25)
+    {
+        // half precision: sign, 5 exponent bits and 10 mantissa bits
+        auto exp = static_cast<int>((h.arg >> 10) & 0x1f);
+        auto mant = static_cast<double>(h.arg & 0x3ff);
+        double d;
+        if (exp == 0)
+            d = std::ldexp(mant, -24);
+        else if (exp == 31)
+            d = mant == 0 ? std::numeric_limits<double>::infinity()
+                          : std::numeric_limits<double>::quiet_NaN();
+        else
+            d = std::ldexp(mant + 1024, exp - 25);
+        return h.arg & 0x8000 ? -d : d;
+    }
+
+    if (h.info == 26)
+    {
+        auto bits = static_cast<uint32_t>(h.arg);
+        float f;
+        std::memcpy(&f, &bits, sizeof(f));
+        return static_cast<double>(f);
+    }
+
+    double d;
+    std::memcpy(&d, &h.arg, sizeof(d));
+    return d;
+}
+
+CPPTOML_INLINE std::shared_ptr<base>
+cbor_reader::read_tagged_text(const head& h, kind& k)
+{
+    auto str = read_text(h);
+    const char* it = str.data();
+    const char* end = it + str.size();
+    if (!h.tagged)
+    {
+        k = kind::STRING;
+        return make_value<std::string>(std::move(str));
+    }
+
+    auto tag = static_cast<cbor_tag>(h.tag);
+    bool ok = true;
+    std::shared_ptr<base> result;
+    if (tag == cbor_tag::LOCAL_DATE)
+    {
+        local_date d;
+        ok = read_date_text(it, end, d);
+        k = kind::LOCAL_DATE;
+        result = make_value(d);
+    }
+    else if (tag == cbor_tag::LOCAL_TIME)
+    {
+        local_time t;
+        ok = read_time_text(it, end, t);
+        k = kind::LOCAL_TIME;
+        result = make_value(t);
+    }
+    else if (tag == cbor_tag::LOCAL_DATETIME
+             || tag == cbor_tag::OFFSET_DATETIME)
+    {
+        offset_datetime dt;
+        ok = read_date_text(it, end, dt) && it != end
+             && (*it == 'T' || *it == 't' || *it == ' ')
+             && read_time_text(++it, end, dt);
+        if (tag == cbor_tag::LOCAL_DATETIME)
+        {
+            k = kind::LOCAL_DATETIME;
+            result = make_value(static_cast<local_datetime&>(dt));
+        }
+        else
+        {
+            ok = ok && read_offset_text(it, end, dt);
+            k = kind::OFFSET_DATETIME;
+            result = make_value(dt);
+        }
+    }
+    else
+    {
+        k = kind::STRING;
+        return make_value<std::string>(std::move(str));
+    }
+
+    if (!ok || it != end)
+        throw_decode_exception("Invalid date or time \"" + str
+                               + "\" for CBOR tag "
+                               + std::to_string(h.tag));
+    return result;
+}
+
+CPPTOML_INLINE std::shared_ptr<value<offset_datetime>>
+cbor_reader::read_epoch(const head& h)
+{
+    // seconds since 1970-01-01T00:00:00Z, within years 0000 to 9999
+    const double min_seconds = -62167219200.0;
+    const double max_seconds = 253402300799.0;
+
+    double seconds;
+    if (h.major == 0)
+        seconds = static_cast<double>(h.arg);
+    else if (h.major == 1)
+        seconds = -1.0 - static_cast<double>(h.arg);
+    else if (h.major == 7 && h.info >= 25 && h.info <= 27)
+        seconds = to_double(h);
+    else
+        throw_decode_exception("Invalid epoch date/time");
+
+    if (!(seconds >= min_seconds && seconds <= max_seconds))
+        throw_decode_exception("Epoch date/time out of range");
+
+    auto whole = std::floor(seconds);
+    auto secs = static_cast<int64_t>(whole);
+    auto days = secs / 86400 - (secs % 86400 < 0 ? 1 : 0);
+    auto rem = secs - days * 86400;
+
+    // days to civil date (proleptic Gregorian), after Howard Hinnant
+    auto z = days + 719468;
+    auto era = (z >= 0 ? z : z - 146096) / 146097;
+    auto doe = z - era * 146097;
+    auto yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    auto doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    auto mp = (5 * doy + 2) / 153;
+
+    offset_datetime dt;
+    dt.day = static_cast<int>(doy - (153 * mp + 2) / 5 + 1);
+    dt.month = static_cast<int>(mp < 10 ? mp + 3 : mp - 9);
+    dt.year = static_cast<int>(yoe + era * 400 + (dt.month <= 2 ? 1 : 0));
+    dt.hour = static_cast<int>(rem / 3600);
+    dt.minute = static_cast<int>(rem % 3600 / 60);
+    dt.second = static_cast<int>(rem % 60);
+    dt.microsecond = static_cast<int>((seconds - whole) * 1000000);
+    return make_value(dt);
+}
+
+CPPTOML_INLINE void cbor_reader::open(std::shared_ptr<base> node,
+                                      std::size_t count, bool is_map)
+{
+    if (stack_.size() > limits_.max_nesting_depth)
+        throw_decode_exception("Exceeded maximum nesting depth of "
+                               + std::to_string(limits_.max_nesting_depth));
+    stack_.push_back({std::move(node), count, is_map, kind::TABLE, {}});
+}
+
+CPPTOML_INLINE void cbor_reader::add(frame& top, std::shared_ptr<base> value,
+                                     kind k)
+{
+    --top.remaining;
+    if (top.is_map)
+    {
+        static_cast<table&>(*top.node).insert(top.key, std::move(value));
+        return;
+    }
+
+    if (!top.node)
+    {
+        top.elem = k;
+        if (k == kind::TABLE)
+        {
+            auto arr = make_table_array();
+            arr->reserve(top.remaining + 1);
+            top.node = std::move(arr);
+        }
+        else
+        {
+            auto arr = make_array();
+            arr->reserve(top.remaining + 1);
+            top.node = std::move(arr);
+        }
+    }
+    else if (k != top.elem && !(top.elem == kind::FLOAT && k == kind::INT))
+    {
+        throw_decode_exception("Arrays must be homogeneous");
+    }
+
+    if (k == kind::TABLE)
+        static_cast<table_array&>(*top.node)
+            .push_back(std::static_pointer_cast<table>(value));
+    else
+        static_cast<array&>(*top.node).get().push_back(std::move(value));
+}
+
+CPPTOML_INLINE void cbor_reader::count_node()
+{
+    if (++nodes_ > limits_.max_nodes)
+        throw_decode_exception("Document exceeds maximum of "
+                               + std::to_string(limits_.max_nodes)
+                               + " nodes");
+}
+}
+#endif
+#endif
+
+/**
+ * An element visited by a tree_iterator.
+ */
+class tree_entry
+{
+  public:
+    /**
+     * The element's key path from the root, with table keys joined by
+     * dots and array indices in brackets ("servers[0].ports[1]"). Keys
+     * are not quoted. The string is only valid until the iterator moves.
+     */
+    const std::string& path() const
+    {
+        return *path_;
+    }
+
+    /**
+     * The element itself.
+     */
+    const base& node() const
+    {
+        return *node_;
+    }
+
+    /**
+     * 1 for the root's own keys, 2 for their children, and so on.
+     */
+    std::size_t depth() const
+    {
+        return depth_;
+    }
+
+  private:
+    friend class tree_iterator;
+
+    const std::string* path_ = nullptr;
+    const base* node_ = nullptr;
+    std::size_t depth_ = 0;
+};
+
+/**
+ * Visits every element below a table depth-first, in pre-order: each
+ * table, array or table array comes before its contents. Pending
+ * containers are kept on an explicit stack, so trees of any depth can be
+ * walked without recursion, and the key path is maintained in place
+ * rather than rebuilt for every element.
+ *
+ * The tree must not be modified while it is being walked.
+ */
+class tree_iterator
+{
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = tree_entry;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const tree_entry*;
+    using reference = const tree_entry&;
+
+    /**
+     * Constructs the end iterator.
+     */
+    tree_iterator()
+    {
+        entry_.path_ = &path_;
+    }
+
+    /**
+     * Constructs an iterator at the first element below root.
+     */
+    explicit tree_iterator(const table& root)
+    {
+        entry_.path_ = &path_;
+        push(root, 0);
+        advance();
+    }
+
+    tree_iterator(const tree_iterator& other)
+        : stack_(other.stack_), path_(other.path_), entry_(other.entry_)
+    {
+        entry_.path_ = &path_;
+    }
+
+    tree_iterator& operator=(const tree_iterator& other)
+    {
+        stack_ = other.stack_;
+        path_ = other.path_;
+        entry_ = other.entry_;
+        entry_.path_ = &path_;
+        return *this;
+    }
+
+    const tree_entry& operator*() const
+    {
+        return entry_;
+    }
+
+    const tree_entry* operator->() const
+    {
+        return &entry_;
+    }
+
+    tree_iterator& operator++()
+    {
+        const auto& node = *entry_.node_;
+        if (node.is_table() || node.is_array() || node.is_table_array())
+            push(node, path_.size());
+        advance();
+        return *this;
+    }
+
+    /**
+     * Moves on to the next element without visiting the contents of the
+     * current one.
+     */
+    void skip_children()
+    {
+        advance();
+    }
+
+    bool operator==(const tree_iterator& other) const
+    {
+        return entry_.node_ == other.entry_.node_;
+    }
+
+    bool operator!=(const tree_iterator& other) const
+    {
+        return entry_.node_ != other.entry_.node_;
+    }
+
+  private:
+    enum class container
+    {
+        TABLE,
+        ARRAY,
+        TABLE_ARRAY
+    };
+
+    /**
+     * A container whose elements are being visited. Only the iterators
+     * for its kind are set.
+     */
+    struct frame
+    {
+        container kind;
+        table::const_iterator key;
+        table::const_iterator key_end;
+        array::const_iterator elem;
+        array::const_iterator elem_end;
+        table_array::const_iterator row;
+        table_array::const_iterator row_end;
+        std::size_t index;
+        // the length of the container's own path
+        std::size_t path_length;
+    };
+
+    void push(const base& b, std::size_t path_length)
+    {
+        frame f{};
+        if (b.is_table())
+        {
+            const auto& t = static_cast<const table&>(b);
+            f.kind = container::TABLE;
+            f.key = t.begin();
+            f.key_end = t.end();
+        }
+        else if (b.is_array())
+        {
+            const auto& a = static_cast<const array&>(b);
+            f.kind = container::ARRAY;
+            f.elem = a.begin();
+            f.elem_end = a.end();
+        }
+        else
+        {
+            const auto& ta = static_cast<const table_array&>(b);
+            f.kind = container::TABLE_ARRAY;
+            f.row = ta.begin();
+            f.row_end = ta.end();
+        }
+        f.index = 0;
+        f.path_length = path_length;
+        stack_.push_back(f);
+    }
+
+    /**
+     * Moves to the next unvisited element on the stack, or to the end.
+     */
+    void advance()
+    {
+        while (!stack_.empty())
+        {
+            auto& f = stack_.back();
+            path_.resize(f.path_length);
+            if (f.kind == container::TABLE && f.key != f.key_end)
+            {
+                if (!path_.empty())
+                    path_ += '.';
+                path_ += f.key->first;
+                entry_.node_ = f.key->second.get();
+                entry_.depth_ = stack_.size();
+                ++f.key;
+                return;
+            }
+
+            if (f.kind == container::ARRAY && f.elem != f.elem_end)
+                entry_.node_ = (f.elem++)->get();
+            else if (f.kind == container::TABLE_ARRAY && f.row != f.row_end)
+                entry_.node_ = (f.row++)->get();
+            else
+            {
+                stack_.pop_back();
+                continue;
+            }
+
+            append_index(f.index++);
+            entry_.depth_ = stack_.size();
+            return;
+        }
+        entry_.node_ = nullptr;
+    }
+
+    /**
+     * Appends "[index]" to the path without going through a temporary
+     * string.
+     */
+    void append_index(std::size_t index)
+    {
+        char digits[24];
+        auto end = digits + sizeof(digits);
+        auto it = end;
+        *--it = ']';
+        do
+        {
+            *--it = static_cast<char>('0' + index % 10);
+            index /= 10;
+        } while (index);
+        *--it = '[';
+        path_.append(it, end);
+    }
+
+    std::vector<frame> stack_;
+    std::string path_;
+    tree_entry entry_;
+};
+
+/**
+ * The elements below a table, for use in range-based for loops.
+ */
+class tree_range
+{
+  public:
+    explicit tree_range(const table& root) : root_(root)
+    {
+        // nothing
+    }
+
+    tree_iterator begin() const
+    {
+        return tree_iterator{root_};
+    }
+
+    tree_iterator end() const
+    {
+        return tree_iterator{};
+    }
+
+  private:
+    const table& root_;
+};
+
+/**
+ * Returns a range over every element below root, depth-first:
+ *
+ *     for (const auto& entry : cpptoml::depth_first(*config))
+ *         std::cout << entry.path() << " at depth " << entry.depth() << "\n";
+ */
+inline tree_range depth_first(const table& root)
+{
+    return tree_range{root};
+}
+
+/**
+ * A table flattened into (dotted key path, element) pairs by flatten().
+ */
+using flat_table = std::vector<std::pair<std::string, std::shared_ptr<base>>>;
+
+namespace detail
+{
+/**
+ * Orders the entries of one table the way their flattened paths sort,
+ * where a non-empty table's entries all begin with its key followed by a
+ * dot and an empty table is a leaf whose path is its key.
+ */
+inline bool flat_path_less(const table::const_iterator::value_type* a,
+                           const table::const_iterator::value_type* b)
+{
+    const auto& ka = a->first;
+    const auto& kb = b->first;
+    auto n = std::min(ka.size(), kb.size());
+    auto cmp = ka.compare(0, n, kb, 0, n);
+    if (cmp != 0)
+        return cmp < 0;
+
+    // one key is a prefix of the other: compare the characters that
+    // follow it in the paths, where a leaf's path ends with its key
+    auto next = [n](const std::string& key, const base& node) {
+        if (n < key.size())
+            return static_cast<int>(static_cast<unsigned char>(key[n]));
+        return node.is_table() && !static_cast<const table&>(node).empty()
+                   ? static_cast<int>('.')
+                   : -1;
+    };
+    return next(ka, *a->second) < next(kb, *b->second);
+}
+}
+
+/**
+ * Flattens a table into its leaves, paired with their dotted key paths
+ * and sorted by path. Everything other than a non-empty table is a leaf:
+ * arrays and table arrays are kept whole, and empty tables are kept so
+ * that they survive unflatten(). The elements are shared with root, not
+ * copied.
+ *
+ * Keys are not quoted, so keys containing dots do not survive a round
+ * trip through unflatten().
+ */
+inline flat_table flatten(const table& root)
+{
+    using entry = table::const_iterator::value_type;
+
+    /**
+     * A table whose entries, sorted in order[begin, end), are being
+     * visited.
+     */
+    struct frame
+    {
+        std::size_t begin;
+        std::size_t next;
+        std::size_t end;
+        // the length of the table's own path, including its trailing dot
+        std::size_t path_length;
+    };
+
+    flat_table result;
+    std::vector<const entry*> order;
+    std::vector<frame> stack;
+    std::string path;
+
+    auto push = [&](const table& t, std::size_t path_length) {
+        auto begin = order.size();
+        for (const auto& e : t)
+            order.push_back(&e);
+        std::sort(order.begin() + static_cast<std::ptrdiff_t>(begin),
+                  order.end(), detail::flat_path_less);
+        stack.push_back({begin, begin, order.size(), path_length});
+    };
+
+    push(root, 0);
+    while (!stack.empty())
+    {
+        auto& f = stack.back();
+        if (f.next == f.end)
+        {
+            order.resize(f.begin);
+            stack.pop_back();
+            continue;
+        }
+
+        const auto& e = *order[f.next++];
+        path.resize(f.path_length);
+        path += e.first;
+        if (e.second->is_table()
+            && !static_cast<const table&>(*e.second).empty())
+        {
+            path += '.';
+            push(static_cast<const table&>(*e.second), path.size());
+        }
+        else
+        {
+            result.emplace_back(path, e.second);
+        }
+    }
+    return result;
+}
+
+/**
+ * Builds a table from (dotted key path, element) pairs, such as those
+ * produced by flatten(), in one pass over [first, last). Each element is
+ * shared, not copied, and new tables are created for the components of
+ * its path. A table element may be followed by paths below it; those are
+ * added to a copy of it (sharing its elements), so the tables in the
+ * range are never modified. The range is best sorted by path (so that
+ * each table is filled in one go) but need not be.
+ *
+ * @throw std::invalid_argument if a path is given more than once, ends
+ * at a table that paths given earlier go through, or goes through an
+ * element that is not a table
+ */
+template <class InputIterator>
+std::shared_ptr<table> unflatten(InputIterator first, InputIterator last)
+{
+    auto root = make_table();
+
+    // the tables created here, which paths may go on to fill; any other
+    // table is from the range and is copied before anything is added
+    std::unordered_set<const table*> created{root.get()};
+
+    // the tables along the previous path, with the length of each one's
+    // path (including its trailing dot)
+    std::vector<std::pair<table*, std::size_t>> open{{root.get(), 0}};
+    std::string prev;
+    std::string key;
+
+    for (; first != last; ++first)
+    {
+        const std::string& path = first->first;
+
+        // close the tables that are not on this path
+        while (open.size() > 1)
+        {
+            auto length = open.back().second;
+            if (path.size() > length
+                && path.compare(0, length, prev, 0, length) == 0)
+                break;
+            open.pop_back();
+        }
+
+        auto pos = open.back().second;
+        for (auto dot = path.find('.', pos); dot != std::string::npos;
+             dot = path.find('.', pos))
+        {
+            key.assign(path, pos, dot - pos);
+            auto tbl = open.back().first;
+            auto sub = tbl->get_table(key);
+            if (!sub && tbl->contains(key))
+                throw std::invalid_argument{
+                    path + " goes through an element that is not a table"};
+            if (!sub || created.count(sub.get()) == 0)
+            {
+                auto copy = make_table();
+                if (sub)
+                {
+                    for (const auto& e : *sub)
+                        copy->insert(e.first, e.second);
+                }
+                tbl->insert(key, copy);
+                created.insert(copy.get());
+                sub = copy;
+            }
+            pos = dot + 1;
+            open.emplace_back(sub.get(), pos);
+        }
+
+        key.assign(path, pos, std::string::npos);
+        auto tbl = open.back().first;
+        if (tbl->contains(key))
+            throw std::invalid_argument{path + " is already defined"};
+        tbl->insert(key, first->second);
+        prev = path;
+    }
+    return root;
+}
+
+namespace detail
+{
+[[noreturn]] inline void decode_error(const decode_path& path,
+                                      const std::string& what)
+{
+    throw parse_exception{path.str() + ": " + what};
+}
+
+template <class T>
+void decode_scalar(const base& b, T& out, const decode_path& path,
+                   const char* what)
+{
+    auto v = dynamic_cast<const value<T>*>(&b);
+    if (!v)
+        decode_error(path, std::string{"expected "} + what);
+    out = v->get();
+}
+
+inline void decode_value(const base& b, std::string& out,
+                         const decode_path& path)
+{
+    decode_scalar(b, out, path, "a string");
+}
+
+inline void decode_value(const base& b, int64_t& out, const decode_path& path)
+{
+    decode_scalar(b, out, path, "an integer");
+}
+
+inline void decode_value(const base& b, double& out, const decode_path& path)
+{
+    // integers are accepted as floats, as with base::as<double>()
+    if (auto i = dynamic_cast<const value<int64_t>*>(&b))
+        out = static_cast<double>(i->get());
+    else
+        decode_scalar(b, out, path, "a float");
+}
+
+inline void decode_value(const base& b, bool& out, const decode_path& path)
+{
+    decode_scalar(b, out, path, "a boolean");
+}
+
+inline void decode_value(const base& b, local_date& out,
+                         const decode_path& path)
+{
+    decode_scalar(b, out, path, "a local date");
+}
+
+inline void decode_value(const base& b, local_time& out,
+                         const decode_path& path)
+{
+    decode_scalar(b, out, path, "a local time");
+}
+
+inline void decode_value(const base& b, local_datetime& out,
+                         const decode_path& path)
+{
+    decode_scalar(b, out, path, "a local date-time");
+}
+
+inline void decode_value(const base& b, offset_datetime& out,
+                         const decode_path& path)
+{
+    decode_scalar(b, out, path, "an offset date-time");
+}
+
+template <class T>
+void decode_value(const base& b, option<T>& out, const decode_path& path);
+
+template <class T>
+void decode_value(const base& b, std::vector<T>& out,
+                  const decode_path& path);
+
+/**
+ * Decodes a table into a generated struct with the decode() overload
+ * generated for it, which is found by argument-dependent lookup.
+ */
+template <class T>
+void decode_value(const base& b, T& out, const decode_path& path)
+{
+    if (!b.is_table())
+        decode_error(path, "expected a table");
+    decode(static_cast<const table&>(b), out, path);
+}
+
+template <class T>
+void decode_value(const base& b, option<T>& out, const decode_path& path)
+{
+    T v{};
+    decode_value(b, v, path);
+    out = option<T>{std::move(v)};
+}
+
+/**
+ * Decodes an array, or a table array into a vector of structs.
+ */
+template <class T>
+void decode_value(const base& b, std::vector<T>& out,
+                  const decode_path& path)
+{
+    auto add = [&](const base& elem, std::size_t i) {
+        // a temporary rather than out[i], which std::vector<bool> lacks
+        T v{};
+        decode_value(elem, v, decode_path{&path, nullptr, i});
+        out.push_back(std::move(v));
+    };
+
+    out.clear();
+    if (b.is_array())
+    {
+        const auto& elems = static_cast<const array&>(b).get();
+        out.reserve(elems.size());
+        for (std::size_t i = 0; i < elems.size(); ++i)
+            add(*elems[i], i);
+    }
+    else if (b.is_table_array())
+    {
+        const auto& tables = static_cast<const table_array&>(b).get();
+        out.reserve(tables.size());
+        for (std::size_t i = 0; i < tables.size(); ++i)
+            add(*tables[i], i);
+    }
+    else
+    {
+        decode_error(path, "expected an array");
+    }
+}
+}
+
+#if defined(CPPTOML_HAS_STATIC_DOCUMENTS)
+/**
+ * The type of a node in a static_document.
+ */
+enum class static_type
+{
+    TABLE,
+    TABLE_ARRAY,
+    ARRAY,
+    STRING,
+    INTEGER,
+    FLOAT,
+    BOOLEAN,
+    LOCAL_DATE,
+    LOCAL_TIME,
+    LOCAL_DATETIME,
+    OFFSET_DATETIME
+};
+
+template <std::size_t Capacity>
+class static_document;
+
+/**
+ * A table, array or value in a static_document. Strings and floats are
+ * kept as the text they were written as (validated when the document was
+ * parsed) and converted when they are read; everything else is converted
+ * while parsing.
+ */
+class static_node
+{
+  public:
+    template <std::size_t>
+    friend class static_document;
+
+    constexpr static_type type() const
+    {
+        return type_;
+    }
+
+  private:
+    static_type type_ = static_type::TABLE;
+    // the index of the table or array holding this node
+    std::size_t parent_ = 0;
+    // the key naming this node in its table, empty in arrays
+    const char* key_ = nullptr;
+    std::size_t key_length_ = 0;
+    // the contents of a string between its quotes, or a float as written
+    const char* text_ = nullptr;
+    std::size_t text_length_ = 0;
+    char delim_ = 0;
+    bool multiline_ = false;
+    std::size_t line_ = 0;
+    int64_t integer_ = 0;
+    offset_datetime datetime_;
+};
+
+namespace detail
+{
+/**
+ * Reports a malformed static document. It is not constexpr, so reaching
+ * it while a document is parsed at compile time is a compile error (one
+ * that names the message).
+ */
+[[noreturn]] inline void static_parse_error(const char* what,
+                                            std::size_t line)
+{
+    throw parse_exception{what, line};
+}
+
+/**
+ * Reports a missing or mistyped key in a static document, likewise at
+ * compile time when the lookup is.
+ */
+[[noreturn]] inline void static_lookup_error(const char* what)
+{
+    throw std::out_of_range{what};
+}
+
+template <class T>
+struct static_tag
+{
+};
+
+/**
+ * Decodes the contents of a string in a static document (already
+ * validated), exactly as the parser would have read them.
+ */
+inline std::string decode_static_string(const char* text, std::size_t len,
+                                        char delim, bool multiline)
+{
+    std::string out;
+    auto end = text + len;
+    auto is_ws = [](char c) { return c == ' ' || c == '\t'; };
+
+    // decodes the escape sequence at it (already validated)
+    auto escape = [&](const char*& it) {
+        ++it;
+        switch (*it)
+        {
+            case 'b':
+                out += '\b';
+                break;
+            case 't':
+                out += '\t';
+                break;
+            case 'n':
+                out += '\n';
+                break;
+            case 'f':
+                out += '\f';
+                break;
+            case 'r':
+                out += '\r';
+                break;
+            case 'u':
+            case 'U':
+            {
+                auto digits = *it == 'U' ? 8 : 4;
+                uint32_t cp = 0;
+                for (int i = 0; i < digits; ++i)
+                {
+                    char c = *++it;
+                    cp = cp * 16
+                         + static_cast<uint32_t>(
+                               is_number(c) ? c - '0' : 10 + (c | 0x20) - 'a');
+                }
+                if (cp <= 0x7f)
+                {
+                    out += static_cast<char>(cp);
+                }
+                else if (cp <= 0x7ff)
+                {
+                    out += static_cast<char>(0xc0 | (cp >> 6));
+                    out += static_cast<char>(0x80 | (cp & 0x3f));
+                }
+                else if (cp <= 0xffff)
+                {
+                    out += static_cast<char>(0xe0 | (cp >> 12));
+                    out += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+                    out += static_cast<char>(0x80 | (cp & 0x3f));
+                }
+                else
+                {
+                    out += static_cast<char>(0xf0 | (cp >> 18));
+                    out += static_cast<char>(0x80 | ((cp >> 12) & 0x3f));
+                    out += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+                    out += static_cast<char>(0x80 | (cp & 0x3f));
+                }
+                break;
+            }
+            default:
+                // '"' or '\\'
+                out += *it;
+        }
+        ++it;
+    };
+
+    if (!multiline)
+    {
+        for (auto it = text; it != end;)
+        {
+            if (delim == '"' && *it == '\\')
+                escape(it);
+            else
+                out += *it++;
+        }
+        return out;
+    }
+
+    // the parser reads a multi-line string a line at a time: the rest of
+    // the opening line, with no newline after it, then whole lines, each
+    // but the closing one followed by a newline unless it ended with a
+    // backslash
+    bool consuming = false;
+    bool first = true;
+    for (auto it = text;;)
+    {
+        auto eol = std::find(it, end, '\n');
+        auto line_end = eol != end && eol != it && eol[-1] == '\r' ? eol - 1
+                                                                    : eol;
+        if (consuming)
+            it = std::find_if_not(it, line_end, is_ws);
+        if (!consuming || it != line_end)
+        {
+            consuming = false;
+            while (it != line_end)
+            {
+                if (delim == '"' && *it == '\\')
+                {
+                    if (std::find_if_not(it + 1, line_end, is_ws) == line_end)
+                    {
+                        consuming = true;
+                        break;
+                    }
+                    escape(it);
+                }
+                else
+                {
+                    out += *it++;
+                }
+            }
+        }
+
+        if (eol == end)
+            return out;
+        if (!first && !consuming)
+            out += '\n';
+        first = false;
+        it = eol + 1;
+    }
+}
+
+/**
+ * Converts a float in a static document (already validated) the way the
+ * parser does.
+ */
+inline double convert_static_float(const char* text, std::size_t len,
+                                   std::size_t line)
+{
+    std::string number;
+    std::remove_copy(text, text + len, std::back_inserter(number), '_');
+    try
+    {
+        return std::stod(number);
+    }
+    catch (const std::out_of_range& ex)
+    {
+        throw parse_exception{"Malformed number (out of range: "
+                                  + std::string{ex.what()} + ")",
+                              line};
+    }
+}
+}
+
+/**
+ * A TOML document parsed at compile time, typically a program's built-in
+ * defaults:
+ *
+ *     constexpr auto defaults = cpptoml::make_static_document<8>(R"(
+ *         [server]
+ *         host = "localhost"
+ *         port = 8080
+ *     )");
+ *     static_assert(defaults.at_qualified<int64_t>("server.port") == 8080,
+ *                   "");
+ *
+ * The document is a constant, so it is built into the program's
+ * read-only data and nothing is parsed at startup; a malformed document
+ * fails to compile. It holds at most Capacity nodes (keys, tables and
+ * array elements) and keeps pointers into the text it was parsed from.
+ * It accepts what parser does, except that quoted keys may not contain
+ * escape sequences, and rejects a few malformed table headers that parser
+ * lets through.
+ *
+ * Lookups of integers, booleans, dates and times are constexpr. Strings
+ * and floats are read at run time, as is to_table(), which builds the
+ * equivalent cpptoml::table without parsing anything.
+ */
+template <std::size_t Capacity>
+class static_document
+{
+  public:
+    constexpr static_document(const char* text, std::size_t length)
+        : text_{text}, length_{length}, nodes_{}, size_{1}
+    {
+        parse();
+    }
+
+    /**
+     * The number of nodes in the document, which is as small as Capacity
+     * can be.
+     */
+    constexpr std::size_t size() const
+    {
+        return size_ - 1;
+    }
+
+    constexpr bool contains_qualified(const char* key) const
+    {
+        return find_qualified(key) != npos;
+    }
+
+    /**
+     * The node with the given dotted key, or nullptr if there is none.
+     */
+    constexpr const static_node* get_qualified(const char* key) const
+    {
+        auto i = find_qualified(key);
+        return i == npos ? nullptr : &nodes_[i];
+    }
+
+    /**
+     * The value with the given dotted key, which must be a std::string,
+     * int64_t, double, bool or date or time type. Integers are read as
+     * doubles too, as with base::as<double>(). Constexpr except for
+     * strings and doubles.
+     *
+     * @throw std::out_of_range if there is no such value or it has a
+     * different type
+     */
+    template <class T>
+    constexpr T at_qualified(const char* key) const
+    {
+        static_assert(valid_value<T>::value,
+                      "at_qualified() reads TOML value types");
+        auto i = find_qualified(key);
+        if (i == npos)
+            detail::static_lookup_error("key not found in static document");
+        return read(nodes_[i], detail::static_tag<T>{});
+    }
+
+    /**
+     * The value with the given dotted key, if there is one of type T.
+     */
+    template <class T>
+    option<T> get_qualified_as(const char* key) const
+    {
+        static_assert(valid_value<T>::value,
+                      "get_qualified_as() reads TOML value types");
+        auto i = find_qualified(key);
+        if (i == npos || !holds(nodes_[i], detail::static_tag<T>{}))
+            return {};
+        return {read(nodes_[i], detail::static_tag<T>{})};
+    }
+
+    /**
+     * Builds the table that parsing the document's text would produce.
+     */
+    std::shared_ptr<table> to_table() const;
+
+  private:
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+    /**
+     * The part of the text left to parse.
+     */
+    struct cursor
+    {
+        const char* it;
+        const char* end;
+        std::size_t line;
+    };
 
-        return ltime;
+    static constexpr bool is_digit(char c)
+    {
+        return c >= '0' && c <= '9';
     }
 
-    std::shared_ptr<value<local_time>>
-    parse_time(std::string::iterator& it, const std::string::iterator& end)
+    static constexpr bool is_hex_digit(char c)
     {
-        return make_value(read_time(it, end));
+        return is_digit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
     }
 
-    std::shared_ptr<base> parse_date(std::string::iterator& it,
-                                     const std::string::iterator& end)
+    static constexpr std::size_t newline_length(const cursor& c)
     {
-        auto date_end = find_end_of_date(it, end);
-
-        auto eat = make_consumer(
-            it, date_end, [&]() { throw_parse_exception("Malformed date"); });
-
-        local_date ldate;
-        ldate.year = eat.eat_digits(4);
-        eat('-');
-        ldate.month = eat.eat_digits(2);
-        eat('-');
-        ldate.day = eat.eat_digits(2);
-
-        if (it == date_end)
-            return make_value(ldate);
-
-        eat('T');
-
-        local_datetime ldt;
-        static_cast<local_date&>(ldt) = ldate;
-        static_cast<local_time&>(ldt) = read_time(it, date_end);
+        if (c.it == c.end)
+            return 0;
+        if (*c.it == '\n')
+            return 1;
+        return *c.it == '\r' && c.end - c.it > 1 && c.it[1] == '\n' ? 2 : 0;
+    }
 
-        if (it == date_end)
-            return make_value(ldt);
+    static constexpr void skip_whitespace(cursor& c)
+    {
+        while (c.it != c.end && (*c.it == ' ' || *c.it == '\t'))
+            ++c.it;
+    }
 
-        offset_datetime dt;
-        static_cast<local_datetime&>(dt) = ldt;
+    static constexpr void skip_comment(cursor& c)
+    {
+        while (c.it != c.end && newline_length(c) == 0)
+            ++c.it;
+    }
 
-        int hoff = 0;
-        int moff = 0;
-        if (*it == '+' || *it == '-')
-        {
-            auto plus = *it == '+';
-            ++it;
+    static constexpr void next_line(cursor& c)
+    {
+        c.it += newline_length(c);
+        ++c.line;
+    }
 
-            hoff = eat.eat_digits(2);
-            dt.hour_offset = (plus) ? hoff : -hoff;
-            eat(':');
-            moff = eat.eat_digits(2);
-            dt.minute_offset = (plus) ? moff : -moff;
-        }
-        else if (*it == 'Z')
+    /**
+     * Skips whitespace, comments and line breaks between the elements of
+     * an array.
+     */
+    static constexpr void skip_array_space(cursor& c)
+    {
+        while (true)
         {
-            ++it;
+            skip_whitespace(c);
+            if (c.it != c.end && *c.it == '#')
+                skip_comment(c);
+            if (c.it == c.end)
+                detail::static_parse_error("Unclosed array", c.line);
+            if (newline_length(c) == 0)
+                return;
+            next_line(c);
         }
-
-        if (it != date_end)
-            throw_parse_exception("Malformed date");
-
-        return make_value(dt);
     }
 
-    std::shared_ptr<base> parse_array(std::string::iterator& it,
-                                      std::string::iterator& end)
+    static constexpr bool same_key(const char* a, std::size_t a_len,
+                                   const char* b, std::size_t b_len)
     {
-        // this gets ugly because of the "homogeneity" restriction:
-        // arrays can either be of only one type, or contain arrays
-        // (each of those arrays could be of different types, though)
-        //
-        // because of the latter portion, we don't really have a choice
-        // but to represent them as arrays of base values...
-        ++it;
-
-        // ugh---have to read the first value to determine array type...
-        skip_whitespace_and_comments(it, end);
-
-        // edge case---empty array
-        if (*it == ']')
-        {
-            ++it;
-            return make_array();
-        }
-
-        auto val_end = std::find_if(
-            it, end, [](char c) { return c == ',' || c == ']' || c == '#'; });
-        parse_type type = determine_value_type(it, val_end);
-        switch (type)
-        {
-            case parse_type::STRING:
-                return parse_value_array<std::string>(it, end);
-            case parse_type::LOCAL_TIME:
-                return parse_value_array<local_time>(it, end);
-            case parse_type::LOCAL_DATE:
-                return parse_value_array<local_date>(it, end);
-            case parse_type::LOCAL_DATETIME:
-                return parse_value_array<local_datetime>(it, end);
-            case parse_type::OFFSET_DATETIME:
-                return parse_value_array<offset_datetime>(it, end);
-            case parse_type::INT:
-                return parse_value_array<int64_t>(it, end);
-            case parse_type::FLOAT:
-                return parse_value_array<double>(it, end);
-            case parse_type::BOOL:
-                return parse_value_array<bool>(it, end);
-            case parse_type::ARRAY:
-                return parse_object_array<array>(&parser::parse_array, '[', it,
-                                                 end);
-            case parse_type::INLINE_TABLE:
-                return parse_object_array<table_array>(
-                    &parser::parse_inline_table, '{', it, end);
-            default:
-                throw_parse_exception("Unable to parse array");
-        }
+        if (a_len != b_len)
+            return false;
+        for (std::size_t i = 0; i < a_len; ++i)
+            if (a[i] != b[i])
+                return false;
+        return true;
     }
 
-    template <class Value>
-    std::shared_ptr<array> parse_value_array(std::string::iterator& it,
-                                             std::string::iterator& end)
+    constexpr std::size_t find_child(std::size_t parent, const char* key,
+                                     std::size_t len) const
     {
-        auto arr = make_array();
-        while (it != end && *it != ']')
+        for (std::size_t i = parent + 1; i < size_; ++i)
         {
-            auto value = parse_value(it, end);
-            if (auto v = value->as<Value>())
-                arr->get().push_back(value);
-            else
-                throw_parse_exception("Arrays must be heterogeneous");
-            skip_whitespace_and_comments(it, end);
-            if (*it != ',')
-                break;
-            ++it;
-            skip_whitespace_and_comments(it, end);
+            if (nodes_[i].parent_ == parent
+                && same_key(nodes_[i].key_, nodes_[i].key_length_, key, len))
+                return i;
         }
-        if (it != end)
-            ++it;
-        return arr;
+        return npos;
     }
 
-    template <class Object, class Function>
-    std::shared_ptr<Object> parse_object_array(Function&& fun, char delim,
-                                               std::string::iterator& it,
-                                               std::string::iterator& end)
+    constexpr std::size_t last_child(std::size_t parent) const
     {
-        auto arr = make_element<Object>();
+        for (std::size_t i = size_ - 1; i > parent; --i)
+            if (nodes_[i].parent_ == parent)
+                return i;
+        return npos;
+    }
 
-        while (it != end && *it != ']')
+    constexpr std::size_t find_qualified(const char* key) const
+    {
+        std::size_t node = 0;
+        while (true)
         {
-            if (*it != delim)
-                throw_parse_exception("Unexpected character in array");
-
-            arr->get().push_back(((*this).*fun)(it, end));
-            skip_whitespace_and_comments(it, end);
-
-            if (*it != ',')
-                break;
-
-            ++it;
-            skip_whitespace_and_comments(it, end);
+            std::size_t len = 0;
+            while (key[len] != '\0' && key[len] != '.')
+                ++len;
+            if (node != 0 && nodes_[node].type_ != static_type::TABLE)
+                return npos;
+            node = find_child(node, key, len);
+            if (node == npos || key[len] == '\0')
+                return node;
+            key += len + 1;
         }
-
-        if (it == end || *it != ']')
-            throw_parse_exception("Unterminated array");
-
-        ++it;
-        return arr;
     }
 
-    std::shared_ptr<table> parse_inline_table(std::string::iterator& it,
-                                              std::string::iterator& end)
+    constexpr std::size_t add_node(static_type type, std::size_t parent,
+                                   const char* key, std::size_t len,
+                                   std::size_t line)
     {
-        auto tbl = make_table();
-        do
-        {
-            ++it;
-            if (it == end)
-                throw_parse_exception("Unterminated inline table");
-
-            consume_whitespace(it, end);
-            parse_key_value(it, end, tbl.get());
-            consume_whitespace(it, end);
-        } while (*it == ',');
-
-        if (it == end || *it != '}')
-            throw_parse_exception("Unterminated inline table");
-
-        ++it;
-        consume_whitespace(it, end);
-
-        return tbl;
+        if (size_ == Capacity + 1)
+            detail::static_parse_error(
+                "Static document has more nodes than its capacity", line);
+        nodes_[size_].type_ = type;
+        nodes_[size_].parent_ = parent;
+        nodes_[size_].key_ = key;
+        nodes_[size_].key_length_ = len;
+        nodes_[size_].line_ = line;
+        return size_++;
     }
 
-    void skip_whitespace_and_comments(std::string::iterator& start,
-                                      std::string::iterator& end)
+    constexpr bool has_value(std::size_t tbl) const
     {
-        consume_whitespace(start, end);
-        while (start == end || *start == '#')
+        for (std::size_t i = tbl + 1; i < size_; ++i)
         {
-            if (!detail::getline(input_, line_))
-                throw_parse_exception("Unclosed array");
-            line_number_++;
-            start = line_.begin();
-            end = line_.end();
-            consume_whitespace(start, end);
+            if (nodes_[i].parent_ == tbl
+                && nodes_[i].type_ != static_type::TABLE
+                && nodes_[i].type_ != static_type::TABLE_ARRAY)
+                return true;
         }
+        return false;
     }
 
-    void consume_whitespace(std::string::iterator& it,
-                            const std::string::iterator& end)
+    constexpr void check_utf8() const
     {
-        while (it != end && (*it == ' ' || *it == '\t'))
-            ++it;
-    }
+        std::size_t line = 1;
+        std::size_t i = 0;
+        while (i < length_)
+        {
+            auto b = static_cast<unsigned char>(text_[i++]);
+            if (b == '\n')
+                ++line;
+            if (b < 0x80)
+                continue;
 
-    void consume_backwards_whitespace(std::string::iterator& back,
-                                      const std::string::iterator& front)
-    {
-        while (back != front && (*back == ' ' || *back == '\t'))
-            --back;
+            std::size_t more = b >= 0xc2 && b <= 0xdf
+                                   ? 1
+                                   : b >= 0xe0 && b <= 0xef
+                                         ? 2
+                                         : b >= 0xf0 && b <= 0xf4 ? 3 : 0;
+            // the second byte is narrowed to rule out overlong forms,
+            // surrogates and code points beyond U+10FFFF
+            unsigned char lo = b == 0xe0 ? 0xa0 : b == 0xf0 ? 0x90 : 0x80;
+            unsigned char hi = b == 0xed ? 0x9f : b == 0xf4 ? 0x8f : 0xbf;
+            if (more == 0 || length_ - i < more)
+                detail::static_parse_error("Invalid UTF-8 sequence", line);
+            for (std::size_t j = 0; j < more; ++j)
+            {
+                auto cont = static_cast<unsigned char>(text_[i++]);
+                if (cont < (j == 0 ? lo : 0x80) || cont > (j == 0 ? hi : 0xbf))
+                    detail::static_parse_error("Invalid UTF-8 sequence",
+                                               line);
+            }
+        }
     }
 
-    void eol_or_comment(const std::string::iterator& it,
-                        const std::string::iterator& end)
+    constexpr void parse()
     {
-        if (it != end && *it != '#')
-            throw_parse_exception("Unidentified trailing character '"
-                                  + std::string{*it}
-                                  + "'---did you forget a '#'?");
+        check_utf8();
+        cursor c{text_, text_ + length_, 1};
+        std::size_t tbl = 0;
+        while (true)
+        {
+            skip_whitespace(c);
+            if (c.it == c.end)
+                return;
+            if (*c.it == '[')
+                tbl = parse_header(c);
+            else if (*c.it != '#' && newline_length(c) == 0)
+                parse_key_value(c, tbl);
+
+            skip_whitespace(c);
+            if (c.it != c.end && *c.it == '#')
+                skip_comment(c);
+            if (c.it == c.end)
+                return;
+            if (newline_length(c) == 0)
+                detail::static_parse_error(
+                    "Unidentified trailing character---did you forget a "
+                    "'#'?",
+                    c.line);
+            next_line(c);
+        }
     }
 
-    bool is_time(const std::string::iterator& it,
-                 const std::string::iterator& end)
+    /**
+     * Reads a bare or quoted key, ending a bare key at whitespace and
+     * either '=' or, in a table header, '.' or ']'. A bare key may not be
+     * empty.
+     */
+    static constexpr const char* parse_key(cursor& c, bool header,
+                                           std::size_t& len)
     {
-        auto time_end = find_end_of_time(it, end);
-        auto len = std::distance(it, time_end);
-
-        if (len < 8)
-            return false;
-
-        if (it[2] != ':' || it[5] != ':')
-            return false;
-
-        if (len > 8)
-            return it[8] == '.' && len > 9;
+        skip_whitespace(c);
+        auto begin = c.it;
+        if (c.it != c.end && *c.it == '"')
+        {
+            ++begin;
+            ++c.it;
+            while (c.it != c.end && *c.it != '"' && newline_length(c) == 0)
+            {
+                if (*c.it == '\\')
+                    detail::static_parse_error(
+                        "Quoted keys in static documents cannot contain "
+                        "escape sequences",
+                        c.line);
+                ++c.it;
+            }
+            if (c.it == c.end || *c.it != '"')
+                detail::static_parse_error("Unterminated string literal",
+                                           c.line);
+            len = static_cast<std::size_t>(c.it++ - begin);
+            skip_whitespace(c);
+            return begin;
+        }
 
-        return true;
+        while (c.it != c.end && *c.it != ' ' && *c.it != '\t'
+               && newline_length(c) == 0
+               && (header ? *c.it != '.' && *c.it != ']' : *c.it != '='))
+        {
+            if (*c.it == '#')
+                detail::static_parse_error("Bare key cannot contain #",
+                                           c.line);
+            if (*c.it == '[' || *c.it == ']')
+                detail::static_parse_error(
+                    "Bare key cannot contain '[' or ']'", c.line);
+            ++c.it;
+        }
+        len = static_cast<std::size_t>(c.it - begin);
+        if (len == 0)
+            detail::static_parse_error(header
+                                           ? "Empty component of table name"
+                                           : "Bare key missing name",
+                                       c.line);
+        skip_whitespace(c);
+        return begin;
     }
 
-    option<parse_type> date_type(const std::string::iterator& it,
-                                 const std::string::iterator& end)
+    /**
+     * Parses a [table] or [[table array]] header, returning the table
+     * that the keys below it go into.
+     */
+    constexpr std::size_t parse_header(cursor& c)
     {
-        auto date_end = find_end_of_date(it, end);
-        auto len = std::distance(it, date_end);
-
-        if (len < 10)
-            return {};
+        ++c.it;
+        bool is_array = c.it != c.end && *c.it == '[';
+        if (is_array)
+            ++c.it;
+        skip_whitespace(c);
+        if (c.it == c.end || *c.it == ']')
+            detail::static_parse_error("Table name cannot be empty", c.line);
 
-        if (it[4] != '-' || it[7] != '-')
-            return {};
-
-        if (len >= 19 && it[10] == 'T' && is_time(it + 11, date_end))
+        std::size_t node = 0;
+        bool inserted = false;
+        while (true)
         {
-            // datetime type
-            auto time_end = find_end_of_time(it + 11, date_end);
-            if (time_end == date_end)
-                return {parse_type::LOCAL_DATETIME};
+            std::size_t len = 0;
+            auto key = parse_key(c, true, len);
+            if (c.it == c.end || (*c.it != '.' && *c.it != ']'))
+                detail::static_parse_error(
+                    "Unterminated table declaration; did you forget a "
+                    "']'?",
+                    c.line);
+            bool last = *c.it == ']';
+            ++c.it;
+
+            auto child = find_child(node, key, len);
+            if (last && is_array)
+            {
+                if (child == npos)
+                    child = add_node(static_type::TABLE_ARRAY, node, key, len,
+                                     c.line);
+                else if (nodes_[child].type_ != static_type::TABLE_ARRAY)
+                    detail::static_parse_error("Key is not a table array",
+                                               c.line);
+                node = add_node(static_type::TABLE, child, nullptr, 0, c.line);
+                inserted = true;
+            }
+            else if (child == npos)
+            {
+                node = add_node(static_type::TABLE, node, key, len, c.line);
+                inserted = true;
+            }
+            else if (nodes_[child].type_ == static_type::TABLE)
+            {
+                node = child;
+            }
+            else if (nodes_[child].type_ == static_type::TABLE_ARRAY)
+            {
+                node = last_child(child);
+            }
             else
-                return {parse_type::OFFSET_DATETIME};
-        }
-        else if (len == 10)
-        {
-            // just a regular date
-            return {parse_type::LOCAL_DATE};
+            {
+                detail::static_parse_error("Key already exists as a value",
+                                           c.line);
+            }
+
+            if (last)
+                break;
+            skip_whitespace(c);
+            if (c.it != c.end && *c.it == ']')
+                detail::static_parse_error("Empty component of table name",
+                                           c.line);
         }
 
-        return {};
+        if (is_array && (c.it == c.end || *c.it++ != ']'))
+            detail::static_parse_error("Unterminated table array name",
+                                       c.line);
+
+        // a table that already existed may only be named again if it was
+        // created implicitly, by a header naming one of its tables
+        if (!inserted && (last_child(node) == npos || has_value(node)))
+            detail::static_parse_error("Redefinition of table", c.line);
+        return node;
+    }
+
+    constexpr void parse_key_value(cursor& c, std::size_t tbl)
+    {
+        std::size_t len = 0;
+        auto key = parse_key(c, false, len);
+        if (find_child(tbl, key, len) != npos)
+            detail::static_parse_error("Key already present", c.line);
+        if (c.it == c.end || *c.it != '=')
+            detail::static_parse_error("Value must follow after a '='",
+                                       c.line);
+        ++c.it;
+        skip_whitespace(c);
+        parse_value(c, tbl, key, len);
+    }
+
+    constexpr std::size_t parse_value(cursor& c, std::size_t parent,
+                                      const char* key, std::size_t len)
+    {
+        if (c.it == c.end || newline_length(c) != 0)
+            detail::static_parse_error("Failed to parse value type", c.line);
+
+        auto node = add_node(static_type::TABLE, parent, key, len, c.line);
+        if (*c.it == '"' || *c.it == '\'')
+            parse_string(c, nodes_[node]);
+        else if (time_length(c.it, c.end) != 0)
+            parse_time(c, nodes_[node]);
+        else if (is_date(c))
+            parse_date(c, nodes_[node]);
+        else if (is_digit(*c.it) || *c.it == '-' || *c.it == '+')
+            parse_number(c, nodes_[node]);
+        else if (*c.it == 't' || *c.it == 'f')
+            parse_bool(c, nodes_[node]);
+        else if (*c.it == '[')
+            parse_array(c, node);
+        else if (*c.it == '{')
+            parse_inline_table(c, node);
+        else
+            detail::static_parse_error("Failed to parse value type", c.line);
+        return node;
     }
 
-    std::istream& input_;
-    std::string line_;
-    std::size_t line_number_ = 0;
-};
-
-/**
- * Utility function to parse a file as a TOML file. Returns the root table.
- * Throws a parse_exception if the file cannot be opened.
- */
-inline std::shared_ptr<table> parse_file(const std::string& filename)
-{
-#if defined(BOOST_NOWIDE_FSTREAM_INCLUDED_HPP)
-    boost::nowide::ifstream file{filename.c_str()};
-#elif defined(NOWIDE_FSTREAM_INCLUDED_HPP)
-    nowide::ifstream file{filename.c_str()};
-#else
-    std::ifstream file{filename};
-#endif
-    if (!file.is_open())
-        throw parse_exception{filename + " could not be opened for parsing"};
-    parser p{file};
-    return p.parse();
-}
-
-template <class... Ts>
-struct value_accept;
-
-template <>
-struct value_accept<>
-{
-    template <class Visitor, class... Args>
-    static void accept(const base&, Visitor&&, Args&&...)
+    constexpr void parse_array(cursor& c, std::size_t node)
     {
-        // nothing
+        nodes_[node].type_ = static_type::ARRAY;
+        ++c.it;
+        skip_array_space(c);
+        if (*c.it == '{')
+            nodes_[node].type_ = static_type::TABLE_ARRAY;
+
+        auto first = npos;
+        while (*c.it != ']')
+        {
+            auto elem = parse_value(c, node, nullptr, 0);
+            if (first == npos)
+                first = elem;
+            check_array_element(nodes_[node].type_, nodes_[first].type_,
+                                nodes_[elem].type_, c.line);
+
+            skip_array_space(c);
+            if (*c.it == ',')
+            {
+                ++c.it;
+                skip_array_space(c);
+            }
+            else if (*c.it != ']')
+            {
+                detail::static_parse_error("Unterminated array", c.line);
+            }
+        }
+        ++c.it;
     }
-};
 
-template <class T, class... Ts>
-struct value_accept<T, Ts...>
-{
-    template <class Visitor, class... Args>
-    static void accept(const base& b, Visitor&& visitor, Args&&... args)
+    static constexpr void check_array_element(static_type array,
+                                              static_type first,
+                                              static_type elem,
+                                              std::size_t line)
     {
-        if (auto v = b.as<T>())
+        if (array == static_type::TABLE_ARRAY)
         {
-            visitor.visit(*v, std::forward<Args>(args)...);
+            if (elem != static_type::TABLE)
+                detail::static_parse_error("Unexpected character in array",
+                                           line);
         }
-        else
+        else if (elem == static_type::TABLE
+                 || (elem != first
+                     && !(first == static_type::FLOAT
+                          && elem == static_type::INTEGER)))
         {
-            value_accept<Ts...>::accept(b, std::forward<Visitor>(visitor),
-                                        std::forward<Args>(args)...);
+            detail::static_parse_error("Arrays must be homogeneous", line);
         }
     }
-};
 
-/**
- * base implementation of accept() that calls visitor.visit() on the concrete
- * class.
- */
-template <class Visitor, class... Args>
-void base::accept(Visitor&& visitor, Args&&... args) const
-{
-    if (is_value())
-    {
-        using value_acceptor
-            = value_accept<std::string, int64_t, double, bool, local_date,
-                           local_time, local_datetime, offset_datetime>;
-        value_acceptor::accept(*this, std::forward<Visitor>(visitor),
-                               std::forward<Args>(args)...);
-    }
-    else if (is_table())
+    constexpr void parse_inline_table(cursor& c, std::size_t node)
     {
-        visitor.visit(static_cast<const table&>(*this),
-                      std::forward<Args>(args)...);
+        ++c.it;
+        skip_whitespace(c);
+        if (c.it != c.end && *c.it == '}')
+        {
+            ++c.it;
+            return;
+        }
+
+        while (true)
+        {
+            if (c.it == c.end || newline_length(c) != 0)
+                detail::static_parse_error("Unterminated inline table",
+                                           c.line);
+            parse_key_value(c, node);
+            skip_whitespace(c);
+            if (c.it != c.end && *c.it == ',')
+            {
+                ++c.it;
+                skip_whitespace(c);
+            }
+            else if (c.it != c.end && *c.it == '}')
+            {
+                ++c.it;
+                return;
+            }
+            else
+            {
+                detail::static_parse_error("Unterminated inline table",
+                                           c.line);
+            }
+        }
     }
-    else if (is_array())
+
+    /**
+     * Checks an escape sequence in a basic string, returning where it
+     * ends.
+     */
+    static constexpr const char* check_escape(const char* it,
+                                              const char* end,
+                                              std::size_t line)
     {
-        visitor.visit(static_cast<const array&>(*this),
-                      std::forward<Args>(args)...);
+        ++it;
+        if (it == end)
+            detail::static_parse_error("Invalid escape sequence", line);
+        if (*it == 'b' || *it == 't' || *it == 'n' || *it == 'f'
+            || *it == 'r' || *it == '"' || *it == '\\')
+            return it + 1;
+        if (*it != 'u' && *it != 'U')
+            detail::static_parse_error("Invalid escape sequence", line);
+
+        auto digits = *it++ == 'U' ? 8 : 4;
+        uint32_t codepoint = 0;
+        for (int i = 0; i < digits; ++i, ++it)
+        {
+            if (it == end)
+                detail::static_parse_error(
+                    "Unexpected end of unicode sequence", line);
+            if (!is_hex_digit(*it))
+                detail::static_parse_error("Invalid unicode escape sequence",
+                                           line);
+            codepoint = codepoint * 16
+                        + static_cast<uint32_t>(
+                              is_digit(*it) ? *it - '0'
+                                            : 10 + (*it | 0x20) - 'a');
+        }
+        if ((codepoint > 0xd7ff && codepoint < 0xe000) || codepoint > 0x10ffff)
+            detail::static_parse_error(
+                "Unicode escape sequence is not a Unicode scalar value",
+                line);
+        return it;
     }
-    else if (is_table_array())
+
+    static constexpr void parse_string(cursor& c, static_node& node)
     {
-        visitor.visit(static_cast<const table_array&>(*this),
-                      std::forward<Args>(args)...);
+        auto delim = *c.it;
+        node.type_ = static_type::STRING;
+        node.delim_ = delim;
+        node.multiline_ = c.end - c.it >= 3 && c.it[1] == delim
+                          && c.it[2] == delim;
+        c.it += node.multiline_ ? 3 : 1;
+        node.text_ = c.it;
+
+        while (true)
+        {
+            if (c.it == c.end)
+                detail::static_parse_error(
+                    node.multiline_ ? "Unterminated multi-line basic string"
+                                    : "Unterminated string literal",
+                    c.line);
+
+            if (newline_length(c) != 0)
+            {
+                if (!node.multiline_)
+                    detail::static_parse_error("Unterminated string literal",
+                                               c.line);
+                next_line(c);
+            }
+            else if (delim == '"' && *c.it == '\\')
+            {
+                // a backslash ending a line of a multi-line string joins
+                // it to the next one
+                auto after = c;
+                ++after.it;
+                skip_whitespace(after);
+                if (node.multiline_
+                    && (after.it == c.end || newline_length(after) != 0))
+                    c.it = after.it;
+                else
+                    c.it = check_escape(c.it, c.end, c.line);
+            }
+            else if (*c.it == delim
+                     && (!node.multiline_
+                         || (c.end - c.it >= 3 && c.it[1] == delim
+                             && c.it[2] == delim)))
+            {
+                node.text_length_ = static_cast<std::size_t>(c.it - node.text_);
+                c.it += node.multiline_ ? 3 : 1;
+                return;
+            }
+            else
+            {
+                ++c.it;
+            }
+        }
     }
-}
 
-/**
- * Writer that can be passed to accept() functions of cpptoml objects and
- * will output valid TOML to a stream.
- */
-class toml_writer
-{
-  public:
     /**
-     * Construct a toml_writer that will write to the given stream
+     * Reads n digits as a number.
      */
-    toml_writer(std::ostream& s, const std::string& indent_space = "\t")
-        : stream_(s), indent_(indent_space), has_naked_endline_(false)
+    static constexpr int read_digits(cursor& c, const char* end, int n,
+                                     const char* what)
     {
-        // nothing
+        int value = 0;
+        for (int i = 0; i < n; ++i, ++c.it)
+        {
+            if (c.it == end || !is_digit(*c.it))
+                detail::static_parse_error(what, c.line);
+            value = value * 10 + (*c.it - '0');
+        }
+        return value;
     }
 
-  public:
-    /**
-     * Output a base value of the TOML tree.
-     */
-    template <class T>
-    void visit(const value<T>& v, bool = false)
+    static constexpr void read_char(cursor& c, const char* end, char ch,
+                                    const char* what)
     {
-        write(v);
+        if (c.it == end || *c.it != ch)
+            detail::static_parse_error(what, c.line);
+        ++c.it;
+    }
+
+    static constexpr const char* span_end(const char* it, const char* end,
+                                          bool date)
+    {
+        while (it != end
+               && (is_digit(*it) || *it == ':' || *it == '.'
+                   || (date
+                       && (*it == 'T' || *it == 'Z' || *it == '-'
+                           || *it == '+'))))
+            ++it;
+        return it;
     }
 
     /**
-     * Output a table element of the TOML tree
+     * The length of the time at it, or 0 if there isn't one.
      */
-    void visit(const table& t, bool in_array = false)
+    static constexpr std::size_t time_length(const char* it, const char* end)
+    {
+        auto len = static_cast<std::size_t>(span_end(it, end, false) - it);
+        if (len < 8 || it[2] != ':' || it[5] != ':')
+            return 0;
+        return len == 8 || (it[8] == '.' && len > 9) ? len : 0;
+    }
+
+    static constexpr bool is_date(const cursor& c)
+    {
+        auto end = span_end(c.it, c.end, true);
+        auto len = end - c.it;
+        if (len < 10 || c.it[4] != '-' || c.it[7] != '-')
+            return false;
+        return len == 10
+               || (len >= 19 && c.it[10] == 'T'
+                   && time_length(c.it + 11, end) != 0);
+    }
+
+    static constexpr void read_time(cursor& c, const char* end,
+                                    local_time& t)
     {
-        write_table_header(in_array);
-        std::vector<std::string> values;
-        std::vector<std::string> tables;
+        auto time_end = span_end(c.it, end, false);
+        t.hour = read_digits(c, time_end, 2, "Malformed time");
+        read_char(c, time_end, ':', "Malformed time");
+        t.minute = read_digits(c, time_end, 2, "Malformed time");
+        read_char(c, time_end, ':', "Malformed time");
+        t.second = read_digits(c, time_end, 2, "Malformed time");
 
-        for (const auto& i : t)
+        int power = 100000;
+        if (c.it != time_end && *c.it == '.')
         {
-            if (i.second->is_table() || i.second->is_table_array())
-            {
-                tables.push_back(i.first);
-            }
-            else
+            ++c.it;
+            while (c.it != time_end && is_digit(*c.it))
             {
-                values.push_back(i.first);
+                t.microsecond += power * (*c.it++ - '0');
+                power /= 10;
             }
         }
+        if (c.it != time_end)
+            detail::static_parse_error("Malformed time", c.line);
+    }
 
-        for (unsigned int i = 0; i < values.size(); ++i)
-        {
-            path_.push_back(values[i]);
+    static constexpr void parse_time(cursor& c, static_node& node)
+    {
+        node.type_ = static_type::LOCAL_TIME;
+        read_time(c, c.end, node.datetime_);
+    }
 
-            if (i > 0)
-                endline();
+    static constexpr void parse_date(cursor& c, static_node& node)
+    {
+        auto end = span_end(c.it, c.end, true);
+        auto& dt = node.datetime_;
+        dt.year = read_digits(c, end, 4, "Malformed date");
+        read_char(c, end, '-', "Malformed date");
+        dt.month = read_digits(c, end, 2, "Malformed date");
+        read_char(c, end, '-', "Malformed date");
+        dt.day = read_digits(c, end, 2, "Malformed date");
+        node.type_ = static_type::LOCAL_DATE;
+        if (c.it == end)
+            return;
 
-            write_table_item_header(*t.get(values[i]));
-            t.get(values[i])->accept(*this, false);
-            path_.pop_back();
-        }
+        read_char(c, end, 'T', "Malformed date");
+        read_time(c, end, dt);
+        node.type_ = static_type::LOCAL_DATETIME;
+        if (c.it == end)
+            return;
 
-        for (unsigned int i = 0; i < tables.size(); ++i)
+        node.type_ = static_type::OFFSET_DATETIME;
+        if (*c.it == '+' || *c.it == '-')
         {
-            path_.push_back(tables[i]);
-
-            if (values.size() > 0 || i > 0)
-                endline();
-
-            write_table_item_header(*t.get(tables[i]));
-            t.get(tables[i])->accept(*this, false);
-            path_.pop_back();
+            int sign = *c.it++ == '+' ? 1 : -1;
+            dt.hour_offset = sign * read_digits(c, end, 2, "Malformed date");
+            read_char(c, end, ':', "Malformed date");
+            dt.minute_offset
+                = sign * read_digits(c, end, 2, "Malformed date");
         }
-
-        endline();
+        else if (*c.it == 'Z')
+        {
+            ++c.it;
+        }
+        if (c.it != end)
+            detail::static_parse_error("Malformed date", c.line);
     }
 
     /**
-     * Output an array element of the TOML tree
+     * Reads digits separated by single underscores, returning how many
+     * there were.
      */
-    void visit(const array& a, bool = false)
+    static constexpr std::size_t read_number_digits(cursor& c)
     {
-        write("[");
-
-        for (unsigned int i = 0; i < a.get().size(); ++i)
+        std::size_t count = 0;
+        while (c.it != c.end && is_digit(*c.it))
         {
-            if (i > 0)
-                write(", ");
-
-            if (a.get()[i]->is_array())
-            {
-                a.get()[i]->as_array()->accept(*this, true);
-            }
-            else
+            ++c.it;
+            ++count;
+            if (c.it != c.end && *c.it == '_')
             {
-                a.get()[i]->accept(*this, true);
+                ++c.it;
+                if (c.it == c.end || !is_digit(*c.it))
+                    detail::static_parse_error("Malformed number", c.line);
             }
         }
+        if (count == 0)
+            detail::static_parse_error("Malformed number", c.line);
+        return count;
+    }
 
-        write("]");
+    static constexpr void check_no_leading_zero(const cursor& c,
+                                                const char* number_end)
+    {
+        if (c.it != c.end && *c.it == '0' && c.it + 1 != number_end
+            && c.it[1] != '.')
+            detail::static_parse_error("Numbers may not have leading zeros",
+                                       c.line);
     }
 
-    /**
-     * Output a table_array element of the TOML tree
-     */
-    void visit(const table_array& t, bool = false)
+    static constexpr void parse_number(cursor& c, static_node& node)
     {
-        for (unsigned int j = 0; j < t.get().size(); ++j)
-        {
-            if (j > 0)
-                endline();
+        auto begin = c.it;
+        auto number_end = c.it;
+        while (number_end != c.end
+               && (is_digit(*number_end) || *number_end == '_'
+                   || *number_end == '.' || *number_end == 'e'
+                   || *number_end == 'E' || *number_end == '-'
+                   || *number_end == '+'))
+            ++number_end;
+
+        bool negative = *c.it == '-';
+        if (*c.it == '-' || *c.it == '+')
+            ++c.it;
+        check_no_leading_zero(c, number_end);
+        auto digits = c.it;
+        read_number_digits(c);
 
-            t.get()[j]->accept(*this, true);
+        if (c.it == c.end
+            || (*c.it != '.' && *c.it != 'e' && *c.it != 'E'))
+        {
+            node.type_ = static_type::INTEGER;
+            // accumulated towards the sign so that INT64_MIN fits
+            int64_t value = 0;
+            for (; digits != c.it; ++digits)
+            {
+                if (*digits == '_')
+                    continue;
+                int64_t digit = *digits - '0';
+                if (negative
+                        ? value < (std::numeric_limits<int64_t>::min() + digit)
+                                      / 10
+                        : value > (std::numeric_limits<int64_t>::max() - digit)
+                                      / 10)
+                    detail::static_parse_error(
+                        "Malformed number (out of range)", c.line);
+                value = value * 10 + (negative ? -digit : digit);
+            }
+            node.integer_ = value;
+            return;
         }
 
-        endline();
+        node.type_ = static_type::FLOAT;
+        bool is_exp = *c.it == 'e' || *c.it == 'E';
+        ++c.it;
+        if (c.it == c.end)
+            detail::static_parse_error("Floats must have trailing digits",
+                                       c.line);
+        if (!is_exp)
+        {
+            read_number_digits(c);
+            is_exp = c.it != c.end && (*c.it == 'e' || *c.it == 'E');
+            if (is_exp)
+                ++c.it;
+        }
+        if (is_exp)
+        {
+            if (c.it != c.end && (*c.it == '-' || *c.it == '+'))
+                ++c.it;
+            check_no_leading_zero(c, number_end);
+            read_number_digits(c);
+        }
+        node.text_ = begin;
+        node.text_length_ = static_cast<std::size_t>(c.it - begin);
     }
 
-    /**
-     * Escape a string for output.
-     */
-    static std::string escape_string(const std::string& str)
+    static constexpr void parse_bool(cursor& c, static_node& node)
     {
-        std::string res;
-        for (auto it = str.begin(); it != str.end(); ++it)
+        node.type_ = static_type::BOOLEAN;
+        node.integer_ = *c.it == 't';
+        const char* word = node.integer_ ? "true" : "false";
+        for (; *word != '\0'; ++word, ++c.it)
         {
-            if (*it == '\b')
-            {
-                res += "\\b";
-            }
-            else if (*it == '\t')
-            {
-                res += "\\t";
-            }
-            else if (*it == '\n')
-            {
-                res += "\\n";
-            }
-            else if (*it == '\f')
-            {
-                res += "\\f";
-            }
-            else if (*it == '\r')
-            {
-                res += "\\r";
-            }
-            else if (*it == '"')
-            {
-                res += "\\\"";
-            }
-            else if (*it == '\\')
-            {
-                res += "\\\\";
-            }
-            else if (*it >= 0x0000 && *it <= 0x001f)
-            {
-                res += "\\u";
-                std::stringstream ss;
-                ss << std::hex << static_cast<uint32_t>(*it);
-                res += ss.str();
-            }
-            else
-            {
-                res += *it;
-            }
+            if (c.it == c.end || *c.it != *word)
+                detail::static_parse_error(
+                    "Attempted to parse invalid boolean value", c.line);
         }
-        return res;
     }
 
-  protected:
-    /**
-     * Write out a string.
-     */
-    void write(const value<std::string>& v)
+    template <class T>
+    static constexpr bool holds(const static_node& n, detail::static_tag<T> tag)
     {
-        write("\"");
-        write(escape_string(v.get()));
-        write("\"");
+        return n.type_ == type_of(tag);
     }
 
-    /**
-     * Write out a double.
-     */
-    void write(const value<double>& v)
+    static constexpr bool holds(const static_node& n,
+                                detail::static_tag<double>)
     {
-        std::ios::fmtflags flags{stream_.flags()};
-
-        stream_ << std::showpoint;
-        write(v.get());
+        return n.type_ == static_type::FLOAT
+               || n.type_ == static_type::INTEGER;
+    }
 
-        stream_.flags(flags);
+    static constexpr static_type type_of(detail::static_tag<std::string>)
+    {
+        return static_type::STRING;
     }
 
-    /**
-     * Write out an integer, local_date, local_time, local_datetime, or
-     * offset_datetime.
-     */
-    template <class T>
-    typename std::enable_if<is_one_of<T, int64_t, local_date, local_time,
-                                      local_datetime,
-                                      offset_datetime>::value>::type
-    write(const value<T>& v)
+    static constexpr static_type type_of(detail::static_tag<int64_t>)
     {
-        write(v.get());
+        return static_type::INTEGER;
     }
 
-    /**
-     * Write out a boolean.
-     */
-    void write(const value<bool>& v)
+    static constexpr static_type type_of(detail::static_tag<double>)
     {
-        write((v.get() ? "true" : "false"));
+        return static_type::FLOAT;
     }
 
-    /**
-     * Write out the header of a table.
-     */
-    void write_table_header(bool in_array = false)
+    static constexpr static_type type_of(detail::static_tag<bool>)
     {
-        if (!path_.empty())
-        {
-            indent();
+        return static_type::BOOLEAN;
+    }
 
-            write("[");
+    static constexpr static_type type_of(detail::static_tag<local_date>)
+    {
+        return static_type::LOCAL_DATE;
+    }
 
-            if (in_array)
-            {
-                write("[");
-            }
+    static constexpr static_type type_of(detail::static_tag<local_time>)
+    {
+        return static_type::LOCAL_TIME;
+    }
 
-            for (unsigned int i = 0; i < path_.size(); ++i)
-            {
-                if (i > 0)
-                {
-                    write(".");
-                }
+    static constexpr static_type type_of(detail::static_tag<local_datetime>)
+    {
+        return static_type::LOCAL_DATETIME;
+    }
 
-                if (path_[i].find_first_not_of("ABCDEFGHIJKLMNOPQRSTUVWXYZabcde"
-                                               "fghijklmnopqrstuvwxyz0123456789"
-                                               "_-")
-                    == std::string::npos)
-                {
-                    write(path_[i]);
-                }
-                else
-                {
-                    write("\"");
-                    write(escape_string(path_[i]));
-                    write("\"");
-                }
-            }
+    static constexpr static_type type_of(detail::static_tag<offset_datetime>)
+    {
+        return static_type::OFFSET_DATETIME;
+    }
 
-            if (in_array)
-            {
-                write("]");
-            }
+    static std::string read(const static_node& n,
+                            detail::static_tag<std::string> tag)
+    {
+        if (!holds(n, tag))
+            detail::static_lookup_error(
+                "static document value has a different type");
+        return detail::decode_static_string(n.text_, n.text_length_,
+                                            n.delim_, n.multiline_);
+    }
 
-            write("]");
-            endline();
-        }
+    static double read(const static_node& n, detail::static_tag<double> tag)
+    {
+        if (!holds(n, tag))
+            detail::static_lookup_error(
+                "static document value has a different type");
+        if (n.type_ == static_type::INTEGER)
+            return static_cast<double>(n.integer_);
+        return detail::convert_static_float(n.text_, n.text_length_,
+                                            n.line_);
     }
 
-    /**
-     * Write out the identifier for an item in a table.
-     */
-    void write_table_item_header(const base& b)
+    static constexpr int64_t read(const static_node& n,
+                                  detail::static_tag<int64_t> tag)
     {
-        if (!b.is_table() && !b.is_table_array())
-        {
-            indent();
+        if (!holds(n, tag))
+            detail::static_lookup_error(
+                "static document value has a different type");
+        return n.integer_;
+    }
 
-            if (path_.back().find_first_not_of("ABCDEFGHIJKLMNOPQRSTUVWXYZabcde"
-                                               "fghijklmnopqrstuvwxyz0123456789"
-                                               "_-")
-                == std::string::npos)
-            {
-                write(path_.back());
-            }
-            else
-            {
-                write("\"");
-                write(escape_string(path_.back()));
-                write("\"");
-            }
+    static constexpr bool read(const static_node& n,
+                               detail::static_tag<bool> tag)
+    {
+        if (!holds(n, tag))
+            detail::static_lookup_error(
+                "static document value has a different type");
+        return n.integer_ != 0;
+    }
 
-            write(" = ");
-        }
+    static constexpr local_date read(const static_node& n,
+                                     detail::static_tag<local_date> tag)
+    {
+        if (!holds(n, tag))
+            detail::static_lookup_error(
+                "static document value has a different type");
+        return n.datetime_;
     }
 
-  private:
-    /**
-     * Indent the proper number of tabs given the size of
-     * the path.
-     */
-    void indent()
+    static constexpr local_time read(const static_node& n,
+                                     detail::static_tag<local_time> tag)
     {
-        for (std::size_t i = 1; i < path_.size(); ++i)
-            write(indent_);
+        if (!holds(n, tag))
+            detail::static_lookup_error(
+                "static document value has a different type");
+        return n.datetime_;
     }
 
-    /**
-     * Write a value out to the stream.
-     */
-    template <class T>
-    void write(const T& v)
+    static constexpr local_datetime
+    read(const static_node& n, detail::static_tag<local_datetime> tag)
     {
-        stream_ << v;
-        has_naked_endline_ = false;
+        if (!holds(n, tag))
+            detail::static_lookup_error(
+                "static document value has a different type");
+        return n.datetime_;
     }
 
-    /**
-     * Write an endline out to the stream
-     */
-    void endline()
+    static constexpr offset_datetime
+    read(const static_node& n, detail::static_tag<offset_datetime> tag)
     {
-        if (!has_naked_endline_)
+        if (!holds(n, tag))
+            detail::static_lookup_error(
+                "static document value has a different type");
+        return n.datetime_;
+    }
+
+    const char* text_;
+    std::size_t length_;
+    // the root table first, then the other nodes in document order
+    static_node nodes_[Capacity + 1];
+    std::size_t size_;
+};
+
+template <std::size_t Capacity>
+constexpr std::size_t static_document<Capacity>::npos;
+
+/**
+ * Parses a string literal into a static_document of the given capacity;
+ * see static_document.
+ */
+template <std::size_t Capacity, std::size_t N>
+constexpr static_document<Capacity>
+make_static_document(const char (&text)[N])
+{
+    return static_document<Capacity>{text, N - 1};
+}
+
+template <std::size_t Capacity>
+std::shared_ptr<table> static_document<Capacity>::to_table() const
+{
+    // parents come before their children, so one pass builds the tree
+    std::vector<std::shared_ptr<base>> built(size_);
+    auto root = make_table();
+    built[0] = root;
+    for (std::size_t i = 1; i < size_; ++i)
+    {
+        const auto& n = nodes_[i];
+        std::shared_ptr<base> b;
+        switch (n.type_)
         {
-            stream_ << "\n";
-            has_naked_endline_ = true;
+            case static_type::TABLE:
+                b = make_table();
+                break;
+            case static_type::TABLE_ARRAY:
+                b = make_table_array();
+                break;
+            case static_type::ARRAY:
+                b = make_array();
+                break;
+            case static_type::STRING:
+                b = make_value(read(n, detail::static_tag<std::string>{}));
+                break;
+            case static_type::INTEGER:
+                b = make_value(n.integer_);
+                break;
+            case static_type::FLOAT:
+                b = make_value(read(n, detail::static_tag<double>{}));
+                break;
+            case static_type::BOOLEAN:
+                b = make_value(n.integer_ != 0);
+                break;
+            case static_type::LOCAL_DATE:
+                b = make_value(read(n, detail::static_tag<local_date>{}));
+                break;
+            case static_type::LOCAL_TIME:
+                b = make_value(read(n, detail::static_tag<local_time>{}));
+                break;
+            case static_type::LOCAL_DATETIME:
+                b = make_value(read(n, detail::static_tag<local_datetime>{}));
+                break;
+            case static_type::OFFSET_DATETIME:
+                b = make_value(n.datetime_);
+                break;
         }
+
+        const auto& parent = built[n.parent_];
+        if (nodes_[n.parent_].type_ == static_type::TABLE)
+            static_cast<table&>(*parent).insert(
+                std::string{n.key_, n.key_length_}, b);
+        else if (nodes_[n.parent_].type_ == static_type::TABLE_ARRAY)
+            static_cast<table_array&>(*parent).push_back(
+                std::static_pointer_cast<table>(b));
+        else
+            static_cast<array&>(*parent).get().push_back(b);
+        built[i] = std::move(b);
     }
+    return root;
+}
 
-  private:
-    std::ostream& stream_;
-    const std::string indent_;
-    std::vector<std::string> path_;
-    bool has_naked_endline_;
+#endif
+
+#if defined(CPPTOML_TRACK_ACCESS)
+/**
+ * The number of lookups of a single key path, for access_report.
+ */
+struct key_access
+{
+    std::string key;
+    uint64_t count;
 };
 
-inline std::ostream& operator<<(std::ostream& stream, const base& b)
+/**
+ * A summary of how a document has been read, built by
+ * make_access_report() when CPPTOML_TRACK_ACCESS is defined.
+ */
+struct access_report
 {
-    toml_writer writer{stream};
-    b.accept(writer);
-    return stream;
-}
+    /// The most frequently looked up key paths, most frequent first.
+    std::vector<key_access> hottest;
 
-template <class T>
-std::ostream& operator<<(std::ostream& stream, const value<T>& v)
+    /// Key paths that have never been looked up. A table (or table array)
+    /// is listed in place of its contents when none of them has been
+    /// looked up either.
+    std::vector<std::string> unread;
+};
+
+namespace detail
 {
-    toml_writer writer{stream};
-    v.accept(writer);
-    return stream;
+/**
+ * Records the key paths in the subtree at b that have been looked up in
+ * reads, and the ones that have not in unread. Returns whether anything
+ * in the subtree has been looked up.
+ */
+inline bool collect_access(const base& b, const std::string& path,
+                           std::vector<key_access>& reads,
+                           std::vector<std::string>& unread)
+{
+    auto count = b.access_count();
+    if (count > 0)
+        reads.push_back({path, count});
+
+    auto mark = unread.size();
+    bool read = count > 0;
+    if (b.is_table())
+    {
+        for (const auto& pr : static_cast<const table&>(b))
+        {
+            auto child = path.empty() ? pr.first : path + "." + pr.first;
+            read = collect_access(*pr.second, child, reads, unread) || read;
+        }
+    }
+    else if (b.is_table_array())
+    {
+        std::size_t i = 0;
+        for (const auto& t : static_cast<const table_array&>(b))
+        {
+            auto child = path + "[" + std::to_string(i++) + "]";
+            read = collect_access(*t, child, reads, unread) || read;
+        }
+    }
+
+    // report an unread subtree as a whole, except for the root
+    if (!read && !path.empty())
+    {
+        unread.resize(mark);
+        unread.push_back(path);
+    }
+    return read;
+}
 }
 
-inline std::ostream& operator<<(std::ostream& stream, const table& t)
+/**
+ * Builds a report of the key paths in a document that have been looked
+ * up most often, and of those that have never been looked up. Only
+ * lookups by key on a table (get(), get_as(), get_qualified_as(),
+ * get_table() and so on) are counted; iterating over a table or array
+ * does not count as reading its elements.
+ */
+inline access_report make_access_report(const table& root,
+                                        std::size_t max_hottest = 20)
 {
-    toml_writer writer{stream};
-    t.accept(writer);
-    return stream;
+    access_report report;
+    detail::collect_access(root, "", report.hottest, report.unread);
+
+    auto by_count = [](const key_access& a, const key_access& b) {
+        return a.count > b.count || (a.count == b.count && a.key < b.key);
+    };
+    if (report.hottest.size() > max_hottest)
+    {
+        std::partial_sort(report.hottest.begin(),
+                          report.hottest.begin() + max_hottest,
+                          report.hottest.end(), by_count);
+        report.hottest.resize(max_hottest);
+    }
+    else
+    {
+        std::sort(report.hottest.begin(), report.hottest.end(), by_count);
+    }
+    std::sort(report.unread.begin(), report.unread.end());
+    return report;
 }
 
-inline std::ostream& operator<<(std::ostream& stream, const table_array& t)
+/**
+ * Resets the access counts of every element in a document.
+ */
+inline void reset_access_counts(const base& b)
 {
-    toml_writer writer{stream};
-    t.accept(writer);
-    return stream;
+    b.reset_access_count();
+    if (b.is_table())
+    {
+        for (const auto& entry : depth_first(static_cast<const table&>(b)))
+            entry.node().reset_access_count();
+    }
+    else if (b.is_table_array())
+    {
+        for (const auto& t : static_cast<const table_array&>(b))
+            reset_access_counts(*t);
+    }
 }
 
-inline std::ostream& operator<<(std::ostream& stream, const array& a)
+inline std::ostream& operator<<(std::ostream& stream,
+                                const access_report& report)
 {
-    toml_writer writer{stream};
-    a.accept(writer);
+    stream << "hottest keys:\n";
+    for (const auto& access : report.hottest)
+        stream << "\t" << access.count << "\t" << access.key << "\n";
+    stream << "unread keys:\n";
+    for (const auto& key : report.unread)
+        stream << "\t" << key << "\n";
     return stream;
 }
+#endif
 }
 #endif
@@ -0,0 +1,63 @@
+/**
+ * @file cpptoml.cpp
+ *
+ * Out-of-line definitions for the cpptoml_lib target. Code that links
+ * against cpptoml_lib is compiled with CPPTOML_COMPILED_LIB defined, which
+ * turns the definitions below into declarations in every other
+ * translation unit.
+ */
+
+#define CPPTOML_IMPLEMENTATION
+// the CBOR functions are compiled in so that code defining CPPTOML_CBOR
+// can link against the library too
+#define CPPTOML_CBOR
+#include "cpptoml.h"
+
+namespace cpptoml
+{
+template class value<std::string>;
+template class value<int64_t>;
+template class value<double>;
+template class value<bool>;
+template class value<local_date>;
+template class value<local_time>;
+template class value<local_datetime>;
+template class value<offset_datetime>;
+
+template class basic_parser<null_tracer>;
+template class basic_toml_writer<null_tracer>;
+
+template option<std::string>
+table::get_as<std::string>(const std::string&) const;
+template option<int64_t>
+table::get_as<int64_t>(const std::string&) const;
+template option<double>
+table::get_as<double>(const std::string&) const;
+template option<bool>
+table::get_as<bool>(const std::string&) const;
+template option<local_date>
+table::get_as<local_date>(const std::string&) const;
+template option<local_time>
+table::get_as<local_time>(const std::string&) const;
+template option<local_datetime>
+table::get_as<local_datetime>(const std::string&) const;
+template option<offset_datetime>
+table::get_as<offset_datetime>(const std::string&) const;
+
+template option<std::string>
+table::get_qualified_as<std::string>(const std::string&) const;
+template option<int64_t>
+table::get_qualified_as<int64_t>(const std::string&) const;
+template option<double>
+table::get_qualified_as<double>(const std::string&) const;
+template option<bool>
+table::get_qualified_as<bool>(const std::string&) const;
+template option<local_date>
+table::get_qualified_as<local_date>(const std::string&) const;
+template option<local_time>
+table::get_qualified_as<local_time>(const std::string&) const;
+template option<local_datetime>
+table::get_qualified_as<local_datetime>(const std::string&) const;
+template option<offset_datetime>
+table::get_qualified_as<offset_datetime>(const std::string&) const;
+}